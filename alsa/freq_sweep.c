@@ -4,15 +4,37 @@
 /* This is a simplified and modified version of the example code at           */
 /* https://www.alsa-project.org/alsa-doc/alsa-lib/_2test_2pcm_8c-example.html */
 /* Work in progress                                                           */
+/* The signal is rendered in float and converted, with TPDF dither, to the    */
+/* deepest sample format the device accepts (pcm_format.h).                   */
+/* With -o file the sweep is rendered offline into a WAV (.wav) or raw 16-bit */
+/* file as fast as possible, without opening a sound device                   */
+/* With -m the sweep is written straight into the device ring buffer through  */
+/* snd_pcm_mmap_begin()/snd_pcm_mmap_commit() instead of being copied by      */
+/* snd_pcm_writei(); either way the CPU time spent per period is printed      */
+/* With -p the sweep is written from a poll() loop on a non-blocking handle   */
+/* (pcm_poll.h), which prints its wakeups per second and idle CPU instead     */
+/* The sweep is a chirp (dsp/chirp): the phase of every frame is computed     */
+/* from its position in the stream, linear by default or exponential with -l, */
+/* so the frequency glides smoothly over every sample however long it plays.  */
 /******************************************************************************/
 
 #include <stdio.h>
 #include <alsa/asoundlib.h>
 #include <inttypes.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "chirp.h"
+#include "pcm_format.h"
+#include "channels.h"
+#include "rt_arena.h"
+#include "rt_check.h"
+#include "wavetable.h"
+#include "offline.h"
+#include "pcm_poll.h"
 
 static char *sound_device = "default"; /* playback device */
-static snd_pcm_format_t sample_format = SND_PCM_FORMAT_S16_LE; /* sample format */
+static snd_pcm_format_t sample_format = SND_PCM_FORMAT_S16_LE; /* sample format, negotiated */
 static unsigned int nb_channels = 2; /* number of channels, 2 for stereo */
 static unsigned int sample_rate = 44100; /* sample rate in Hz */
 static unsigned int buffer_time = 500000; /* ring buffer length in us */
@@ -20,15 +42,24 @@ static unsigned int period_time = 100000; /* period time in us */
 static double sine_start_freq = 1000; /* sinusoidal wave start frequency in Hz */
 static double sine_stop_freq = 1000; /* sinusoidal wave stop frequency in Hz */
 static unsigned int playback_duration = 5; /* duration of playback in seconds */
+static wavetable *waveform = NULL; /* band-limited waveform, NULL for a sine */
+static const char *output_file = NULL; /* render to this file instead of playing */
+static chirp_shape sweep_shape = CHIRP_LINEAR; /* CHIRP_EXPONENTIAL with -l */
+static chirp sweep; /* from sine_start_freq to sine_stop_freq over the playback */
+
+#define SINE_CHUNK (256) /* frames rendered and converted at a time */
+#define MAX_CHANNELS (8)
 
 static snd_pcm_sframes_t buffer_size; /* size of buffer size in samples (tbc) */
 static snd_pcm_sframes_t period_size; /* size of period in samples (tbc) */
+static converter conversion; /* from the rendered floats to sample_format */
 
 static int set_hwparams(snd_pcm_t *handle,
             snd_pcm_hw_params_t *params,
             snd_pcm_access_t access)
 {
     unsigned int rrate;
+    convert_format format;
     snd_pcm_uframes_t size;
     int err, dir;
 
@@ -52,11 +83,12 @@ static int set_hwparams(snd_pcm_t *handle,
         return err;
     }
     /* set the sample format */
-    err = snd_pcm_hw_params_set_format(handle, params, sample_format);
+    err = pcm_format_negotiate(handle, params, &sample_format, &format);
     if (err < 0) {
         printf("Sample format not available for playback: %s\n", snd_strerror(err));
         return err;
     }
+    converter_init(&conversion, format, 1, 0);
     printf("Sample format: %s (%u bits per sample)\n",snd_pcm_format_name(sample_format),
         snd_pcm_format_physical_width(sample_format));
     /* set the count of channels */
@@ -166,47 +198,73 @@ static int xrun_recovery(snd_pcm_t *handle, int err)
     return err;
 }
 
-static void generate_sine(snd_pcm_sframes_t _period_size, unsigned int _nb_channels, 
-                          int16_t *_samples, double *_phase, int _frequency) {
-    static double max_phase = 2. * M_PI;
-    double phase = *_phase;
-    double step = max_phase*_frequency/(double)sample_rate;
-    unsigned int i = 0;
-    int16_t res;
+/* Periods in playback_duration, counted in 64 bits: any duration fits */
+static unsigned long playback_periods(void) {
+    return (unsigned long long) playback_duration * 1000000 / period_time;
+}
+
+/* The sweep spans every period played */
+static void sweep_init(void) {
+    chirp_init(&sweep, sample_rate, sine_start_freq, sine_stop_freq,
+               playback_periods() * period_size, sweep_shape);
+}
 
-    unsigned int chn;
-    int format_bits = snd_pcm_format_width(sample_format);
-    unsigned int maxval = (1 << (format_bits - 1)) - 1;
+static void generate_sine(snd_pcm_sframes_t _period_size, unsigned int _nb_channels, 
+                          void *_samples, unsigned long *_position) {
+    unsigned long position = *_position;
+    float chunk[SINE_CHUNK];
+    float frames[SINE_CHUNK * MAX_CHANNELS];
+    char *out = _samples;
+    snd_pcm_sframes_t i = 0;
+    unsigned int n;
 
+    /* Rendering must not allocate or lock: see rt_check.h */
+    rt_check_enter();
     while (i < _period_size) {
-        res = sin(phase) * maxval;
-        _samples[2*i] = res;
-        _samples[2*i+1] = res;
-        phase += step;
-        if (phase >= max_phase)
-            phase -= max_phase;
-        i++;
+        n = _period_size - i < SINE_CHUNK ? _period_size - i : SINE_CHUNK;
+        if (waveform != NULL) {
+            /* A wavetable plays one frequency per chunk: the mean one, from */
+            /* the exact phase, so each chunk starts where the sweep is      */
+            wavetable_render(waveform, chunk, n, chirp_phase(&sweep, position),
+                             chirp_cycles(&sweep, position, n) * sample_rate / n);
+        } else {
+            chirp_render(&sweep, chunk, position, n);
+        }
+        position += n;
+        channels_fan_out(chunk, frames, _nb_channels, n);
+        /* Render in float, convert once to whatever the device takes */
+        convert_block(&conversion, frames, out, n * _nb_channels);
+        out += n * _nb_channels * convert_bytes(conversion.format);
+        i += n;
     }
-    *_phase = phase;
+    *_position = position;
+    rt_check_leave();
+}
+
+static double thread_cpu_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
 static int playback(snd_pcm_t *handle,
-                 int16_t *samples)
+                 char *samples)
 {
-    double phase = 0;
-    int16_t *ptr;
+    unsigned long position = 0;
+    char *ptr;
     int err, cptr;
-    int frequency = sine_start_freq;
-    int iterations = playback_duration * 1000000 / period_time;
-    double step = (sine_stop_freq - sine_start_freq) / iterations;
+    unsigned long iterations = playback_periods();
     while (iterations > 0) {
-        generate_sine(period_size, nb_channels, samples, &phase, frequency);
+        generate_sine(period_size, nb_channels, samples, &position);
         ptr = samples;
         cptr = period_size;
         while (cptr > 0) {
             err = snd_pcm_writei(handle, ptr, cptr);
-            if (err == -EAGAIN)
+            if (err == -EAGAIN) {
+                /* Non-blocking handle: sleep until there is room */
+                snd_pcm_wait(handle, 1000);
                 continue;
+            }
             if (err < 0) {
                 if (xrun_recovery(handle, err) < 0) {
                     printf("Write error: %s\n", snd_strerror(err));
@@ -214,12 +272,142 @@ static int playback(snd_pcm_t *handle,
                 }
                 break;  /* skip one period */
             }
-            ptr += err * nb_channels;
+            ptr += err * nb_channels * convert_bytes(conversion.format);
             cptr -= err;
         }
         iterations--;
-        frequency += step;
     }
+    return 0;
+}
+
+/* Same periods as playback(), rendered in place in the device ring buffer */
+static int playback_mmap(snd_pcm_t *handle)
+{
+    unsigned long position = 0;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames, size;
+    snd_pcm_sframes_t avail, committed;
+    snd_pcm_state_t state;
+    char *ptr;
+    int err, started = 0;
+    unsigned long iterations = playback_periods();
+    while (iterations > 0) {
+        state = snd_pcm_state(handle);
+        if (state == SND_PCM_STATE_XRUN || state == SND_PCM_STATE_SUSPENDED) {
+            err = xrun_recovery(handle, state == SND_PCM_STATE_XRUN ? -EPIPE : -ESTRPIPE);
+            if (err < 0) {
+                printf("Recovery error: %s\n", snd_strerror(err));
+                return err;
+            }
+            started = 0;
+        }
+        avail = snd_pcm_avail_update(handle);
+        if (avail < 0) {
+            err = xrun_recovery(handle, avail);
+            if (err < 0) {
+                printf("Avail update error: %s\n", snd_strerror(err));
+                return err;
+            }
+            started = 0;
+            continue;
+        }
+        if (avail < period_size) {
+            /* The buffer is full: start the stream once, then wait for room */
+            if (!started) {
+                started = 1;
+                err = snd_pcm_start(handle);
+                if (err < 0) {
+                    printf("Start error: %s\n", snd_strerror(err));
+                    return err;
+                }
+            } else {
+                err = snd_pcm_wait(handle, -1);
+                if (err < 0) {
+                    if ((err = xrun_recovery(handle, err)) < 0) {
+                        printf("Wait error: %s\n", snd_strerror(err));
+                        return err;
+                    }
+                    started = 0;
+                }
+            }
+            continue;
+        }
+        size = period_size;
+        while (size > 0) {
+            /* The period may wrap around the end of the ring buffer */
+            frames = size;
+            err = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+            if (err < 0) {
+                if ((err = xrun_recovery(handle, err)) < 0) {
+                    printf("Mmap begin error: %s\n", snd_strerror(err));
+                    return err;
+                }
+                started = 0;
+                continue;
+            }
+            /* Interleaved: every channel shares the first area */
+            ptr = (char *) areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+            generate_sine(frames, nb_channels, ptr, &position);
+            committed = snd_pcm_mmap_commit(handle, offset, frames);
+            if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+                if ((err = xrun_recovery(handle, committed >= 0 ? -EPIPE : committed)) < 0) {
+                    printf("Mmap commit error: %s\n", snd_strerror(err));
+                    return err;
+                }
+                started = 0;
+            }
+            size -= frames;
+        }
+        iterations--;
+    }
+    return 0;
+}
+
+/* Offline rendering produces the same periods as playback() */
+static void sweep_render(void *data, void *out, unsigned long frames,
+                         double time) {
+    generate_sine(frames, nb_channels, out, data);
+}
+
+static int render_offline(void) {
+    unsigned long position = 0;
+
+    period_size = (snd_pcm_sframes_t) sample_rate * period_time / 1000000;
+    sweep_init();
+    converter_init(&conversion, CONVERT_S16, 1, 0);
+    return offline_render(output_file, OFFLINE_S16, nb_channels, sample_rate,
+                          period_size, (double) playback_periods() * period_size / sample_rate,
+                          sweep_render, &position);
+}
+
+static void sweep_period(void *data, void *out, unsigned long frames) {
+    sweep_render(data, out, frames, 0);
+}
+
+/* Same periods as playback(), written whenever poll() says there is room */
+static int playback_poll(snd_pcm_t *handle) {
+    pcm_poll_stream stream;
+    pcm_poll engine;
+    unsigned long position = 0;
+    int err;
+
+    if (pcm_poll_stream_init(&stream, handle, sweep_period, &position, period_size,
+                             playback_periods() * period_size,
+                             nb_channels * snd_pcm_format_physical_width(sample_format) / 8) < 0) {
+        printf("Not enough memory\n");
+        return -1;
+    }
+    if ((err = pcm_poll_init(&engine, &stream, 1)) < 0) {
+        printf("Poll descriptors error: %s\n", snd_strerror(err));
+        free(stream.samples);
+        return err;
+    }
+    err = pcm_poll_run(&engine);
+    if (err < 0)
+        printf("Playback error: %s\n", snd_strerror(err));
+    pcm_poll_print(&engine);
+    pcm_poll_free(&engine);
+    return err;
 }
 
 int main(int argc, char *argv[]) {
@@ -228,13 +416,53 @@ int main(int argc, char *argv[]) {
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *hwparams;
     snd_pcm_sw_params_t *swparams;
-    int16_t *samples;
+    char *samples;
+    rt_arena arena;
+    size_t bytes;
+    wavetable table;
+    snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED;
+    double cpu;
+    int opt, poll_loop = 0;
 
-    if(argc==4){
+    /* -m and -p pick different write loops: the second one given is refused */
+    while ((opt = getopt(argc, argv, "o:mpl")) != -1) {
+        if (opt == 'o') {
+            output_file = optarg;
+        } else if (opt == 'm' && !poll_loop) {
+            access = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+        } else if (opt == 'p' && access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+            poll_loop = 1;
+        } else if (opt == 'l') {
+            sweep_shape = CHIRP_EXPONENTIAL;
+        } else {
+            printf("Usage: freq_sweep [-o file] [-m | -p] [-l] [duration start_freq stop_freq [waveform]]\n");
+            return -1;
+        }
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if(argc==4 || argc==5){
         playback_duration = atoi(argv[1]);
         sine_start_freq = atoi(argv[2]);
         sine_stop_freq = atoi(argv[3]);
     }
+    /* Optional waveform: sine, saw, square, triangle or harmonic amplitudes */
+    if(argc==5){
+        if (wavetable_build_named(&table, argv[4], sample_rate) < 0) {
+            printf("Unknown waveform %s\n", argv[4]);
+            return -1;
+        }
+        waveform = &table;
+    }
+
+    if (output_file != NULL) {
+        err = render_offline();
+        if (waveform != NULL)
+            wavetable_free(waveform);
+        return err;
+    }
         
 
     /* Allocate memory for hardware and software parameters */
@@ -256,7 +484,7 @@ int main(int argc, char *argv[]) {
 
     /* Set hardware parameters for the playback */
     /* We use interleaved mode, for left and right channels in the stereo stream */
-    if ((err = set_hwparams(handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0)) {
+    if ((err = set_hwparams(handle, hwparams, access)) < 0) {
         printf("Setting of hardware parameters failed: %s\n", snd_strerror(err));
         return err;
     }
@@ -267,16 +495,38 @@ int main(int argc, char *argv[]) {
         return err;
     }
 
-    /* Set aside memory for samples */
-    samples = malloc((period_size * nb_channels * snd_pcm_format_physical_width(sample_format)) / 8);
-    if (samples == NULL) {
+    sweep_init();
+
+    /* Set aside memory for samples, resident before playback starts */
+    bytes = (period_size * nb_channels * snd_pcm_format_physical_width(sample_format)) / 8;
+    if (rt_arena_init(&arena, bytes) < 0) {
         printf("Not enough memory\n");
         return -1;
     }
+    samples = rt_arena_alloc(&arena, bytes);
+
+    if (poll_loop) {
+        err = playback_poll(handle);
+        rt_arena_free(&arena);
+        if (waveform != NULL)
+            wavetable_free(waveform);
+        snd_pcm_close(handle);
+        return err;
+    }
 
-    playback(handle, samples);
+    cpu = thread_cpu_time();
+    if (access == SND_PCM_ACCESS_MMAP_INTERLEAVED)
+        playback_mmap(handle);
+    else
+        playback(handle, samples);
+    cpu = thread_cpu_time() - cpu;
+    printf("%s: %.1f us of CPU per period of %ld frames\n",
+           access == SND_PCM_ACCESS_MMAP_INTERLEAVED ? "mmap" : "writei",
+           1e6 * cpu / playback_periods(), (long) period_size);
    
-    free(samples);
+    rt_arena_free(&arena);
+    if (waveform != NULL)
+        wavetable_free(waveform);
     snd_pcm_close(handle);
     return 0;
 
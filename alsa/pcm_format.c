@@ -0,0 +1,35 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Sample format negotiation between the float renderers and the device       */
+/******************************************************************************/
+
+#include "pcm_format.h"
+
+/* In order of preference */
+static const struct {
+    snd_pcm_format_t format;
+    convert_format convert;
+} formats[] = {
+    { SND_PCM_FORMAT_S32_LE, CONVERT_S32 },
+    { SND_PCM_FORMAT_S24_LE, CONVERT_S24 },
+    { SND_PCM_FORMAT_S24_3LE, CONVERT_S24_3 },
+    { SND_PCM_FORMAT_S16_LE, CONVERT_S16 },
+    { SND_PCM_FORMAT_FLOAT_LE, CONVERT_FLOAT }
+};
+
+#define NB_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+int pcm_format_negotiate(snd_pcm_t *handle, snd_pcm_hw_params_t *params,
+                         snd_pcm_format_t *format, convert_format *convert) {
+    unsigned int i;
+
+    for (i=0; i<NB_FORMATS; i++) {
+        if (snd_pcm_hw_params_test_format(handle, params, formats[i].format) == 0) {
+            *format = formats[i].format;
+            *convert = formats[i].convert;
+            return snd_pcm_hw_params_set_format(handle, params, *format);
+        }
+    }
+    return -EINVAL;
+}
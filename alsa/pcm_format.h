@@ -0,0 +1,27 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Sample format negotiation between the float renderers and the device       */
+/*                                                                            */
+/* The programs render in float and convert once per block with convert.h.    */
+/* The device is offered the formats the converter can produce, deepest       */
+/* integer formats first and float last, and the first one it accepts is      */
+/* set in the hardware parameters.                                            */
+/******************************************************************************/
+
+#ifndef PCM_FORMAT_H
+#define PCM_FORMAT_H
+
+#include <alsa/asoundlib.h>
+#include "convert.h"
+
+/******************************************************************************/
+/* pcm_format_negotiate: set the best format the device takes in params       */
+/* format, convert: set to the ALSA format chosen and matching conversion     */
+/* Returns 0, or a negative ALSA error if the device takes none of them.      */
+/******************************************************************************/
+
+int pcm_format_negotiate(snd_pcm_t *handle, snd_pcm_hw_params_t *params,
+                         snd_pcm_format_t *format, convert_format *convert);
+
+#endif
@@ -0,0 +1,195 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Event-driven playback of several PCM streams from one thread               */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "pcm_poll.h"
+
+static double now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int pcm_poll_stream_init(pcm_poll_stream *stream, snd_pcm_t *handle,
+                         pcm_poll_fn render, void *data, unsigned long period,
+                         unsigned long frames, unsigned int frame_bytes) {
+    stream->handle = handle;
+    stream->render = render;
+    stream->data = data;
+    stream->period = period;
+    stream->frames = frames;
+    stream->frame_bytes = frame_bytes;
+    stream->offset = 0;
+    stream->pending = 0;
+    stream->xruns = 0;
+    stream->done = frames == 0;
+    stream->samples = malloc(period * frame_bytes);
+    return stream->samples == NULL ? -1 : 0;
+}
+
+int pcm_poll_init(pcm_poll *engine, pcm_poll_stream *streams, unsigned int count) {
+    unsigned int i;
+    int n, err;
+
+    engine->streams = streams;
+    engine->count = count;
+    engine->nfds = 0;
+    for (i=0; i<count; i++) {
+        n = snd_pcm_poll_descriptors_count(streams[i].handle);
+        if (n <= 0)
+            return n < 0 ? n : -EINVAL;
+        streams[i].first_fd = engine->nfds;
+        streams[i].nfds = n;
+        engine->nfds += n;
+    }
+    engine->fds = malloc(engine->nfds * sizeof(struct pollfd));
+    if (engine->fds == NULL)
+        return -ENOMEM;
+    for (i=0; i<count; i++) {
+        err = snd_pcm_poll_descriptors(streams[i].handle, engine->fds + streams[i].first_fd,
+                                       streams[i].nfds);
+        if (err < 0 || (err = snd_pcm_nonblock(streams[i].handle, 1)) < 0) {
+            free(engine->fds);
+            engine->fds = NULL;
+            return err;
+        }
+    }
+    return 0;
+}
+
+/* Render and write periods until the stream would block, or ends. A period */
+/* is only rendered once the last one is written whole: what a short or      */
+/* refused write leaves is kept and written first on the next wakeup.        */
+static int service(pcm_poll *engine, pcm_poll_stream *stream) {
+    snd_pcm_sframes_t avail, written;
+    unsigned long frames;
+    int err;
+
+    while (stream->pending > 0 || stream->frames > 0) {
+        if (stream->pending == 0) {
+            avail = snd_pcm_avail_update(stream->handle);
+            if (avail < 0) {
+                stream->xruns++;
+                if ((err = snd_pcm_recover(stream->handle, avail, 1)) < 0)
+                    return err;
+                continue;
+            }
+            frames = stream->frames < stream->period ? stream->frames : stream->period;
+            if ((unsigned long) avail < frames)
+                return 0;
+            stream->render(stream->data, stream->samples, frames);
+            engine->periods++;
+            stream->frames -= frames;
+            stream->offset = 0;
+            stream->pending = frames;
+        }
+        written = snd_pcm_writei(stream->handle, (char *) stream->samples +
+                                 stream->offset * stream->frame_bytes, stream->pending);
+        if (written == -EAGAIN)
+            return 0;
+        if (written < 0) {
+            stream->xruns++;
+            if ((err = snd_pcm_recover(stream->handle, written, 1)) < 0)
+                return err;
+            /* The rest of a period lost to an xrun is skipped, as the */
+            /* blocking loops do                                       */
+            written = stream->pending;
+        }
+        stream->offset += written;
+        stream->pending -= written;
+    }
+    return 0;
+}
+
+int pcm_poll_run(pcm_poll *engine) {
+    pcm_poll_stream *stream;
+    unsigned short revents;
+    unsigned int i, j, active = 0;
+    double wall, cpu;
+    int err = 0;
+
+    engine->wakeups = 0;
+    engine->periods = 0;
+    wall = now(CLOCK_MONOTONIC);
+    cpu = now(CLOCK_THREAD_CPUTIME_ID);
+
+    /* Fill every buffer up front: the writes themselves start the streams */
+    for (i=0; i<engine->count; i++) {
+        stream = &engine->streams[i];
+        if (!stream->done && (err = service(engine, stream)) < 0)
+            goto out;
+        active += !stream->done;
+    }
+
+    while (active > 0) {
+        if (poll(engine->fds, engine->nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            err = -errno;
+            goto out;
+        }
+        engine->wakeups++;
+        for (i=0; i<engine->count; i++) {
+            stream = &engine->streams[i];
+            if (stream->done)
+                continue;
+            err = snd_pcm_poll_descriptors_revents(stream->handle,
+                                                   engine->fds + stream->first_fd,
+                                                   stream->nfds, &revents);
+            if (err < 0)
+                goto out;
+            if (revents & (POLLOUT | POLLERR)) {
+                /* POLLERR is an xrun or a suspend, which service() recovers */
+                if ((err = service(engine, stream)) < 0)
+                    goto out;
+            }
+            if (stream->frames == 0 && stream->pending == 0) {
+                /* Stop polling it; poll() skips negative descriptors */
+                for (j=0; j<stream->nfds; j++)
+                    engine->fds[stream->first_fd + j].fd = -1;
+                stream->done = 1;
+                active--;
+            }
+        }
+    }
+
+out:
+    engine->cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    engine->wall = now(CLOCK_MONOTONIC) - wall;
+    for (i=0; i<engine->count; i++) {
+        snd_pcm_nonblock(engine->streams[i].handle, 0);
+        if (err == 0)
+            snd_pcm_drain(engine->streams[i].handle);
+    }
+    return err;
+}
+
+void pcm_poll_print(pcm_poll *engine) {
+    unsigned long xruns = 0;
+    double busy = engine->wall > 0 ? 100 * engine->cpu / engine->wall : 0;
+    unsigned int i;
+
+    for (i=0; i<engine->count; i++)
+        xruns += engine->streams[i].xruns;
+    printf("%u streams: %.1f wakeups/s, %.2f periods per wakeup, "
+           "CPU busy %.3f%% (idle %.3f%%), %lu xruns\n", engine->count,
+           engine->wall > 0 ? engine->wakeups / engine->wall : 0,
+           engine->wakeups > 0 ? (double) engine->periods / engine->wakeups : 0,
+           busy, 100 - busy, xruns);
+}
+
+void pcm_poll_free(pcm_poll *engine) {
+    unsigned int i;
+
+    for (i=0; i<engine->count; i++) {
+        free(engine->streams[i].samples);
+        engine->streams[i].samples = NULL;
+    }
+    free(engine->fds);
+    engine->fds = NULL;
+}
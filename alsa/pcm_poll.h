@@ -0,0 +1,79 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Event-driven playback of several PCM streams from one thread               */
+/*                                                                            */
+/* The streams are switched to non-blocking mode and their poll descriptors   */
+/* are gathered into one poll() call, so the thread sleeps until some stream  */
+/* has at least avail_min frames free, then renders and writes whole periods  */
+/* into every stream that is ready, until it would block again. Nothing       */
+/* spins on -EAGAIN, and a single thread serves any number of streams.        */
+/*                                                                            */
+/* Each stream must already have its hardware and software parameters set,    */
+/* with avail_min at its period size and a start threshold the first writes   */
+/* reach; the engine reports how often it woke up and how much of the time    */
+/* its thread spent on the CPU.                                               */
+/******************************************************************************/
+
+#ifndef PCM_POLL_H
+#define PCM_POLL_H
+
+#include <poll.h>
+#include <alsa/asoundlib.h>
+
+/* Render frames interleaved frames, in the stream's format, into out */
+typedef void (*pcm_poll_fn)(void *data, void *out, unsigned long frames);
+
+typedef struct {
+    snd_pcm_t *handle;
+    pcm_poll_fn render;
+    void *data;
+    unsigned long period;       /* frames per render and write */
+    unsigned long frames;       /* frames left to render */
+    unsigned int frame_bytes;
+    void *samples;              /* one period */
+    unsigned long offset;       /* frames of samples already written */
+    unsigned long pending;      /* frames of samples rendered, not written yet */
+    unsigned int first_fd;      /* this stream's slice of the engine's fds */
+    unsigned int nfds;
+    unsigned long xruns;
+    int done;
+} pcm_poll_stream;
+
+typedef struct {
+    pcm_poll_stream *streams;
+    unsigned int count;
+    struct pollfd *fds;
+    unsigned int nfds;
+    /* Statistics of the last pcm_poll_run() */
+    unsigned long wakeups;      /* returns from poll() */
+    unsigned long periods;      /* renders over all streams */
+    double wall;                /* seconds */
+    double cpu;                 /* seconds of the engine thread */
+} pcm_poll;
+
+/******************************************************************************/
+/* pcm_poll_stream_init: describe one stream for the engine                   */
+/* period: frames rendered and written at a time, normally the period size    */
+/* frames: total frames to play                                               */
+/* frame_bytes: bytes of one interleaved frame                                */
+/* Returns 0, or -1 if memory runs out.                                       */
+/******************************************************************************/
+
+int pcm_poll_stream_init(pcm_poll_stream *stream, snd_pcm_t *handle,
+                         pcm_poll_fn render, void *data, unsigned long period,
+                         unsigned long frames, unsigned int frame_bytes);
+
+/* Gather the poll descriptors of count streams. Returns 0 or an ALSA error. */
+int pcm_poll_init(pcm_poll *engine, pcm_poll_stream *streams, unsigned int count);
+
+/* Play every stream to its end, then drain them. Returns 0 or an ALSA error. */
+int pcm_poll_run(pcm_poll *engine);
+
+/* Wakeups per second, periods per wakeup, CPU busy and idle shares, xruns */
+void pcm_poll_print(pcm_poll *engine);
+
+/* Free the engine and the streams' period buffers; the handles stay open */
+void pcm_poll_free(pcm_poll *engine);
+
+#endif
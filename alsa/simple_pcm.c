@@ -4,15 +4,45 @@
 /* This is a simplified and modified version of the example code at           */
 /* https://www.alsa-project.org/alsa-doc/alsa-lib/_2test_2pcm_8c-example.html */
 /* Work in progress                                                           */
+/* The signal is rendered in float and converted, with TPDF dither, to the    */
+/* deepest sample format the device accepts (pcm_format.h).                   */
+/* With -m the sine is written straight into the device ring buffer through   */
+/* snd_pcm_mmap_begin()/snd_pcm_mmap_commit() instead of being copied by      */
+/* snd_pcm_writei(). Each run prints the CPU time spent per period; -b plays  */
+/* the tone once with each access mode to compare them.                       */
+/* With -p streams the tone is played on that many streams at once, all       */
+/* served by one thread that sleeps in poll() between periods (pcm_poll.h),   */
+/* which prints its wakeups per second and idle CPU.                          */
+/* Underruns and suspends are counted and timestamped for every run.          */
+/* With -t seconds the latency is tuned instead: periods are halved from the  */
+/* current one, trying 2, 3 then 4 periods per buffer, as long as a run of    */
+/* that many seconds ends without an xrun and its CPU time per period, render */
+/* and write, fits in half a period. The smallest passing combination is      */
+/* saved to the -s file (simple_pcm.latency by default), which later runs     */
+/* load. -D picks the device, e.g. null to tune headless.                     */
+/* With -n the device is opened non-interleaved: the tone is rendered and     */
+/* converted for one channel only, and that buffer is written as every        */
+/* channel with snd_pcm_writen(). -b also plays this way.                     */
+/* The tone keeps its phase in fixed point (dsp/nco): it never drifts.        */
+/* Usage: simple_pcm [-D device] [-s file]                                    */
+/*                   [-t seconds | -m | -n | -b | -p streams] [frequency]     */
 /******************************************************************************/
 
 #include <stdio.h>
 #include <alsa/asoundlib.h>
 #include <inttypes.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "nco.h"
+#include "pcm_format.h"
+#include "channels.h"
+#include "rt_arena.h"
+#include "rt_check.h"
+#include "pcm_poll.h"
 
 static char *sound_device = "default"; /* playback device */
-static snd_pcm_format_t sample_format = SND_PCM_FORMAT_S16_LE; /* sample format */
+static snd_pcm_format_t sample_format = SND_PCM_FORMAT_S16_LE; /* sample format, negotiated */
 static unsigned int nb_channels = 2; /* number of channels, 2 for stereo */
 static unsigned int sample_rate = 44100; /* sample rate in Hz */
 static unsigned int buffer_time = 500000; /* ring buffer length in us */
@@ -20,14 +50,40 @@ static unsigned int period_time = 100000; /* period time in us */
 static double sine_freq = 1000; /* sinusoidal wave frequency in Hz */
 static unsigned int playback_duration = 5; /* duration of playback in seconds */
 
+#define SINE_CHUNK (256) /* frames handed to the sine kernel at a time */
+#define MAX_CHANNELS (8)
+#define XRUN_LOG (32) /* xruns whose time is kept per run */
+#define MIN_PERIOD_TIME (1000) /* shortest period the tuner tries, in us */
+#define TUNE_HEADROOM (0.5) /* share of a period its CPU time may take when tuning */
+
+static const char *latency_file = "simple_pcm.latency"; /* tuned buffer and period times */
+
+/* Xruns of the current run, times in seconds since it started */
+static struct {
+    double start;
+    unsigned int underruns;
+    unsigned int suspends;
+    unsigned int logged;
+    double time[XRUN_LOG];
+    int suspend[XRUN_LOG];
+} xruns;
+
+/* CPU time spent rendering in the current run */
+static double render_time;
+static unsigned long render_frames;
+/* CPU seconds per period of the last run, rendering and writing */
+static double period_cpu;
+
 static snd_pcm_sframes_t buffer_size; /* size of buffer size in samples (tbc) */
 static snd_pcm_sframes_t period_size; /* size of period in samples (tbc) */
+static converter conversion; /* from the rendered floats to sample_format */
 
 static int set_hwparams(snd_pcm_t *handle,
             snd_pcm_hw_params_t *params,
             snd_pcm_access_t access)
 {
     unsigned int rrate;
+    convert_format format;
     snd_pcm_uframes_t size;
     int err, dir;
 
@@ -51,11 +107,12 @@ static int set_hwparams(snd_pcm_t *handle,
         return err;
     }
     /* set the sample format */
-    err = snd_pcm_hw_params_set_format(handle, params, sample_format);
+    err = pcm_format_negotiate(handle, params, &sample_format, &format);
     if (err < 0) {
         printf("Sample format not available for playback: %s\n", snd_strerror(err));
         return err;
     }
+    converter_init(&conversion, format, 1, 0);
     printf("Sample format: %s (%u bits per sample)\n",snd_pcm_format_name(sample_format),
         snd_pcm_format_physical_width(sample_format));
     /* set the count of channels */
@@ -144,8 +201,41 @@ static int set_swparams(snd_pcm_t *handle, snd_pcm_sw_params_t *swparams)
     return 0;
 }
 
+static double monotonic_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void xruns_reset(void) {
+    xruns.start = monotonic_time();
+    xruns.underruns = 0;
+    xruns.suspends = 0;
+    xruns.logged = 0;
+}
+
+static void xruns_print(void) {
+    unsigned int i;
+
+    printf("%u underruns, %u suspends\n", xruns.underruns, xruns.suspends);
+    for (i=0; i<xruns.logged; i++)
+        printf("  %s at %.3f s\n", xruns.suspend[i] ? "suspend" : "underrun", xruns.time[i]);
+    if (xruns.underruns + xruns.suspends > xruns.logged)
+        printf("  (%u more not logged)\n", xruns.underruns + xruns.suspends - xruns.logged);
+}
+
 static int xrun_recovery(snd_pcm_t *handle, int err)
 {
+    if (err == -EPIPE || err == -ESTRPIPE) {
+        if (err == -EPIPE)
+            xruns.underruns++;
+        else
+            xruns.suspends++;
+        if (xruns.logged < XRUN_LOG) {
+            xruns.time[xruns.logged] = monotonic_time() - xruns.start;
+            xruns.suspend[xruns.logged++] = err == -ESTRPIPE;
+        }
+    }
     printf("Stream recovery\n");
     if (err == -EPIPE) {    /* under-run */
         err = snd_pcm_prepare(handle);
@@ -166,44 +256,62 @@ static int xrun_recovery(snd_pcm_t *handle, int err)
 }
 
 static void generate_sine(snd_pcm_sframes_t _period_size, unsigned int _nb_channels, 
-                          int16_t *_samples, double *_phase) {
-    static double max_phase = 2. * M_PI;
-    double phase = *_phase;
-    double step = max_phase*sine_freq/(double)sample_rate;
-    unsigned int i = 0;
-    int16_t res;
-
-    unsigned int chn;
-    int format_bits = snd_pcm_format_width(sample_format);
-    unsigned int maxval = (1 << (format_bits - 1)) - 1;
+                          void *_samples, nco *_osc) {
+    float chunk[SINE_CHUNK];
+    float frames[SINE_CHUNK * MAX_CHANNELS];
+    char *out = _samples;
+    snd_pcm_sframes_t i = 0;
+    unsigned int n;
 
+    /* Rendering must not allocate or lock: see rt_check.h */
+    rt_check_enter();
     while (i < _period_size) {
-        res = sin(phase) * maxval;
-        _samples[2*i] = res;
-        _samples[2*i+1] = res;
-        phase += step;
-        if (phase >= max_phase)
-            phase -= max_phase;
-        i++;
-    }
-    *_phase = phase;
+        n = _period_size - i < SINE_CHUNK ? _period_size - i : SINE_CHUNK;
+        nco_render(_osc, chunk, n);
+        channels_fan_out(chunk, frames, _nb_channels, n);
+        /* Render in float, convert once to whatever the device takes */
+        convert_block(&conversion, frames, out, n * _nb_channels);
+        out += n * _nb_channels * convert_bytes(conversion.format);
+        i += n;
+    }
+    rt_check_leave();
+}
+
+static double thread_cpu_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Periods in playback_duration, counted in 64 bits: -t takes any seconds */
+static unsigned long playback_periods(void)
+{
+    return (unsigned long long) playback_duration * 1000000 / period_time;
 }
 
 static int playback(snd_pcm_t *handle,
-                 int16_t *samples)
+                 char *samples)
 {
-    double phase = 0;
-    int16_t *ptr;
+    double t;
+    nco osc;
+    char *ptr;
     int err, cptr;
-    int iterations = playback_duration * 1000000 / period_time;
+    unsigned long iterations = playback_periods();
+    nco_init(&osc, sine_freq, sample_rate);
     while (iterations > 0) {
-        generate_sine(period_size, nb_channels, samples, &phase);
+        t = thread_cpu_time();
+        generate_sine(period_size, nb_channels, samples, &osc);
+        render_time += thread_cpu_time() - t;
+        render_frames += period_size;
         ptr = samples;
         cptr = period_size;
         while (cptr > 0) {
             err = snd_pcm_writei(handle, ptr, cptr);
-            if (err == -EAGAIN)
+            if (err == -EAGAIN) {
+                /* Non-blocking handle: sleep until there is room */
+                snd_pcm_wait(handle, 1000);
                 continue;
+            }
             if (err < 0) {
                 if (xrun_recovery(handle, err) < 0) {
                     printf("Write error: %s\n", snd_strerror(err));
@@ -211,33 +319,159 @@ static int playback(snd_pcm_t *handle,
                 }
                 break;  /* skip one period */
             }
-            ptr += err * nb_channels;
+            ptr += err * nb_channels * convert_bytes(conversion.format);
             cptr -= err;
         }
         iterations--;
     }
+    return 0;
 }
 
-int main(int argc, char *argv[]) {
+/* Same periods as playback(), rendered once and written as every channel */
+static int playback_planar(snd_pcm_t *handle,
+                 char *samples)
+{
+    double t;
+    nco osc;
+    void *bufs[MAX_CHANNELS];
+    unsigned int chn, bytes = convert_bytes(conversion.format);
+    int err, cptr;
+    unsigned long iterations = playback_periods();
+    nco_init(&osc, sine_freq, sample_rate);
+    while (iterations > 0) {
+        t = thread_cpu_time();
+        generate_sine(period_size, 1, samples, &osc);
+        render_time += thread_cpu_time() - t;
+        render_frames += period_size;
+        cptr = period_size;
+        while (cptr > 0) {
+            for (chn = 0; chn < nb_channels; chn++)
+                bufs[chn] = samples + (period_size - cptr) * bytes;
+            err = snd_pcm_writen(handle, bufs, cptr);
+            if (err == -EAGAIN) {
+                snd_pcm_wait(handle, 1000);
+                continue;
+            }
+            if (err < 0) {
+                if (xrun_recovery(handle, err) < 0) {
+                    printf("Write error: %s\n", snd_strerror(err));
+                    exit(EXIT_FAILURE);
+                }
+                break;  /* skip one period */
+            }
+            cptr -= err;
+        }
+        iterations--;
+    }
+    return 0;
+}
 
+/* Same periods as playback(), rendered in place in the device ring buffer */
+static int playback_mmap(snd_pcm_t *handle)
+{
+    double t;
+    nco osc;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, frames, size;
+    snd_pcm_sframes_t avail, committed;
+    snd_pcm_state_t state;
+    char *ptr;
+    int err, started = 0;
+    unsigned long iterations = playback_periods();
+    nco_init(&osc, sine_freq, sample_rate);
+    while (iterations > 0) {
+        state = snd_pcm_state(handle);
+        if (state == SND_PCM_STATE_XRUN || state == SND_PCM_STATE_SUSPENDED) {
+            err = xrun_recovery(handle, state == SND_PCM_STATE_XRUN ? -EPIPE : -ESTRPIPE);
+            if (err < 0) {
+                printf("Recovery error: %s\n", snd_strerror(err));
+                return err;
+            }
+            started = 0;
+        }
+        avail = snd_pcm_avail_update(handle);
+        if (avail < 0) {
+            err = xrun_recovery(handle, avail);
+            if (err < 0) {
+                printf("Avail update error: %s\n", snd_strerror(err));
+                return err;
+            }
+            started = 0;
+            continue;
+        }
+        if (avail < period_size) {
+            /* The buffer is full: start the stream once, then wait for room */
+            if (!started) {
+                started = 1;
+                err = snd_pcm_start(handle);
+                if (err < 0) {
+                    printf("Start error: %s\n", snd_strerror(err));
+                    return err;
+                }
+            } else {
+                err = snd_pcm_wait(handle, -1);
+                if (err < 0) {
+                    if ((err = xrun_recovery(handle, err)) < 0) {
+                        printf("Wait error: %s\n", snd_strerror(err));
+                        return err;
+                    }
+                    started = 0;
+                }
+            }
+            continue;
+        }
+        size = period_size;
+        while (size > 0) {
+            /* The period may wrap around the end of the ring buffer */
+            frames = size;
+            err = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+            if (err < 0) {
+                if ((err = xrun_recovery(handle, err)) < 0) {
+                    printf("Mmap begin error: %s\n", snd_strerror(err));
+                    return err;
+                }
+                started = 0;
+                continue;
+            }
+            /* Interleaved: every channel shares the first area */
+            ptr = (char *) areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+            t = thread_cpu_time();
+            generate_sine(frames, nb_channels, ptr, &osc);
+            render_time += thread_cpu_time() - t;
+            render_frames += frames;
+            committed = snd_pcm_mmap_commit(handle, offset, frames);
+            if (committed < 0 || (snd_pcm_uframes_t) committed != frames) {
+                if ((err = xrun_recovery(handle, committed >= 0 ? -EPIPE : committed)) < 0) {
+                    printf("Mmap commit error: %s\n", snd_strerror(err));
+                    return err;
+                }
+                started = 0;
+            }
+            size -= frames;
+        }
+        iterations--;
+    }
+    return 0;
+}
+
+/* Open the device with the given access, play and print the CPU cost */
+static int play(snd_pcm_access_t access)
+{
     int err;
     snd_pcm_t *handle;
     snd_pcm_hw_params_t *hwparams;
     snd_pcm_sw_params_t *swparams;
-    int16_t *samples;
-
-    if(argc==2)
-        sine_freq = atoi(argv[1]);
+    char *samples;
+    rt_arena arena = { NULL };
+    size_t bytes;
+    unsigned long periods;
+    int planar = access == SND_PCM_ACCESS_RW_NONINTERLEAVED;
+    double cpu;
 
     /* Allocate memory for hardware and software parameters */
     snd_pcm_hw_params_alloca(&hwparams);
     snd_pcm_sw_params_alloca(&swparams);
 
-    printf("Playback device is %s\n", sound_device);
-    printf("Stream parameters are %uHz, %u channels\n", 
-            sample_rate, nb_channels);
-    printf("Sine wave frequency is %.4fHz\n", sine_freq);
-
     /* Open PCM device. '0' in the last argument means standard */
     /* (blocking on write and read) mode */
     if ((err = snd_pcm_open(&handle, sound_device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
@@ -247,28 +481,250 @@ int main(int argc, char *argv[]) {
 
     /* Set hardware parameters for the playback */
     /* We use interleaved mode, for left and right channels in the stereo stream */
-    if ((err = set_hwparams(handle, hwparams, SND_PCM_ACCESS_RW_INTERLEAVED) < 0)) {
+    if ((err = set_hwparams(handle, hwparams, access)) < 0) {
         printf("Setting of hardware parameters failed: %s\n", snd_strerror(err));
+        snd_pcm_close(handle);
         return err;
     }
 
     /* Set soft parameters for the playback */
     if ((err = set_swparams(handle, swparams)) < 0) {
         printf("Setting of soft parameters failed: %s\n", snd_strerror(err));
+        snd_pcm_close(handle);
         return err;
     }
 
-    /* Set aside memory for samples */
-    samples = malloc((period_size * nb_channels * snd_pcm_format_physical_width(sample_format)) / 8);
-    if (samples == NULL) {
-        printf("Not enough memory\n");
-        return -1;
+    /* As counted by the playback loops, once period_time is settled */
+    periods = playback_periods();
+    xruns_reset();
+    render_time = 0;
+    render_frames = 0;
+    if (access == SND_PCM_ACCESS_MMAP_INTERLEAVED) {
+        cpu = thread_cpu_time();
+        err = playback_mmap(handle);
+        cpu = thread_cpu_time() - cpu;
+    } else {
+        /* Set aside memory for samples, a single channel when planar */
+        bytes = (period_size * (planar ? 1 : nb_channels) *
+                 snd_pcm_format_physical_width(sample_format)) / 8;
+        if (rt_arena_init(&arena, bytes) < 0) {
+            printf("Not enough memory\n");
+            snd_pcm_close(handle);
+            return -1;
+        }
+        samples = rt_arena_alloc(&arena, bytes);
+        cpu = thread_cpu_time();
+        err = planar ? playback_planar(handle, samples) : playback(handle, samples);
+        cpu = thread_cpu_time() - cpu;
     }
+    period_cpu = periods > 0 ? cpu / periods : 0;
+    printf("%s: %.1f us of CPU per period of %ld frames\n",
+           access == SND_PCM_ACCESS_MMAP_INTERLEAVED ? "mmap" : planar ? "writen" : "writei",
+           1e6 * period_cpu, (long) period_size);
+    if (render_frames > 0)
+        printf("Rendering: %.1f us per period (%.2f%% of it)\n",
+               1e6 * render_time * period_size / render_frames,
+               100 * render_time / render_frames * sample_rate);
+    xruns_print();
 
-    playback(handle, samples);
-   
-    free(samples);
+    rt_arena_free(&arena);
     snd_pcm_close(handle);
+    return err;
+}
+
+static void sine_render(void *data, void *out, unsigned long frames) {
+    generate_sine(frames, nb_channels, out, data);
+}
+
+/* Play the tone on count streams from this thread with the poll() engine */
+static int play_poll(unsigned int count)
+{
+    snd_pcm_t **handles;
+    snd_pcm_hw_params_t *hwparams;
+    snd_pcm_sw_params_t *swparams;
+    pcm_poll_stream *streams;
+    pcm_poll engine;
+    nco *oscs;
+    unsigned int i, opened = 0;
+    int err = 0;
+
+    snd_pcm_hw_params_alloca(&hwparams);
+    snd_pcm_sw_params_alloca(&swparams);
+    handles = calloc(count, sizeof(snd_pcm_t *));
+    streams = calloc(count, sizeof(pcm_poll_stream));
+    oscs = calloc(count, sizeof(nco));
+    if (handles == NULL || streams == NULL || oscs == NULL) {
+        printf("Not enough memory\n");
+        err = -1;
+        goto out;
+    }
+
+    for (i=0; i<count; i++) {
+        if ((err = snd_pcm_open(&handles[i], sound_device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+            printf("Playback open error: %s\n", snd_strerror(err));
+            goto out;
+        }
+        opened++;
+        if ((err = set_hwparams(handles[i], hwparams, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+            printf("Setting of hardware parameters failed: %s\n", snd_strerror(err));
+            goto out;
+        }
+        if ((err = set_swparams(handles[i], swparams)) < 0) {
+            printf("Setting of soft parameters failed: %s\n", snd_strerror(err));
+            goto out;
+        }
+        /* As many periods as playback() writes */
+        nco_init(&oscs[i], sine_freq, sample_rate);
+        if (pcm_poll_stream_init(&streams[i], handles[i], sine_render, &oscs[i], period_size,
+                                 playback_periods() * period_size,
+                                 nb_channels * snd_pcm_format_physical_width(sample_format) / 8) < 0) {
+            printf("Not enough memory\n");
+            err = -1;
+            goto out;
+        }
+    }
+
+    if ((err = pcm_poll_init(&engine, streams, count)) < 0) {
+        printf("Poll descriptors error: %s\n", snd_strerror(err));
+        goto out;
+    }
+    err = pcm_poll_run(&engine);
+    if (err < 0)
+        printf("Playback error: %s\n", snd_strerror(err));
+    pcm_poll_print(&engine);
+    pcm_poll_free(&engine);
+
+out:
+    for (i=0; i<opened; i++)
+        snd_pcm_close(handles[i]);
+    if (err < 0 && streams != NULL)
+        for (i=0; i<count; i++)
+            free(streams[i].samples);
+    free(handles);
+    free(streams);
+    free(oscs);
+    return err;
+}
+
+/* Buffer and period times saved by tune(), if there are any */
+static void load_latency(void)
+{
+    unsigned int buffer, period;
+    FILE *f = fopen(latency_file, "r");
+
+    if (f == NULL)
+        return;
+    if (fscanf(f, "%u %u", &buffer, &period) == 2 && period > 0 && buffer >= period) {
+        buffer_time = buffer;
+        period_time = period;
+        printf("Using tuned latency from %s\n", latency_file);
+    }
+    fclose(f);
+}
+
+/* Search down for the smallest buffer that plays for seconds without xruns */
+static int tune(unsigned int seconds)
+{
+    unsigned int period, periods, best_buffer = 0, best_period = 0;
+    int passed = 1;
+    FILE *f;
+
+    playback_duration = seconds;
+    for (period = period_time; passed && period >= MIN_PERIOD_TIME; period /= 2) {
+        passed = 0;
+        for (periods = 2; !passed && periods <= 4; periods++) {
+            period_time = period;
+            buffer_time = period * periods;
+            printf("Trying %u periods of %u us\n", periods, period);
+            /* A configuration the device refuses fails like one that xruns */
+            if (play(SND_PCM_ACCESS_RW_INTERLEAVED) == 0 &&
+                xruns.underruns + xruns.suspends == 0) {
+                /* A period's CPU time, rendering and writing, must leave */
+                /* room for scheduling; its share grows as periods shrink  */
+                if (period_cpu > TUNE_HEADROOM * period_size / sample_rate) {
+                    printf("Rendering and writing took more than %.0f%% of a %u us period\n",
+                           100 * TUNE_HEADROOM, period_time);
+                    break;
+                }
+                passed = 1;
+                /* The times the device settled on */
+                best_buffer = buffer_time;
+                best_period = period_time;
+            }
+        }
+    }
+    if (best_period == 0) {
+        printf("No configuration played %u s without xruns\n", seconds);
+        return -1;
+    }
+    printf("Tuned latency: buffer of %u us in periods of %u us\n", best_buffer, best_period);
+    f = fopen(latency_file, "w");
+    if (f == NULL || fprintf(f, "%u %u\n", best_buffer, best_period) < 0) {
+        printf("Cannot save the latency to %s\n", latency_file);
+        if (f != NULL)
+            fclose(f);
+        return -1;
+    }
+    fclose(f);
     return 0;
+}
 
-}
\ No newline at end of file
+int main(int argc, char *argv[]) {
+
+    int err, opt, mmap = 0, planar = 0, both = 0, streams = 0;
+    unsigned int tune_seconds = 0;
+
+    while ((opt = getopt(argc, argv, "mnbp:t:s:D:")) != -1) {
+        if (opt == 't') {
+            tune_seconds = atoi(optarg);
+        } else if (opt == 's') {
+            latency_file = optarg;
+        } else if (opt == 'D') {
+            sound_device = optarg;
+        } else if (opt == 'm') {
+            mmap = 1;
+        } else if (opt == 'n') {
+            planar = 1;
+        } else if (opt == 'b') {
+            both = 1;
+        } else if (opt == 'p') {
+            streams = atoi(optarg);
+        } else {
+            printf("Usage: simple_pcm [-D device] [-s file] [-t seconds | -m | -n | -b | -p streams] [frequency]\n");
+            return -1;
+        }
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if(argc==2)
+        sine_freq = atoi(argv[1]);
+
+    printf("Playback device is %s\n", sound_device);
+    printf("Stream parameters are %uHz, %u channels\n", 
+            sample_rate, nb_channels);
+    printf("Sine wave frequency is %.4fHz\n", sine_freq);
+
+    if (tune_seconds > 0)
+        return tune(tune_seconds);
+    load_latency();
+    if (streams > 0)
+        return play_poll(streams);
+    if (both || (!mmap && !planar)) {
+        err = play(SND_PCM_ACCESS_RW_INTERLEAVED);
+        if (err < 0)
+            return err;
+    }
+    if (both || mmap) {
+        err = play(SND_PCM_ACCESS_MMAP_INTERLEAVED);
+        if (err < 0)
+            return err;
+    }
+    if (both || planar) {
+        err = play(SND_PCM_ACCESS_RW_NONINTERLEAVED);
+        if (err < 0)
+            return err;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Channel layout stages between mono or planar renderers and the device      */
+/******************************************************************************/
+
+#include <string.h>
+#include "channels.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void channels_fan_out(const float *in, float *out, unsigned int channels,
+                      unsigned long frames) {
+    unsigned long i = 0;
+    unsigned int c;
+
+    if (channels == 1) {
+        memmove(out, in, frames * sizeof(float));
+        return;
+    }
+    if (channels == 2) {
+#ifdef __SSE2__
+        __m128 x;
+
+        for (; i+4<=frames; i+=4) {
+            x = _mm_loadu_ps(in + i);
+            _mm_storeu_ps(out + 2*i, _mm_unpacklo_ps(x, x));
+            _mm_storeu_ps(out + 2*i + 4, _mm_unpackhi_ps(x, x));
+        }
+#endif
+        for (; i<frames; i++) {
+            out[2*i] = in[i];
+            out[2*i+1] = in[i];
+        }
+        return;
+    }
+    for (; i<frames; i++)
+        for (c=0; c<channels; c++)
+            out[i * channels + c] = in[i];
+}
+
+void channels_interleave(const float *const *planes, float *out,
+                         unsigned int channels, unsigned long frames) {
+    unsigned long i = 0;
+    unsigned int c;
+
+    if (channels == 1) {
+        memmove(out, planes[0], frames * sizeof(float));
+        return;
+    }
+    if (channels == 2) {
+#ifdef __SSE2__
+        __m128 l, r;
+
+        for (; i+4<=frames; i+=4) {
+            l = _mm_loadu_ps(planes[0] + i);
+            r = _mm_loadu_ps(planes[1] + i);
+            _mm_storeu_ps(out + 2*i, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(out + 2*i + 4, _mm_unpackhi_ps(l, r));
+        }
+#endif
+        for (; i<frames; i++) {
+            out[2*i] = planes[0][i];
+            out[2*i+1] = planes[1][i];
+        }
+        return;
+    }
+    for (c=0; c<channels; c++)
+        for (i=0; i<frames; i++)
+            out[i * channels + c] = planes[c][i];
+}
@@ -0,0 +1,26 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Channel layout stages between mono or planar renderers and the device      */
+/*                                                                            */
+/* Generators render one mono block, or one block per channel, and these      */
+/* stages lay it out as the device wants it, instead of each generator        */
+/* computing a sample and storing it once per channel. Stereo, the common     */
+/* case, runs four frames at a time with SSE2 unpacks where available;        */
+/* other channel counts use plain strided loops. Devices that take planar     */
+/* buffers (paNonInterleaved, SND_PCM_ACCESS_RW_NONINTERLEAVED) need no       */
+/* stage at all: a mono block can be handed over as every channel.            */
+/******************************************************************************/
+
+#ifndef CHANNELS_H
+#define CHANNELS_H
+
+/* out[i * channels + c] = in[i] for every channel c */
+void channels_fan_out(const float *in, float *out, unsigned int channels,
+                      unsigned long frames);
+
+/* out[i * channels + c] = planes[c][i] */
+void channels_interleave(const float *const *planes, float *out,
+                         unsigned int channels, unsigned long frames);
+
+#endif
@@ -0,0 +1,105 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Linear and exponential frequency sweeps in closed form                     */
+/******************************************************************************/
+
+#include <math.h>
+#include "sine.h"
+#include "chirp.h"
+
+#define TWO_PI (2 * M_PI)
+
+void chirp_init(chirp *c, double sample_rate, double start, double stop,
+                unsigned long length, chirp_shape shape) {
+    unsigned int k;
+
+    c->sample_rate = sample_rate;
+    c->start = start;
+    c->stop = stop;
+    c->length = length;
+    /* Exponential sweeps need both ends above 0, and some ratio */
+    if (shape == CHIRP_EXPONENTIAL && !(start > 0 && stop > 0 && start != stop))
+        shape = CHIRP_LINEAR;
+    c->shape = shape;
+    if (length == 0) {
+        c->rate = 0;
+        c->end = 0;
+        return;
+    }
+    if (shape == CHIRP_EXPONENTIAL) {
+        c->rate = log(stop / start) / length;
+        for (k=0; k<CHIRP_LANES; k++)
+            c->offsets[k] = expm1(c->rate * k) / c->rate;
+        c->end = start * expm1(c->rate * length) / (c->rate * sample_rate);
+    } else {
+        c->rate = (stop - start) / length;
+        c->end = (start + 0.5 * c->rate * length) * length / sample_rate;
+    }
+}
+
+double chirp_frequency(const chirp *c, unsigned long n) {
+    if (n >= c->length)
+        return c->stop;
+    if (c->shape == CHIRP_EXPONENTIAL)
+        return c->start * exp(c->rate * n);
+    return c->start + c->rate * n;
+}
+
+/* Phase of frame n in cycles, unwrapped */
+static double unwrapped(const chirp *c, unsigned long n) {
+    if (n >= c->length)
+        return c->end + c->stop * (n - c->length) / c->sample_rate;
+    if (c->shape == CHIRP_EXPONENTIAL)
+        return c->start * expm1(c->rate * n) / (c->rate * c->sample_rate);
+    return (c->start + 0.5 * c->rate * n) * n / c->sample_rate;
+}
+
+double chirp_phase(const chirp *c, unsigned long n) {
+    double phase = unwrapped(c, n);
+
+    return phase - floor(phase);
+}
+
+double chirp_cycles(const chirp *c, unsigned long n, unsigned long frames) {
+    return unwrapped(c, n + frames) - unwrapped(c, n);
+}
+
+void chirp_phases(const chirp *c, float *x, unsigned long n, unsigned long frames) {
+    double base, step, curve, p;
+    int k, segment;
+
+    while (frames > 0) {
+        segment = frames < CHIRP_LANES ? frames : CHIRP_LANES;
+        /* A segment lies either in the sweep or after it */
+        if (n < c->length && c->length - n < (unsigned long) segment)
+            segment = c->length - n;
+        /* Exact at the start of the segment, offsets are a few cycles at most */
+        base = chirp_phase(c, n);
+        step = chirp_frequency(c, n) / c->sample_rate;
+        if (n < c->length && c->shape == CHIRP_EXPONENTIAL) {
+            for (k=0; k<segment; k++) {
+                p = base + step * c->offsets[k];
+                p -= (int) p;
+                p += p < 0;
+                x[k] = TWO_PI * p;
+            }
+        } else {
+            curve = n < c->length ? 0.5 * c->rate / c->sample_rate : 0;
+            for (k=0; k<segment; k++) {
+                p = base + k * (step + curve * k);
+                p -= (int) p;
+                p += p < 0;
+                x[k] = TWO_PI * p;
+            }
+        }
+        x += segment;
+        n += segment;
+        frames -= segment;
+    }
+}
+
+void chirp_render(const chirp *c, float *y, unsigned long n, unsigned long frames) {
+    chirp_phases(c, y, n, frames);
+    sine_block(y, y, frames);
+}
@@ -0,0 +1,63 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Linear and exponential frequency sweeps in closed form                     */
+/*                                                                            */
+/* An oscillator that adds its step to its phase, and a step to its           */
+/* frequency, once per sample carries every rounding error forward, so a long */
+/* sweep drifts (portaudio/debugging/freq_sweep shows by how much). A chirp   */
+/* instead computes the phase of any frame from the frame number alone:       */
+/*   linear       f(n) = f0 + (f1 - f0) n / N                                 */
+/*                phase(n) = (f0 n + (f1 - f0) n^2 / 2N) / rate               */
+/*   exponential  f(n) = f0 (f1 / f0)^(n / N)                                 */
+/*                phase(n) = f0 N (f(n) / f0 - 1) / (rate log(f1 / f0))       */
+/* and holds f1 after frame N. The error is one double rounding of the phase, */
+/* whatever the run length, and blocks depend on nothing but their first      */
+/* frame: they vectorize, and can be rendered in any order or in parallel.    */
+/* Within a block the phase is taken from CHIRP_LANES-frame segments, each    */
+/* one offset from an exact phase at its start, so the sweep costs one exp()  */
+/* per segment.                                                               */
+/******************************************************************************/
+
+#ifndef CHIRP_H
+#define CHIRP_H
+
+#define CHIRP_LANES (64)
+
+typedef enum {
+    CHIRP_LINEAR,
+    CHIRP_EXPONENTIAL           /* equal ratios per frame; f0 and f1 > 0 */
+} chirp_shape;
+
+typedef struct {
+    double sample_rate;
+    double start;               /* Hz at frame 0 */
+    double stop;                /* Hz at frame length, and after */
+    unsigned long length;       /* frames of the sweep */
+    chirp_shape shape;
+    double rate;                /* per frame: Hz, or log of the ratio */
+    double end;                 /* unwrapped phase at length, in cycles */
+    double offsets[CHIRP_LANES]; /* exponential: frames of phase k frames on */
+} chirp;
+
+/* A sweep from start to stop Hz over length frames. An exponential sweep */
+/* whose ends are not both positive is made linear.                        */
+void chirp_init(chirp *c, double sample_rate, double start, double stop,
+                unsigned long length, chirp_shape shape);
+
+/* Instantaneous frequency of frame n, in Hz */
+double chirp_frequency(const chirp *c, unsigned long n);
+
+/* Phase of frame n, in cycles, [0, 1) */
+double chirp_phase(const chirp *c, unsigned long n);
+
+/* Cycles played from frame n to frame n + frames, unwrapped */
+double chirp_cycles(const chirp *c, unsigned long n, unsigned long frames);
+
+/* x[i] = phase of frame n + i, in radians, [0, 2*pi) */
+void chirp_phases(const chirp *c, float *x, unsigned long n, unsigned long frames);
+
+/* y[i] = sine of frame n + i */
+void chirp_render(const chirp *c, float *y, unsigned long n, unsigned long frames);
+
+#endif
@@ -0,0 +1,135 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Phase error of a 100 Hz to 10 kHz linear sweep after a minute, an hour     */
+/* and four hours of samples, accumulated in float, in double and in closed   */
+/* form (dsp/chirp), against a long double reference; then the cost of a      */
+/* chirp block, linear and exponential, next to a fixed-frequency sine.       */
+/* Usage: chirp_bench [block_size]                                            */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "sine.h"
+#include "chirp.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define START_IN_HZ (100)
+#define STOP_IN_HZ (10000)
+#define MAX_BLOCK (4096)
+#define MIN_SECONDS (0.2)
+
+static float y[MAX_BLOCK];
+static volatile float sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Wrapped distance between two phases in cycles, in radians */
+static double error(long double a, long double b) {
+    long double d = a - b;
+
+    d -= floorl(d + 0.5L);
+    return fabs(2 * M_PI * (double) d);
+}
+
+static void drift(unsigned long length) {
+    chirp c;
+    long double rate = (long double)(STOP_IN_HZ - START_IN_HZ) / length, exact;
+    float phase_f = 0, step_f = (float) START_IN_HZ / SAMPLE_RATE_IN_HZ;
+    float dstep_f = rate / SAMPLE_RATE_IN_HZ;
+    double phase_d = 0, step_d = (double) START_IN_HZ / SAMPLE_RATE_IN_HZ;
+    double dstep_d = rate / SAMPLE_RATE_IN_HZ;
+    double max_f = 0, max_d = 0, max_c = 0, e;
+    unsigned long n;
+
+    chirp_init(&c, SAMPLE_RATE_IN_HZ, START_IN_HZ, STOP_IN_HZ, length, CHIRP_LINEAR);
+    for (n=0; n<length; n++) {
+        if (n % 4096 == 0) {
+            /* The accumulators sum f(0) .. f(n-1): their exact value */
+            exact = (START_IN_HZ * (long double) n + rate * n * (n - 1.0L) / 2) / SAMPLE_RATE_IN_HZ;
+            e = error(phase_f, exact);
+            max_f = e > max_f ? e : max_f;
+            e = error(phase_d, exact);
+            max_d = e > max_d ? e : max_d;
+            /* The chirp integrates f(t) */
+            exact = (START_IN_HZ * (long double) n + rate * n * (long double) n / 2) / SAMPLE_RATE_IN_HZ;
+            e = error(chirp_phase(&c, n), exact);
+            max_c = e > max_c ? e : max_c;
+        }
+        /* Wrapped, as oscillators do */
+        phase_f += step_f;
+        step_f += dstep_f;
+        if (phase_f >= 1)
+            phase_f -= 1;
+        phase_d += step_d;
+        step_d += dstep_d;
+        if (phase_d >= 1)
+            phase_d -= 1;
+    }
+    printf("%10.0f s %14.3g %14.3g %14.3g\n", (double) length / SAMPLE_RATE_IN_HZ,
+           max_f, max_d, max_c);
+}
+
+/* ns per sample over blocks of n samples, staying within the sweep */
+static double time_chirp(const chirp *c, unsigned long n) {
+    unsigned long blocks = 0, position = 0;
+    double start, elapsed;
+
+    start = now();
+    do {
+        chirp_render(c, y, position, n);
+        position = position + 2 * n < c->length ? position + n : 0;
+        blocks++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    sink = y[n-1];
+    return elapsed * 1e9 / ((double) blocks * n);
+}
+
+static double time_sine(unsigned long n) {
+    unsigned long blocks = 0;
+    double start, elapsed, phase = 0;
+
+    start = now();
+    do {
+        phase = sine_phase_ramp(y, phase, 0.1, n);
+        sine_block(y, y, n);
+        blocks++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    sink = y[n-1];
+    return elapsed * 1e9 / ((double) blocks * n);
+}
+
+int main(int argc, char *argv[]) {
+    static const double seconds[] = { 60, 3600, 4 * 3600 };
+    unsigned long n = 256, length = 10 * SAMPLE_RATE_IN_HZ;
+    unsigned int i;
+    chirp linear, exponential;
+
+    if (argc == 2)
+        n = atoi(argv[1]);
+    if (n < 1 || n > MAX_BLOCK) {
+        fprintf(stderr, "Block size must be between 1 and %d\n", MAX_BLOCK);
+        return 1;
+    }
+
+    printf("Maximum phase error in radians, %d to %d Hz linear sweep\n", START_IN_HZ, STOP_IN_HZ);
+    printf("%12s %14s %14s %14s\n", "length", "float", "double", "chirp");
+    for (i=0; i<sizeof(seconds)/sizeof(seconds[0]); i++)
+        drift(seconds[i] * SAMPLE_RATE_IN_HZ);
+
+    chirp_init(&linear, SAMPLE_RATE_IN_HZ, START_IN_HZ, STOP_IN_HZ, length, CHIRP_LINEAR);
+    chirp_init(&exponential, SAMPLE_RATE_IN_HZ, START_IN_HZ, STOP_IN_HZ, length, CHIRP_EXPONENTIAL);
+    printf("\nBlocks of %lu samples, sine kernel %s, ns/sample\n", n, sine_kernel_name());
+    printf("%-14s %8.3f\n", "fixed sine", time_sine(n));
+    printf("%-14s %8.3f\n", "chirp linear", time_chirp(&linear, n));
+    printf("%-14s %8.3f\n", "chirp exp", time_chirp(&exponential, n));
+    return 0;
+}
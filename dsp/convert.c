@@ -0,0 +1,189 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Scalar conversion kernels and runtime selection of the SIMD ones           */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "convert.h"
+#include "convert_impl.h"
+
+#define CONVERT_CHUNK (256) /* samples staged as int32 before packing 3 bytes */
+
+#define S16_SCALE (32768.0f)
+#define S24_SCALE (8388608.0f)
+#define S32_SCALE (2147483648.0f)
+#define S32_HI (2147483520.0f) /* largest float below 2^31 */
+
+static inline uint32_t xorshift32(uint32_t s) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+/* Scale, dither from lane, clamp and round one sample */
+static inline long quantize(float x, float scale, float hi, uint32_t *lane) {
+    float v = x * scale;
+    float a, b;
+
+    if (lane != NULL) {
+        *lane = xorshift32(*lane);
+        a = (float) (int32_t) *lane;
+        *lane = xorshift32(*lane);
+        b = (float) (int32_t) *lane;
+        v = v + (a + b) * CONVERT_DITHER_SCALE;
+    }
+    v = v > -scale ? v : -scale;
+    v = v < hi ? v : hi;
+    return lrintf(v);
+}
+
+void convert_s16_scalar(const float *x, int16_t *y, unsigned long n, uint32_t *state) {
+    unsigned long i;
+
+    for (i=0; i<n; i++)
+        y[i] = quantize(x[i], S16_SCALE, S16_SCALE - 1,
+                        state != NULL ? &state[i % CONVERT_LANES] : NULL);
+}
+
+void convert_s32_scalar(const float *x, int32_t *y, unsigned long n,
+                        float scale, float hi, uint32_t *state) {
+    unsigned long i;
+
+    for (i=0; i<n; i++)
+        y[i] = quantize(x[i], scale, hi, state != NULL ? &state[i % CONVERT_LANES] : NULL);
+}
+
+/* Kernel table and runtime dispatch */
+
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    convert_s16_fn s16;
+    convert_s32_fn s32;
+} convert_kernel;
+
+static int always(void) {
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int has_sse2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static int has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+/* In order of preference */
+static const convert_kernel kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx2", has_avx2, convert_s16_avx2, convert_s32_avx2 },
+    { "sse2", has_sse2, convert_s16_sse2, convert_s32_sse2 },
+#endif
+    { "scalar", always, convert_s16_scalar, convert_s32_scalar }
+};
+
+#define NB_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const convert_kernel *current_kernel;
+
+int convert_kernel_select(const char *name) {
+    unsigned int i;
+
+    for (i=0; i<NB_KERNELS; i++) {
+        if (name != NULL && strcmp(name, kernels[i].name) != 0)
+            continue;
+        if (!kernels[i].supported()) {
+            if (name != NULL)
+                return -1;
+            continue;
+        }
+        __atomic_store_n(&current_kernel, &kernels[i], __ATOMIC_RELEASE);
+        return 0;
+    }
+    return -1;
+}
+
+static const convert_kernel *convert_kernel_get(void) {
+    const convert_kernel *k = __atomic_load_n(&current_kernel, __ATOMIC_ACQUIRE);
+
+    if (k == NULL) {
+        if (convert_kernel_select(getenv("DSP_CONVERT_KERNEL")) < 0)
+            convert_kernel_select(NULL);
+        k = __atomic_load_n(&current_kernel, __ATOMIC_ACQUIRE);
+    }
+    return k;
+}
+
+const char *convert_kernel_name(void) {
+    return convert_kernel_get()->name;
+}
+
+void converter_init(converter *c, convert_format format, int dither, uint32_t seed) {
+    unsigned int l;
+
+    c->format = format;
+    c->dither = dither && (format == CONVERT_S16 || format == CONVERT_S24_3 ||
+                           format == CONVERT_S24);
+    /* Distinct, never zero: a zero xorshift state stays zero */
+    for (l=0; l<CONVERT_LANES; l++) {
+        c->state[l] = (seed + l) * 2654435761u ^ 0x9e3779b9u;
+        if (c->state[l] == 0)
+            c->state[l] = 1;
+    }
+}
+
+unsigned int convert_bytes(convert_format format) {
+    switch (format) {
+    case CONVERT_S16:
+        return 2;
+    case CONVERT_S24_3:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+void convert_block(converter *c, const float *x, void *y, unsigned long n) {
+    const convert_kernel *k = convert_kernel_get();
+    uint32_t *state = c->dither ? c->state : NULL;
+    int32_t chunk[CONVERT_CHUNK];
+    uint8_t *bytes = y;
+    unsigned long i, j, m;
+
+    switch (c->format) {
+    case CONVERT_S16:
+        k->s16(x, y, n, state);
+        break;
+    case CONVERT_S24:
+        k->s32(x, y, n, S24_SCALE, S24_SCALE - 1, state);
+        break;
+    case CONVERT_S32:
+        k->s32(x, y, n, S32_SCALE, S32_HI, state);
+        break;
+    case CONVERT_S24_3:
+        /* CONVERT_CHUNK is a multiple of CONVERT_LANES, so lanes stay in step */
+        for (i=0; i<n; i+=m) {
+            m = n - i < CONVERT_CHUNK ? n - i : CONVERT_CHUNK;
+            k->s32(x + i, chunk, m, S24_SCALE, S24_SCALE - 1, state);
+            for (j=0; j<m; j++) {
+                *bytes++ = chunk[j];
+                *bytes++ = chunk[j] >> 8;
+                *bytes++ = chunk[j] >> 16;
+            }
+        }
+        break;
+    case CONVERT_FLOAT:
+        if ((const void *) x != y)
+            memmove(y, x, n * sizeof(float));
+        break;
+    }
+}
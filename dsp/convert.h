@@ -0,0 +1,61 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Float to device sample format conversion with runtime CPU dispatch         */
+/*                                                                            */
+/* Samples in [-1, 1] are scaled to the integer range of the format, clamped  */
+/* to it and rounded to the nearest integer, optionally after adding TPDF     */
+/* dither of +/- 1 LSB (the sum of two uniform variables of 1/2 LSB each).    */
+/* The dither comes from CONVERT_LANES independent xorshift32 generators,     */
+/* sample i of a block drawing from generator i % CONVERT_LANES, so that the  */
+/* SSE2 and AVX2 kernels step them all at once. As with the sine kernels,     */
+/* every path performs the same operations as the scalar fallback and the     */
+/* output is bit-identical whichever kernel runs.                             */
+/*                                                                            */
+/* S32 and FLOAT are not dithered: a float only carries 24 bits, so dither    */
+/* at the last bit of a 32-bit sample would be lost in the rounding anyway.   */
+/******************************************************************************/
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdint.h>
+
+#define CONVERT_LANES (8)
+
+typedef enum {
+    CONVERT_S16,        /* 16 bits */
+    CONVERT_S24_3,      /* 24 bits packed in 3 little-endian bytes */
+    CONVERT_S24,        /* 24 bits in the low bits of 32 */
+    CONVERT_S32,        /* 32 bits */
+    CONVERT_FLOAT       /* 32-bit float, copied as is */
+} convert_format;
+
+typedef struct {
+    convert_format format;
+    int dither;
+    uint32_t state[CONVERT_LANES];
+} converter;
+
+/* dither: non-zero to add TPDF dither; seed: any value, 0 included */
+void converter_init(converter *c, convert_format format, int dither, uint32_t seed);
+
+/* Bytes taken by one sample in format */
+unsigned int convert_bytes(convert_format format);
+
+/* Convert n samples (frames times channels, interleaved or not) from x to y */
+void convert_block(converter *c, const float *x, void *y, unsigned long n);
+
+/* Name of the kernel in use: "scalar", "sse2" or "avx2" */
+const char *convert_kernel_name(void);
+
+/******************************************************************************/
+/* convert_kernel_select: force a kernel by name, or pick the best one the    */
+/* CPU supports when name is NULL. Returns 0 on success, -1 if the kernel is  */
+/* unknown or not supported. The DSP_CONVERT_KERNEL environment variable      */
+/* forces a kernel the same way on first use.                                 */
+/******************************************************************************/
+
+int convert_kernel_select(const char *name);
+
+#endif
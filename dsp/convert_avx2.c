@@ -0,0 +1,75 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* AVX2 conversion kernels, 8 samples per iteration. Built with -mavx2.       */
+/******************************************************************************/
+
+#include "convert.h"
+#include "convert_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+static inline __m256i xorshift32_avx2(__m256i s) {
+    s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+    s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+    return _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+}
+
+static inline __m256i quantize_avx2(__m256 x, __m256 scale, __m256 hi, __m256i *lanes) {
+    __m256 v = _mm256_mul_ps(x, scale);
+    __m256 a, b;
+
+    if (lanes != NULL) {
+        *lanes = xorshift32_avx2(*lanes);
+        a = _mm256_cvtepi32_ps(*lanes);
+        *lanes = xorshift32_avx2(*lanes);
+        b = _mm256_cvtepi32_ps(*lanes);
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_add_ps(a, b),
+                                           _mm256_set1_ps(CONVERT_DITHER_SCALE)));
+    }
+    v = _mm256_max_ps(v, _mm256_sub_ps(_mm256_setzero_ps(), scale));
+    v = _mm256_min_ps(v, hi);
+    return _mm256_cvtps_epi32(v);
+}
+
+void convert_s16_avx2(const float *x, int16_t *y, unsigned long n, uint32_t *state) {
+    __m256 scale = _mm256_set1_ps(32768.0f), hi = _mm256_set1_ps(32767.0f);
+    __m256i s, *lanes = NULL;
+    __m256i q;
+    unsigned long i;
+
+    if (state != NULL) {
+        s = _mm256_loadu_si256((const __m256i *) state);
+        lanes = &s;
+    }
+    for (i=0; i+8<=n; i+=8) {
+        q = quantize_avx2(_mm256_loadu_ps(x + i), scale, hi, lanes);
+        /* Packing works within 128-bit halves, so pack the two halves together */
+        _mm_storeu_si128((__m128i *) (y + i), _mm_packs_epi32(_mm256_castsi256_si128(q),
+                                                              _mm256_extracti128_si256(q, 1)));
+    }
+    if (state != NULL)
+        _mm256_storeu_si256((__m256i *) state, s);
+    convert_s16_scalar(x + i, y + i, n - i, state);
+}
+
+void convert_s32_avx2(const float *x, int32_t *y, unsigned long n,
+                      float scale, float hi, uint32_t *state) {
+    __m256 vscale = _mm256_set1_ps(scale), vhi = _mm256_set1_ps(hi);
+    __m256i s, *lanes = NULL;
+    unsigned long i;
+
+    if (state != NULL) {
+        s = _mm256_loadu_si256((const __m256i *) state);
+        lanes = &s;
+    }
+    for (i=0; i+8<=n; i+=8)
+        _mm256_storeu_si256((__m256i *) (y + i),
+                            quantize_avx2(_mm256_loadu_ps(x + i), vscale, vhi, lanes));
+    if (state != NULL)
+        _mm256_storeu_si256((__m256i *) state, s);
+    convert_s32_scalar(x + i, y + i, n - i, scale, hi, state);
+}
+
+#endif
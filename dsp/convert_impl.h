@@ -0,0 +1,39 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Per-ISA entry points of the conversion kernels. Each implementation must   */
+/* evaluate, per sample, in this order:                                       */
+/*   v = x * scale                                                            */
+/*   v = v + ((float) (int32_t) s1 + (float) (int32_t) s2) * 2^-32, dither    */
+/*   v = v > lo ? v : lo, then v < hi ? v : hi                                */
+/*   y = v rounded to nearest, ties to even                                   */
+/* where s1 and s2 are the next two outputs of the sample's xorshift32 lane.  */
+/******************************************************************************/
+
+#ifndef CONVERT_IMPL_H
+#define CONVERT_IMPL_H
+
+#include <stdint.h>
+
+#define CONVERT_DITHER_SCALE (0x1p-32f)
+
+/* state is NULL when there is no dither */
+typedef void (*convert_s16_fn)(const float *x, int16_t *y, unsigned long n,
+                               uint32_t *state);
+typedef void (*convert_s32_fn)(const float *x, int32_t *y, unsigned long n,
+                               float scale, float hi, uint32_t *state);
+
+void convert_s16_scalar(const float *x, int16_t *y, unsigned long n, uint32_t *state);
+void convert_s32_scalar(const float *x, int32_t *y, unsigned long n,
+                        float scale, float hi, uint32_t *state);
+
+#if defined(__x86_64__) || defined(__i386__)
+void convert_s16_sse2(const float *x, int16_t *y, unsigned long n, uint32_t *state);
+void convert_s32_sse2(const float *x, int32_t *y, unsigned long n,
+                      float scale, float hi, uint32_t *state);
+void convert_s16_avx2(const float *x, int16_t *y, unsigned long n, uint32_t *state);
+void convert_s32_avx2(const float *x, int32_t *y, unsigned long n,
+                      float scale, float hi, uint32_t *state);
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* SSE2 conversion kernels, 8 samples per iteration in two halves of 4 lanes. */
+/* Built with -msse2.                                                         */
+/******************************************************************************/
+
+#include "convert.h"
+#include "convert_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+
+static inline __m128i xorshift32_sse2(__m128i s) {
+    s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+    s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+    return _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+}
+
+static inline __m128i quantize_sse2(__m128 x, __m128 scale, __m128 hi, __m128i *lanes) {
+    __m128 v = _mm_mul_ps(x, scale);
+    __m128 a, b;
+
+    if (lanes != NULL) {
+        *lanes = xorshift32_sse2(*lanes);
+        a = _mm_cvtepi32_ps(*lanes);
+        *lanes = xorshift32_sse2(*lanes);
+        b = _mm_cvtepi32_ps(*lanes);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_add_ps(a, b), _mm_set1_ps(CONVERT_DITHER_SCALE)));
+    }
+    v = _mm_max_ps(v, _mm_sub_ps(_mm_setzero_ps(), scale));
+    v = _mm_min_ps(v, hi);
+    return _mm_cvtps_epi32(v);
+}
+
+void convert_s16_sse2(const float *x, int16_t *y, unsigned long n, uint32_t *state) {
+    __m128 scale = _mm_set1_ps(32768.0f), hi = _mm_set1_ps(32767.0f);
+    __m128i s0, s1, *l0 = NULL, *l1 = NULL;
+    __m128i q0, q1;
+    unsigned long i;
+
+    if (state != NULL) {
+        s0 = _mm_loadu_si128((const __m128i *) state);
+        s1 = _mm_loadu_si128((const __m128i *) (state + 4));
+        l0 = &s0;
+        l1 = &s1;
+    }
+    for (i=0; i+8<=n; i+=8) {
+        q0 = quantize_sse2(_mm_loadu_ps(x + i), scale, hi, l0);
+        q1 = quantize_sse2(_mm_loadu_ps(x + i + 4), scale, hi, l1);
+        _mm_storeu_si128((__m128i *) (y + i), _mm_packs_epi32(q0, q1));
+    }
+    if (state != NULL) {
+        _mm_storeu_si128((__m128i *) state, s0);
+        _mm_storeu_si128((__m128i *) (state + 4), s1);
+    }
+    convert_s16_scalar(x + i, y + i, n - i, state);
+}
+
+void convert_s32_sse2(const float *x, int32_t *y, unsigned long n,
+                      float scale, float hi, uint32_t *state) {
+    __m128 vscale = _mm_set1_ps(scale), vhi = _mm_set1_ps(hi);
+    __m128i s0, s1, *l0 = NULL, *l1 = NULL;
+    unsigned long i;
+
+    if (state != NULL) {
+        s0 = _mm_loadu_si128((const __m128i *) state);
+        s1 = _mm_loadu_si128((const __m128i *) (state + 4));
+        l0 = &s0;
+        l1 = &s1;
+    }
+    for (i=0; i+8<=n; i+=8) {
+        _mm_storeu_si128((__m128i *) (y + i), quantize_sse2(_mm_loadu_ps(x + i), vscale, vhi, l0));
+        _mm_storeu_si128((__m128i *) (y + i + 4),
+                         quantize_sse2(_mm_loadu_ps(x + i + 4), vscale, vhi, l1));
+    }
+    if (state != NULL) {
+        _mm_storeu_si128((__m128i *) state, s0);
+        _mm_storeu_si128((__m128i *) (state + 4), s1);
+    }
+    convert_s32_scalar(x + i, y + i, n - i, scale, hi, state);
+}
+
+#endif
@@ -0,0 +1,51 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Denormal floats flushed to zero in the audio threads                       */
+/******************************************************************************/
+
+#include "denormals.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+
+#define MXCSR_DAZ (1u << 6)
+#define MXCSR_FTZ (1u << 15)
+
+void denormals_flush(void) {
+    _mm_setcsr(_mm_getcsr() | MXCSR_DAZ | MXCSR_FTZ);
+}
+
+int denormals_flushing(void) {
+    return (_mm_getcsr() & (MXCSR_DAZ | MXCSR_FTZ)) == (MXCSR_DAZ | MXCSR_FTZ);
+}
+
+#elif defined(__aarch64__)
+#include <stdint.h>
+
+#define FPCR_FZ (1ul << 24) /* inputs and results */
+
+void denormals_flush(void) {
+    uint64_t fpcr;
+
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    __asm__ volatile("msr fpcr, %0" : : "r"(fpcr | FPCR_FZ));
+}
+
+int denormals_flushing(void) {
+    uint64_t fpcr;
+
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    return (fpcr & FPCR_FZ) != 0;
+}
+
+#else
+
+void denormals_flush(void) {
+}
+
+int denormals_flushing(void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,27 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Denormal floats flushed to zero in the audio threads                       */
+/*                                                                            */
+/* A decaying envelope, a release tail or a filter fed silence ends up in     */
+/* subnormal numbers, below 1.2e-38, long after it stopped being audible.     */
+/* x86 handles those in microcode, a hundred cycles or more per operation,    */
+/* so a pool of fading voices can cost more than a pool of loud ones. With    */
+/* flush to zero (results) and denormals are zero (inputs), they are plain    */
+/* zeros instead.                                                             */
+/*                                                                            */
+/* The modes are per thread: every thread that renders calls                  */
+/* denormals_flush() before it starts. The engine backends, the render pool   */
+/* workers and the render ahead thread do.                                    */
+/******************************************************************************/
+
+#ifndef DENORMALS_H
+#define DENORMALS_H
+
+/* Flush denormals to zero in the calling thread, where the CPU can */
+void denormals_flush(void);
+
+/* Non-zero if the calling thread flushes them */
+int denormals_flushing(void);
+
+#endif
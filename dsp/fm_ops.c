@@ -0,0 +1,439 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Polyphonic FM voices of up to FM_OPS operators, routed by an algorithm     */
+/******************************************************************************/
+
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "sine.h"
+#include "nco.h"
+#include "fm_voices.h"
+#include "fm_ops.h"
+
+#define RADIANS_PER_STEP (1.46291807926715968e-9f) /* 2*pi / 2^32 */
+#define HOLD (INT_MAX) /* remaining samples of a segment that never ends */
+
+enum { STAGE_IDLE, STAGE_ATTACK, STAGE_DECAY, STAGE_SUSTAIN, STAGE_RELEASE };
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define FM_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define FM_TARGETS
+#endif
+
+#define BIT(o) (1u << (o))
+
+/* Operators are numbered from 0; modulators come after what they modulate */
+static const fm_algorithm algorithms[] = {
+    /* 0 <- 1, Chowning's instrument */
+    { "pair",     2, { BIT(1) }, BIT(0), -1 },
+    /* 0 <- 1 <- 2 <- 3, 3 fed back */
+    { "stack4",   4, { BIT(1), BIT(2), BIT(3) }, BIT(0), 3 },
+    /* 0 <- 1 and 2 <- 3 */
+    { "pairs",    4, { BIT(1), 0, BIT(3) }, BIT(0) | BIT(2), 3 },
+    /* 0 <- 1 + 2 + 3 */
+    { "branch",   4, { BIT(1) | BIT(2) | BIT(3) }, BIT(0), 3 },
+    /* Four sines mixed */
+    { "additive", 4, { 0 }, BIT(0) | BIT(1) | BIT(2) | BIT(3), 3 },
+    /* DX7 algorithm 1: 0 <- 1 and 2 <- 3 <- 4 <- 5 */
+    { "dx1",      6, { BIT(1), 0, BIT(3), BIT(4), BIT(5) }, BIT(0) | BIT(2), 5 },
+    /* DX7 algorithm 5: three pairs */
+    { "dx5",      6, { BIT(1), 0, BIT(3), 0, BIT(5) }, BIT(0) | BIT(2) | BIT(4), 5 },
+    /* DX7 algorithm 32: six sines mixed */
+    { "dx32",     6, { 0 }, 0x3f, 5 }
+};
+
+#define NB_ALGORITHMS (sizeof(algorithms) / sizeof(algorithms[0]))
+
+/* ratio, detune, phase, level, attack, decay, sustain, sustain_level, release */
+static const fm_ops_patch presets[] = {
+    /* fm_test 0.6 440 440 5: carrier and modulator at 440 Hz, index 5. The */
+    /* modulator starts a quarter cycle back: the phase of frequency        */
+    /* modulation by a sine is minus a cosine.                              */
+    { "brass", &algorithms[0], {
+        { 1,   0, 0,    1,    0.1,   0.1,  -1, 0.5, 0.1 },
+        { 1,   0, 0.75, 5,    0.1,   0.1,  -1, 0.5, 0.1 } }, 0 },
+    /* Chowning's bell ratio, 1:1.4, index falling with the amplitude */
+    { "bell", &algorithms[2], {
+        { 1,   0, 0,    0.6,  0.001, 4.0,  -1, 0,   2.0 },
+        { 1.4, 0, 0,    10,   0.001, 3.0,  -1, 0,   2.0 },
+        { 2.0, 0, 0,    0.3,  0.001, 2.5,  -1, 0,   1.5 },
+        { 2.8, 0, 0,    4,    0.001, 1.5,  -1, 0,   1.0 } }, 0 },
+    { "epiano", &algorithms[6], {
+        { 1,   0, 0,    0.5,  0.002, 2.5,  -1, 0.2, 0.4 },
+        { 1,   0, 0,    1.2,  0.002, 1.5,  -1, 0.1, 0.4 },
+        { 1,   0, 0,    0.3,  0.002, 2.5,  -1, 0.2, 0.4 },
+        { 14,  0, 0,    0.9,  0.001, 0.25, -1, 0,   0.2 },
+        { 1,   1, 0,    0.2,  0.002, 2.0,  -1, 0.2, 0.4 },
+        { 1,   0, 0,    1.0,  0.002, 1.2,  -1, 0.1, 0.4 } }, 0.5 },
+    { "bass", &algorithms[1], {
+        { 1,   0, 0,    0.8,  0.005, 0.4,  -1, 0.6, 0.15 },
+        { 1,   0, 0,    2,    0.002, 0.25, -1, 0.3, 0.15 },
+        { 2,   0, 0,    1,    0.002, 0.15, -1, 0.1, 0.1 },
+        { 1,   0, 0,    1,    0.002, 0.1,  -1, 0,   0.1 } }, 0.8 },
+    { "organ", &algorithms[4], {
+        { 0.5, 0, 0,    0.3,  0.01,  0.05, -1, 1,   0.05 },
+        { 1,   0, 0,    0.3,  0.01,  0.05, -1, 1,   0.05 },
+        { 2,   0, 0,    0.2,  0.01,  0.05, -1, 1,   0.05 },
+        { 3,   0, 0,    0.15, 0.01,  0.05, -1, 1,   0.05 } }, 0.3 }
+};
+
+#define NB_PRESETS (sizeof(presets) / sizeof(presets[0]))
+
+const fm_algorithm *fm_algorithm_named(const char *name) {
+    unsigned int i;
+
+    for (i=0; i<NB_ALGORITHMS; i++)
+        if (strcmp(name, algorithms[i].name) == 0)
+            return &algorithms[i];
+    return NULL;
+}
+
+const fm_ops_patch *fm_ops_preset(const char *name) {
+    unsigned int i;
+
+    for (i=0; i<NB_PRESETS; i++)
+        if (strcmp(name, presets[i].name) == 0)
+            return &presets[i];
+    return NULL;
+}
+
+const char *fm_ops_presets(void) {
+    return "brass bell epiano bass organ";
+}
+
+static unsigned int round_up(unsigned int n) {
+    return (n + FM_OPS_LANES - 1) / FM_OPS_LANES * FM_OPS_LANES;
+}
+
+static int to_samples(double seconds, double sample_rate) {
+    if (seconds < 0)
+        return HOLD;
+    return (int)(seconds * sample_rate + 0.5);
+}
+
+static int valid(const fm_algorithm *a) {
+    unsigned int o, all;
+
+    if (a == NULL || a->operators < 1 || a->operators > FM_OPS)
+        return 0;
+    all = BIT(a->operators) - 1;
+    /* Modulators of o are among the operators after it */
+    for (o=0; o<a->operators; o++)
+        if (a->modulators[o] & ~(all & ~(BIT(o + 1) - 1)))
+            return 0;
+    return (a->carriers & all) != 0 && a->feedback < (int) a->operators;
+}
+
+int fm_ops_init(fm_ops *s, unsigned int capacity, double sample_rate,
+                const fm_ops_patch *patch) {
+    unsigned int nb_arrays = 9 * FM_OPS + 4;
+    unsigned int o, v;
+    size_t array_bytes;
+    char *p;
+
+    memset(s, 0, sizeof(*s));
+    if (patch == NULL || !valid(patch->algorithm))
+        return -1;
+    s->patch = *patch;
+    s->capacity = round_up(capacity > 0 ? capacity : 1);
+    /* Every array is a whole number of cache lines */
+    array_bytes = (s->capacity * 4 + 63) / 64 * 64;
+    if (rt_arena_init(&s->arena, array_bytes * nb_arrays) < 0)
+        return -1;
+
+    p = rt_arena_alloc(&s->arena, array_bytes * nb_arrays);
+    for (o=0; o<FM_OPS; o++) {
+        s->phase[o] = (uint32_t *) p;
+        s->increment[o] = (uint32_t *)(p += array_bytes);
+        s->level[o] = (float *)(p += array_bytes);
+        s->out[o] = (float *)(p += array_bytes);
+        s->env_base[o] = (float *)(p += array_bytes);
+        s->env_increment[o] = (float *)(p += array_bytes);
+        s->env_pos[o] = (float *)(p += array_bytes);
+        s->env_remaining[o] = (int *)(p += array_bytes);
+        s->env_stage[o] = (int *)(p += array_bytes);
+        p += array_bytes;
+        for (v=0; v<s->capacity; v++)
+            s->env_remaining[o][v] = HOLD;
+        s->attack[o] = to_samples(patch->op[o].attack, sample_rate);
+        s->decay[o] = to_samples(patch->op[o].decay, sample_rate);
+        s->sustain[o] = to_samples(patch->op[o].sustain, sample_rate);
+        s->release[o] = to_samples(patch->op[o].release, sample_rate);
+    }
+    s->history[0] = (float *) p;
+    s->history[1] = (float *)(p += array_bytes);
+    s->x = (float *)(p += array_bytes);
+    s->id = (unsigned int *)(p += array_bytes);
+    s->serial = 1;
+    s->sample_rate = sample_rate;
+    return 0;
+}
+
+void fm_ops_free(fm_ops *s) {
+    rt_arena_free(&s->arena);
+    s->capacity = 0;
+    s->active = 0;
+}
+
+static float env_level(const fm_ops *s, unsigned int o, unsigned int v) {
+    return s->env_base[o][v] + s->env_increment[o][v] * s->env_pos[o][v];
+}
+
+/* Start envelope segment `stage` of operator o of voice v from its level */
+static void env_enter(fm_ops *s, unsigned int o, unsigned int v, int stage) {
+    const fm_operator *op = &s->patch.op[o];
+    float level = env_level(s, o, v), increment = 0;
+    int length;
+
+    switch (stage) {
+    case STAGE_ATTACK:
+        /* Keep the attack slope, so a retrigger only covers what is left */
+        length = (int)((1 - level) * s->attack[o] + 0.5f);
+        increment = length > 0 ? (1 - level) / length : 0;
+        break;
+    case STAGE_DECAY:
+        level = 1;
+        length = s->decay[o];
+        increment = length > 0 ? (op->sustain_level - 1) / length : 0;
+        break;
+    case STAGE_SUSTAIN:
+        level = op->sustain_level;
+        length = s->sustain[o];
+        break;
+    case STAGE_RELEASE:
+        length = s->release[o];
+        increment = length > 0 ? -level / length : 0;
+        break;
+    default:
+        level = 0;
+        length = HOLD;
+        break;
+    }
+    s->env_stage[o][v] = stage;
+    s->env_base[o][v] = level;
+    s->env_increment[o][v] = increment;
+    s->env_pos[o][v] = 0;
+    s->env_remaining[o][v] = length;
+}
+
+/* Move operator o of voice v past every finished segment */
+static void env_advance(fm_ops *s, unsigned int o, unsigned int v) {
+    while (s->env_remaining[o][v] == 0) {
+        if (s->env_stage[o][v] == STAGE_RELEASE)
+            env_enter(s, o, v, STAGE_IDLE);
+        else
+            env_enter(s, o, v, s->env_stage[o][v] + 1);
+    }
+}
+
+/* Clear a slot so that it renders silence */
+static void clear_voice(fm_ops *s, unsigned int v) {
+    unsigned int o;
+
+    for (o=0; o<FM_OPS; o++) {
+        s->phase[o][v] = s->increment[o][v] = 0;
+        s->level[o][v] = s->out[o][v] = 0;
+        s->env_base[o][v] = s->env_increment[o][v] = s->env_pos[o][v] = 0;
+        s->env_remaining[o][v] = HOLD;
+        s->env_stage[o][v] = STAGE_IDLE;
+    }
+    s->history[0][v] = s->history[1][v] = 0;
+    s->id[v] = 0;
+}
+
+unsigned int fm_ops_note_on(fm_ops *s, double frequency, double gain) {
+    const fm_algorithm *a = s->patch.algorithm;
+    const fm_operator *op;
+    unsigned int o, v, w;
+    int fresh = s->active < s->capacity;
+
+    if (fresh) {
+        v = s->active++;
+        clear_voice(s, v);
+    } else {
+        /* Ids grow with time, compare them modulo 2^32 */
+        for (v=0, w=1; w<s->active; w++)
+            if ((int)(s->id[w] - s->id[v]) < 0)
+                v = w;
+    }
+    for (o=0; o<a->operators; o++) {
+        op = &s->patch.op[o];
+        s->increment[o][v] = nco_increment(frequency * op->ratio + op->detune, s->sample_rate);
+        if (fresh)
+            s->phase[o][v] = nco_increment(op->phase, 1);
+        s->level[o][v] = a->carriers & BIT(o) ? op->level * gain : op->level;
+        env_enter(s, o, v, STAGE_ATTACK);
+        env_advance(s, o, v);
+    }
+    s->id[v] = s->serial++;
+    if (s->serial == 0)
+        s->serial = 1;
+    return s->id[v];
+}
+
+void fm_ops_note_off(fm_ops *s, unsigned int id) {
+    unsigned int o, v;
+
+    for (v=0; v<s->active; v++) {
+        if (s->id[v] != id)
+            continue;
+        for (o=0; o<s->patch.algorithm->operators; o++) {
+            if (s->env_stage[o][v] != STAGE_IDLE && s->env_stage[o][v] != STAGE_RELEASE) {
+                env_enter(s, o, v, STAGE_RELEASE);
+                env_advance(s, o, v);
+            }
+        }
+        return;
+    }
+}
+
+/******************************************************************************/
+/* Inner loop: run frames of n voices (a multiple of FM_OPS_LANES) during     */
+/* which no envelope segment ends. Each sample goes through the operators     */
+/* from the last to the first, every voice at once; the mix is then summed    */
+/* in FM_OPS_LANES partial sums added in a fixed order, so the result is the  */
+/* same whichever instruction set the clone is built for.                     */
+/******************************************************************************/
+
+FM_TARGETS
+static void fm_ops_run(fm_ops *s, unsigned int n, unsigned long run, float *out) {
+    const fm_algorithm *a = s->patch.algorithm;
+    float feedback = 0.5f * (float) s->patch.feedback;
+    float *restrict x = s->x, *y;
+    float *restrict h0 = s->history[0], *restrict h1 = s->history[1];
+    float lanes[FM_OPS_LANES];
+    unsigned long j;
+    unsigned int o, m, v, l;
+
+    for (j=0; j<run; j++) {
+        for (o=a->operators; o-- > 0; ) {
+            uint32_t *restrict phase = s->phase[o];
+            const uint32_t *restrict increment = s->increment[o];
+            const float *restrict level = s->level[o];
+            const float *restrict base = s->env_base[o];
+            const float *restrict slope = s->env_increment[o];
+            float *restrict pos = s->env_pos[o];
+
+            /* The phase as a signed fraction of a cycle is within [-pi, pi) */
+            for (v=0; v<n; v++)
+                x[v] = RADIANS_PER_STEP * (float)(int32_t) phase[v];
+            for (m=o+1; m<a->operators; m++) {
+                if (!(a->modulators[o] & BIT(m)))
+                    continue;
+                y = s->out[m];
+                for (v=0; v<n; v++)
+                    x[v] += y[v];
+            }
+            /* Feedback from the mean of the last two samples, which damps */
+            /* the oscillation a single sample of delay would start        */
+            if ((int) o == a->feedback)
+                for (v=0; v<n; v++)
+                    x[v] += feedback * (h0[v] + h1[v]);
+            y = s->out[o];
+            sine_block(x, y, n);
+            for (v=0; v<n; v++) {
+                y[v] *= level[v] * (base[v] + slope[v] * pos[v]);
+                pos[v] += 1.0f;
+                phase[v] += increment[v];
+            }
+            if ((int) o == a->feedback) {
+                for (v=0; v<n; v++) {
+                    h1[v] = h0[v];
+                    h0[v] = y[v];
+                }
+            }
+        }
+
+        memset(x, 0, n * sizeof(float));
+        for (o=0; o<a->operators; o++) {
+            if (!(a->carriers & BIT(o)))
+                continue;
+            y = s->out[o];
+            for (v=0; v<n; v++)
+                x[v] += y[v];
+        }
+        for (l=0; l<FM_OPS_LANES; l++)
+            lanes[l] = x[l];
+        for (v=FM_OPS_LANES; v<n; v+=FM_OPS_LANES)
+            for (l=0; l<FM_OPS_LANES; l++)
+                lanes[l] += x[v+l];
+        for (l=FM_OPS_LANES/2; l>0; l/=2)
+            for (v=0; v<l; v++)
+                lanes[v] += lanes[v+l];
+        out[j] = lanes[0];
+    }
+}
+
+/* Retire voices whose carriers are all idle or releasing below */
+/* FM_SILENCE, keeping [0, active) packed                       */
+static void collect(fm_ops *s) {
+    const fm_algorithm *a = s->patch.algorithm;
+    unsigned int v = 0, o, last;
+    int sounding;
+
+    while (v < s->active) {
+        for (o=0, sounding=0; o<a->operators; o++)
+            if (a->carriers & BIT(o) && s->env_stage[o][v] != STAGE_IDLE &&
+                (s->env_stage[o][v] != STAGE_RELEASE ||
+                 fabsf(s->level[o][v] * env_level(s, o, v)) >= FM_SILENCE))
+                sounding = 1;
+        if (sounding) {
+            v++;
+            continue;
+        }
+        /* Move the last voice into the hole */
+        last = --s->active;
+        if (v != last) {
+            for (o=0; o<FM_OPS; o++) {
+                s->phase[o][v] = s->phase[o][last];
+                s->increment[o][v] = s->increment[o][last];
+                s->level[o][v] = s->level[o][last];
+                s->out[o][v] = s->out[o][last];
+                s->env_base[o][v] = s->env_base[o][last];
+                s->env_increment[o][v] = s->env_increment[o][last];
+                s->env_pos[o][v] = s->env_pos[o][last];
+                s->env_remaining[o][v] = s->env_remaining[o][last];
+                s->env_stage[o][v] = s->env_stage[o][last];
+            }
+            s->history[0][v] = s->history[0][last];
+            s->history[1][v] = s->history[1][last];
+            s->id[v] = s->id[last];
+        }
+        clear_voice(s, last);
+    }
+}
+
+void fm_ops_render(fm_ops *s, float *out, unsigned long frames) {
+    unsigned int operators = s->patch.algorithm->operators;
+    unsigned int n = round_up(s->active), o, v;
+    unsigned long run;
+
+    if (s->active == 0) {
+        memset(out, 0, frames * sizeof(float));
+        return;
+    }
+    while (frames > 0) {
+        run = frames;
+        for (o=0; o<operators; o++)
+            for (v=0; v<s->active; v++)
+                if ((unsigned long) s->env_remaining[o][v] < run)
+                    run = s->env_remaining[o][v];
+
+        fm_ops_run(s, n, run, out);
+
+        for (o=0; o<operators; o++) {
+            for (v=0; v<s->active; v++) {
+                if (s->env_remaining[o][v] != HOLD)
+                    s->env_remaining[o][v] -= run;
+                if (s->env_remaining[o][v] == 0)
+                    env_advance(s, o, v);
+            }
+        }
+        out += run;
+        frames -= run;
+    }
+    collect(s);
+}
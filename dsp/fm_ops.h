@@ -0,0 +1,118 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Polyphonic FM voices of up to FM_OPS operators, routed by an algorithm     */
+/*                                                                            */
+/* Every operator is a sine with its own frequency ratio, level and ADSR      */
+/* envelope. An algorithm says which operators modulate which, which ones are */
+/* heard (the carriers) and which one feeds back into itself, as on the       */
+/* DX synthesizers. Modulation is of the phase: an operator's output, in      */
+/* radians, is added to the phases of the operators it modulates, so a        */
+/* modulator's level is its modulation index. A modulator always has a higher */
+/* number than the operators it modulates, so operators are evaluated from    */
+/* the last one down and every modulator is ready before it is used.          */
+/*                                                                            */
+/* All voices of an fm_ops play the same patch, which is what lets them be    */
+/* evaluated together: for each sample, each operator is computed for every   */
+/* voice at once, in arrays of voices that the sine kernels and the compiler  */
+/* vectorize (as in fm_voices.h), so a chain of operators costs one vector    */
+/* pass per operator rather than one scalar chain per voice. Phases are       */
+/* fixed point (nco.h) and never drift.                                       */
+/*                                                                            */
+/* All memory is taken by fm_ops_init() from one arena, resident before the   */
+/* audio starts (rt_arena.h): notes on and off and rendering never allocate   */
+/* or fault and can run in the audio callback, from a single thread.          */
+/******************************************************************************/
+
+#ifndef FM_OPS_H
+#define FM_OPS_H
+
+#include <stdint.h>
+#include "rt_arena.h"
+
+#define FM_OPS (6)
+#define FM_OPS_LANES (16) /* voices per loop iteration, capacity is rounded up */
+
+typedef struct {
+    const char *name;
+    unsigned int operators;         /* 1 to FM_OPS */
+    unsigned int modulators[FM_OPS]; /* bit m set: operator m modulates this one */
+    unsigned int carriers;          /* bit o set: operator o is heard */
+    int feedback;                   /* operator modulating itself, -1 for none */
+} fm_algorithm;
+
+typedef struct {
+    double ratio;                   /* of the note frequency */
+    double detune;                  /* Hz added to it */
+    double phase;                   /* at note on, in cycles */
+    double level;                   /* carriers: amplitude, modulators: index */
+    double attack;                  /* envelope times in seconds, as in adsr() */
+    double decay;
+    double sustain;                 /* negative to hold until fm_ops_note_off() */
+    double sustain_level;
+    double release;
+} fm_operator;
+
+typedef struct {
+    const char *name;
+    const fm_algorithm *algorithm;
+    fm_operator op[FM_OPS];
+    double feedback;                /* index of the feedback operator on itself */
+} fm_ops_patch;
+
+typedef struct {
+    fm_ops_patch patch;
+    unsigned int capacity;          /* multiple of FM_OPS_LANES */
+    unsigned int active;            /* voices [0, active) are sounding */
+    unsigned int serial;            /* id of the next note */
+    double sample_rate;
+    int attack[FM_OPS];             /* envelope segments in samples */
+    int decay[FM_OPS];
+    int sustain[FM_OPS];
+    int release[FM_OPS];
+    /* One entry per voice and operator, each array 64-byte aligned */
+    uint32_t *phase[FM_OPS];
+    uint32_t *increment[FM_OPS];
+    float *level[FM_OPS];
+    float *out[FM_OPS];             /* the operator's last sample */
+    float *env_base[FM_OPS];        /* envelope is env_base + env_increment * env_pos */
+    float *env_increment[FM_OPS];
+    float *env_pos[FM_OPS];
+    int *env_remaining[FM_OPS];
+    int *env_stage[FM_OPS];
+    float *history[2];              /* last two outputs of the feedback operator */
+    float *x;                       /* scratch: phases in radians, then the mix */
+    unsigned int *id;
+    rt_arena arena;                 /* every array above */
+} fm_ops;
+
+/* Algorithm by name: pair, stack4, pairs, branch, additive, dx1, dx5, dx32 */
+const fm_algorithm *fm_algorithm_named(const char *name);
+
+/* Patch by name, NULL if unknown, and the names of them all */
+const fm_ops_patch *fm_ops_preset(const char *name);
+const char *fm_ops_presets(void);
+
+/******************************************************************************/
+/* fm_ops_init: a pool of at least capacity voices playing patch              */
+/* Returns 0, or -1 if out of memory or if the algorithm is invalid: an       */
+/* operator modulated by itself or by a lower one, or no carrier.             */
+/******************************************************************************/
+
+int fm_ops_init(fm_ops *s, unsigned int capacity, double sample_rate,
+                const fm_ops_patch *patch);
+
+void fm_ops_free(fm_ops *s);
+
+/* Start a note, returns its id (never 0). When the pool is full the oldest */
+/* voice is stolen, keeping its phases and levels so it does not click.     */
+unsigned int fm_ops_note_on(fm_ops *s, double frequency, double gain);
+
+/* Release the note with the given id, if it is still sounding */
+void fm_ops_note_off(fm_ops *s, unsigned int id);
+
+/* Render frames of the mono mix of all voices into out, then retire the */
+/* voices whose carriers have all finished                                */
+void fm_ops_render(fm_ops *s, float *out, unsigned long frames);
+
+#endif
@@ -0,0 +1,333 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Polyphonic two-operator FM voices in a fixed-capacity pool                 */
+/******************************************************************************/
+
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "sine.h"
+#include "fm_voices.h"
+
+#define TWO_PI (6.28318530717958648f)
+#define INV_TWO_PI (0.159154943091895336f)
+#define HOLD (INT_MAX) /* remaining samples of a segment that never ends */
+
+enum { STAGE_IDLE, STAGE_ATTACK, STAGE_DECAY, STAGE_SUSTAIN, STAGE_RELEASE };
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define FM_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define FM_TARGETS
+#endif
+
+static unsigned int round_up(unsigned int n) {
+    return (n + FM_POOL_LANES - 1) / FM_POOL_LANES * FM_POOL_LANES;
+}
+
+static int to_samples(double seconds, double sample_rate) {
+    if (seconds < 0)
+        return HOLD;
+    return (int)(seconds * sample_rate + 0.5);
+}
+
+int fm_pool_init(fm_pool *pool, unsigned int capacity, double sample_rate) {
+    float **float_arrays[] = {
+        &pool->phase, &pool->step, &pool->mod_phase, &pool->mod_step,
+        &pool->depth, &pool->gain, &pool->env_base, &pool->env_increment,
+        &pool->env_pos, &pool->sustain_level, &pool->mod_out, &pool->car_out
+    };
+    int **int_arrays[] = {
+        &pool->env_remaining, &pool->env_stage, &pool->attack_samples,
+        &pool->decay_samples, &pool->sustain_samples, &pool->release_samples
+    };
+    unsigned int nb_float = sizeof(float_arrays) / sizeof(float_arrays[0]);
+    unsigned int nb_int = sizeof(int_arrays) / sizeof(int_arrays[0]);
+    unsigned int i, v;
+    size_t array_bytes;
+    char *p;
+
+    pool->capacity = round_up(capacity > 0 ? capacity : 1);
+    /* Every array is a whole number of cache lines */
+    array_bytes = (pool->capacity * 4 + 63) / 64 * 64;
+    if (rt_arena_init(&pool->arena, array_bytes * (nb_float + nb_int + 1)) < 0)
+        return -1;
+
+    p = rt_arena_alloc(&pool->arena, array_bytes * (nb_float + nb_int + 1));
+    for (i=0; i<nb_float; i++, p+=array_bytes)
+        *float_arrays[i] = (float *)p;
+    for (i=0; i<nb_int; i++, p+=array_bytes)
+        *int_arrays[i] = (int *)p;
+    pool->id = (unsigned int *)p;
+
+    for (v=0; v<pool->capacity; v++)
+        pool->env_remaining[v] = HOLD;
+    pool->active = 0;
+    pool->serial = 1;
+    pool->sample_rate = sample_rate;
+    return 0;
+}
+
+void fm_pool_free(fm_pool *pool) {
+    rt_arena_free(&pool->arena);
+    pool->capacity = 0;
+    pool->active = 0;
+}
+
+static float env_level(const fm_pool *pool, unsigned int v) {
+    return pool->env_base[v] + pool->env_increment[v] * pool->env_pos[v];
+}
+
+/* Start envelope segment `stage` of voice v from its current level */
+static void env_enter(fm_pool *pool, unsigned int v, int stage) {
+    float level = env_level(pool, v);
+    int length;
+
+    switch (stage) {
+    case STAGE_ATTACK:
+        /* Keep the attack slope, so a retrigger only covers what is left */
+        length = (int)((1 - level) * pool->attack_samples[v] + 0.5f);
+        pool->env_increment[v] = length > 0 ? (1 - level) / length : 0;
+        break;
+    case STAGE_DECAY:
+        level = 1;
+        length = pool->decay_samples[v];
+        pool->env_increment[v] = length > 0 ?
+                                 (pool->sustain_level[v] - 1) / length : 0;
+        break;
+    case STAGE_SUSTAIN:
+        level = pool->sustain_level[v];
+        length = pool->sustain_samples[v];
+        pool->env_increment[v] = 0;
+        break;
+    case STAGE_RELEASE:
+        length = pool->release_samples[v];
+        pool->env_increment[v] = length > 0 ? -level / length : 0;
+        break;
+    default:
+        level = 0;
+        length = HOLD;
+        pool->env_increment[v] = 0;
+        break;
+    }
+    pool->env_stage[v] = stage;
+    pool->env_base[v] = level;
+    pool->env_pos[v] = 0;
+    pool->env_remaining[v] = length;
+}
+
+/* Move voice v past every finished segment */
+static void env_advance(fm_pool *pool, unsigned int v) {
+    while (pool->env_remaining[v] == 0) {
+        if (pool->env_stage[v] == STAGE_RELEASE)
+            env_enter(pool, v, STAGE_IDLE);
+        else
+            env_enter(pool, v, pool->env_stage[v] + 1);
+    }
+}
+
+/* Clear a slot so that it renders silence */
+static void clear_voice(fm_pool *pool, unsigned int v) {
+    pool->phase[v] = pool->step[v] = 0;
+    pool->mod_phase[v] = pool->mod_step[v] = 0;
+    pool->depth[v] = pool->gain[v] = 0;
+    pool->env_base[v] = pool->env_increment[v] = pool->env_pos[v] = 0;
+    pool->env_remaining[v] = HOLD;
+    pool->env_stage[v] = STAGE_IDLE;
+    pool->id[v] = 0;
+}
+
+static unsigned int steal_voice(const fm_pool *pool) {
+    unsigned int v, victim = 0;
+    float level, quietest = 2;
+
+    for (v=0; v<pool->active; v++) {
+        if (pool->env_stage[v] != STAGE_RELEASE && pool->env_stage[v] != STAGE_IDLE)
+            continue;
+        level = env_level(pool, v);
+        if (level < quietest) {
+            quietest = level;
+            victim = v;
+        }
+    }
+    if (quietest <= 1)
+        return victim;
+    /* Ids grow with time, compare them modulo 2^32 */
+    for (v=1; v<pool->active; v++)
+        if ((int)(pool->id[v] - pool->id[victim]) < 0)
+            victim = v;
+    return victim;
+}
+
+unsigned int fm_pool_note_on(fm_pool *pool, const fm_patch *patch) {
+    double sr = pool->sample_rate;
+    unsigned int v;
+
+    if (pool->active < pool->capacity) {
+        v = pool->active++;
+        clear_voice(pool, v);
+    } else {
+        v = steal_voice(pool);
+    }
+
+    pool->step[v] = 2 * M_PI * patch->frequency / sr;
+    pool->mod_step[v] = 2 * M_PI * patch->mod_frequency / sr;
+    pool->depth[v] = patch->mod_index * pool->mod_step[v];
+    pool->gain[v] = patch->gain;
+    pool->attack_samples[v] = to_samples(patch->attack, sr);
+    pool->decay_samples[v] = to_samples(patch->decay, sr);
+    pool->sustain_samples[v] = to_samples(patch->sustain, sr);
+    pool->release_samples[v] = to_samples(patch->release, sr);
+    pool->sustain_level[v] = patch->sustain_level;
+    env_enter(pool, v, STAGE_ATTACK);
+    env_advance(pool, v);
+
+    pool->id[v] = pool->serial++;
+    if (pool->serial == 0)
+        pool->serial = 1;
+    return pool->id[v];
+}
+
+void fm_pool_reset(fm_pool *pool) {
+    unsigned int v;
+
+    for (v=0; v<pool->capacity; v++)
+        clear_voice(pool, v);
+    pool->active = 0;
+}
+
+void fm_pool_note_off(fm_pool *pool, unsigned int id) {
+    unsigned int v;
+
+    for (v=0; v<pool->active; v++) {
+        if (pool->id[v] != id)
+            continue;
+        if (pool->env_stage[v] != STAGE_IDLE && pool->env_stage[v] != STAGE_RELEASE) {
+            env_enter(pool, v, STAGE_RELEASE);
+            env_advance(pool, v);
+        }
+        return;
+    }
+}
+
+/******************************************************************************/
+/* Inner loop: run frames of n voices (n a multiple of FM_POOL_LANES) during  */
+/* which no envelope segment ends. The mix is accumulated in FM_POOL_LANES    */
+/* partial sums that are added in a fixed order, so the result is the same    */
+/* whichever instruction set the clone is built for.                          */
+/******************************************************************************/
+
+FM_TARGETS
+static void fm_render_run(unsigned int n, unsigned long run, float *out,
+                          float *restrict phase, const float *restrict step,
+                          float *restrict mod_phase, const float *restrict mod_step,
+                          const float *restrict depth, const float *restrict gain,
+                          const float *restrict env_base, const float *restrict env_increment,
+                          float *restrict env_pos,
+                          float *restrict mod_out, float *restrict car_out) {
+    float lanes[FM_POOL_LANES];
+    unsigned long j;
+    unsigned int v, l;
+    float env, ph;
+
+    for (j=0; j<run; j++) {
+        sine_block(mod_phase, mod_out, n);
+        sine_block(phase, car_out, n);
+        for (v=0; v<n; v++) {
+            env = env_base[v] + env_increment[v] * env_pos[v];
+            car_out[v] = gain[v] * env * car_out[v];
+            /* Frequency modulation: the phase step swings by depth */
+            ph = phase[v] + step[v] + depth[v] * env * mod_out[v];
+            phase[v] = ph - TWO_PI * (float)(int)(ph * INV_TWO_PI);
+            ph = mod_phase[v] + mod_step[v];
+            mod_phase[v] = ph - TWO_PI * (float)(int)(ph * INV_TWO_PI);
+            env_pos[v] += 1.0f;
+        }
+        for (l=0; l<FM_POOL_LANES; l++)
+            lanes[l] = car_out[l];
+        for (v=FM_POOL_LANES; v<n; v+=FM_POOL_LANES)
+            for (l=0; l<FM_POOL_LANES; l++)
+                lanes[l] += car_out[v+l];
+        for (l=FM_POOL_LANES/2; l>0; l/=2)
+            for (v=0; v<l; v++)
+                lanes[v] += lanes[v+l];
+        out[j] = lanes[0];
+    }
+}
+
+void fm_pool_render_voices(fm_pool *pool, unsigned int first, unsigned int count,
+                           float *out, unsigned long frames) {
+    unsigned int n = round_up(count);
+    unsigned int last = first + count;
+    unsigned long run;
+    unsigned int v;
+
+    while (frames > 0) {
+        run = frames;
+        for (v=first; v<last; v++)
+            if ((unsigned long)pool->env_remaining[v] < run)
+                run = pool->env_remaining[v];
+
+        fm_render_run(n, run, out, pool->phase + first, pool->step + first,
+                      pool->mod_phase + first, pool->mod_step + first,
+                      pool->depth + first, pool->gain + first,
+                      pool->env_base + first, pool->env_increment + first,
+                      pool->env_pos + first,
+                      pool->mod_out + first, pool->car_out + first);
+
+        for (v=first; v<last; v++) {
+            if (pool->env_remaining[v] != HOLD)
+                pool->env_remaining[v] -= run;
+            if (pool->env_remaining[v] == 0)
+                env_advance(pool, v);
+        }
+        out += run;
+        frames -= run;
+    }
+}
+
+void fm_pool_collect(fm_pool *pool) {
+    unsigned int v = 0, last;
+
+    while (v < pool->active) {
+        /* The rest of a release under the threshold would not be heard */
+        if (pool->env_stage[v] != STAGE_IDLE &&
+            (pool->env_stage[v] != STAGE_RELEASE ||
+             fabsf(pool->gain[v] * env_level(pool, v)) >= FM_SILENCE)) {
+            v++;
+            continue;
+        }
+        /* Move the last voice into the hole */
+        last = --pool->active;
+        if (v != last) {
+            pool->phase[v] = pool->phase[last];
+            pool->step[v] = pool->step[last];
+            pool->mod_phase[v] = pool->mod_phase[last];
+            pool->mod_step[v] = pool->mod_step[last];
+            pool->depth[v] = pool->depth[last];
+            pool->gain[v] = pool->gain[last];
+            pool->env_base[v] = pool->env_base[last];
+            pool->env_increment[v] = pool->env_increment[last];
+            pool->env_pos[v] = pool->env_pos[last];
+            pool->env_remaining[v] = pool->env_remaining[last];
+            pool->env_stage[v] = pool->env_stage[last];
+            pool->attack_samples[v] = pool->attack_samples[last];
+            pool->decay_samples[v] = pool->decay_samples[last];
+            pool->sustain_samples[v] = pool->sustain_samples[last];
+            pool->release_samples[v] = pool->release_samples[last];
+            pool->sustain_level[v] = pool->sustain_level[last];
+            pool->id[v] = pool->id[last];
+        }
+        clear_voice(pool, last);
+    }
+}
+
+void fm_pool_render(fm_pool *pool, float *out, unsigned long frames) {
+    if (pool->active == 0) {
+        memset(out, 0, frames * sizeof(float));
+        return;
+    }
+    fm_pool_render_voices(pool, 0, pool->active, out, frames);
+    fm_pool_collect(pool);
+}
@@ -0,0 +1,104 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Polyphonic two-operator FM voices in a fixed-capacity pool                 */
+/*                                                                            */
+/* Each voice is the Chowning instrument of fm_test: a sine carrier whose     */
+/* instantaneous frequency is f + I * env * fm * sin(2*pi*fm*t), scaled by    */
+/* the same ADSR envelope. Voice state is kept as a structure of arrays, so   */
+/* one loop iteration advances FM_POOL_LANES voices; the loops are compiled   */
+/* for AVX-512, AVX2 and SSE2 and picked at runtime. All memory is taken by   */
+/* fm_pool_init() from one arena, resident before the audio starts            */
+/* (rt_arena.h): starting, stopping, stealing and rendering voices never      */
+/* allocate or fault, so they can run in the audio callback. The pool is not  */
+/* thread safe: note on/off must come from the thread that renders.           */
+/******************************************************************************/
+
+#ifndef FM_VOICES_H
+#define FM_VOICES_H
+
+#include "rt_arena.h"
+
+#define FM_POOL_LANES (16) /* voices per loop iteration, capacity is rounded up */
+#define FM_SILENCE (1e-5f)  /* -100 dB: a voice releasing below this is retired */
+
+typedef struct {
+    double frequency;     /* carrier frequency in Hz */
+    double mod_frequency; /* modulator frequency in Hz */
+    double mod_index;     /* peak modulation index, scaled by the envelope */
+    double gain;          /* peak amplitude */
+    double attack;        /* envelope times in seconds, as in adsr() */
+    double decay;
+    double sustain;       /* negative to hold until fm_pool_note_off() */
+    double sustain_level;
+    double release;
+} fm_patch;
+
+typedef struct {
+    unsigned int capacity;  /* multiple of FM_POOL_LANES */
+    unsigned int active;    /* voices [0, active) are sounding */
+    unsigned int serial;    /* id of the next note */
+    double sample_rate;
+    /* One entry per voice, each array 64-byte aligned */
+    float *phase;           /* carrier phase, radians */
+    float *step;            /* carrier phase step, radians per sample */
+    float *mod_phase;
+    float *mod_step;
+    float *depth;           /* peak phase step deviation: index * mod_step */
+    float *gain;
+    float *env_base;        /* envelope is env_base + env_increment * env_pos */
+    float *env_increment;
+    float *env_pos;         /* samples into the current segment */
+    int *env_remaining;     /* samples left in the segment */
+    int *env_stage;
+    int *attack_samples;
+    int *decay_samples;
+    int *sustain_samples;
+    int *release_samples;
+    float *sustain_level;
+    unsigned int *id;
+    float *mod_out;         /* per voice scratch for the sine kernel */
+    float *car_out;
+    rt_arena arena;         /* every array above */
+} fm_pool;
+
+/* Allocate a pool for at least capacity voices. Returns 0, or -1. */
+int fm_pool_init(fm_pool *pool, unsigned int capacity, double sample_rate);
+
+void fm_pool_free(fm_pool *pool);
+
+/******************************************************************************/
+/* fm_pool_note_on: start a note, returns its id (never 0)                    */
+/* When the pool is full a voice is stolen: the quietest voice in its         */
+/* release stage, or else the oldest one. A stolen voice keeps its phase and  */
+/* level and attacks from there, so stealing does not click.                  */
+/******************************************************************************/
+
+unsigned int fm_pool_note_on(fm_pool *pool, const fm_patch *patch);
+
+/* Silence every voice at once, without release */
+void fm_pool_reset(fm_pool *pool);
+
+/* Release the note with the given id, if it is still sounding */
+void fm_pool_note_off(fm_pool *pool, unsigned int id);
+
+/* Render frames of the mono mix of all voices into out, then retire */
+/* voices whose envelope has finished or released below FM_SILENCE    */
+void fm_pool_render(fm_pool *pool, float *out, unsigned long frames);
+
+/******************************************************************************/
+/* fm_pool_render_voices: render only voices [first, first + count)           */
+/* first must be a multiple of FM_POOL_LANES, and so must count unless the    */
+/* range ends at pool->active. The mix is written (not added)                 */
+/* to out, summed in a fixed order, so the result only depends on the voices  */
+/* in the range. Ranges that do not overlap may be rendered concurrently.     */
+/* Finished voices stay in place until fm_pool_collect() is called.           */
+/******************************************************************************/
+
+void fm_pool_render_voices(fm_pool *pool, unsigned int first, unsigned int count,
+                           float *out, unsigned long frames);
+
+/* Retire finished and silent voices, keeping [0, active) packed */
+void fm_pool_collect(fm_pool *pool);
+
+#endif
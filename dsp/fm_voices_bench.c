@@ -0,0 +1,79 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Cost of rendering the FM voice pool, per voice and sample, and the share   */
+/* of a callback's real-time budget it takes at each polyphony.               */
+/* Usage: fm_voices_bench [frames_per_buffer]                                 */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sine.h"
+#include "fm_voices.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define MAX_FRAMES (4096)
+#define MIN_SECONDS (0.3)
+
+static float out[MAX_FRAMES];
+static volatile float sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    static const unsigned int polyphony[] = { 1, 16, 64, 128, 256, 512 };
+    unsigned long frames = 1024, blocks;
+    unsigned int p, v;
+    double start, elapsed, per_block, deadline;
+    fm_pool pool;
+    fm_patch brass = { 440, 440, 5, 1, 0.1, 0.1, -1, 0.5, 0.1 };
+
+    if (argc == 2)
+        frames = atoi(argv[1]);
+    if (frames < 1 || frames > MAX_FRAMES) {
+        fprintf(stderr, "Frames per buffer must be between 1 and %d\n", MAX_FRAMES);
+        return 1;
+    }
+    deadline = (double)frames / SAMPLE_RATE_IN_HZ;
+
+    printf("Brass voices, %lu frames per buffer (deadline %.2f ms), sine kernel %s\n",
+           frames, deadline * 1e3, sine_kernel_name());
+    printf("%8s %12s %14s %10s\n", "voices", "ms/buffer", "ns/voice/frame", "% budget");
+
+    for (p=0; p<sizeof(polyphony)/sizeof(polyphony[0]); p++) {
+        if (fm_pool_init(&pool, polyphony[p], SAMPLE_RATE_IN_HZ) < 0) {
+            fprintf(stderr, "Not enough memory\n");
+            return 1;
+        }
+        /* Spread the voices over five octaves, held in sustain */
+        for (v=0; v<polyphony[p]; v++) {
+            brass.frequency = 55.0 * (1 + (v % 60) / 12.0);
+            brass.mod_frequency = brass.frequency;
+            fm_pool_note_on(&pool, &brass);
+        }
+        /* Get through attack and decay first */
+        for (blocks=0; blocks<(unsigned long)(0.25 / deadline) + 1; blocks++)
+            fm_pool_render(&pool, out, frames);
+
+        blocks = 0;
+        start = now();
+        do {
+            fm_pool_render(&pool, out, frames);
+            blocks++;
+            elapsed = now() - start;
+        } while (elapsed < MIN_SECONDS);
+        sink = out[frames-1];
+
+        per_block = elapsed / blocks;
+        printf("%8u %12.3f %14.3f %9.1f%%\n", polyphony[p], per_block * 1e3,
+               per_block * 1e9 / ((double)polyphony[p] * frames),
+               100 * per_block / deadline);
+        fm_pool_free(&pool);
+    }
+    return 0;
+}
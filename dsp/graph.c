@@ -0,0 +1,567 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Block-processing graphs of DSP nodes                                       */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "adsr.h"
+#include "sine.h"
+#include "graph.h"
+
+#define TWO_PI (2 * M_PI)
+
+enum {
+    NODE_OSC,
+    NODE_ENV,
+    NODE_LFO,
+    NODE_FM,
+    NODE_GAIN,
+    NODE_MIX,
+    NODE_PARAM,
+    NODE_OUTPUT
+};
+
+struct graph_node {
+    int type;
+    double gain;                /* amplitude of oscillators, gain of the others */
+    double phase;               /* radians, oscillators, LFOs and operators */
+    double step;                /* radians per sample */
+    float depth;                /* radians per sample per unit of modulation */
+    float offset;               /* LFOs: added to the sine */
+    adsr_env env;
+    /* Modulators: the ramp to the next control point */
+    float value;                /* at the next frame */
+    float target;               /* at the control point */
+    float slope;                /* per frame */
+    unsigned int countdown;     /* frames to the control point */
+    int silent;                 /* the block just rendered is all zeros */
+    param_smooth *param;
+    int port[GRAPH_PORTS];      /* input node ids, -1 when not connected */
+    int *mix;                   /* mixer inputs */
+    unsigned int nb_mix;
+    unsigned int mix_capacity;
+    /* Compilation */
+    int visit;                  /* 0 not yet, 1 in progress, 2 scheduled */
+    int buffer;                 /* arena block of the output, -1 if none yet */
+    unsigned int last_use;      /* last step reading the output */
+};
+
+/* What a step writes and reads, by node id, while compiling */
+typedef struct {
+    int node;
+    int in[GRAPH_PORTS];
+    int accumulate;
+    int guard;                  /* envelope muting the next skip steps, or -1 */
+    unsigned int skip;
+} step_plan;
+
+typedef struct {
+    graph *g;
+    step_plan *plan;
+    unsigned int count;
+} compiler;
+
+int graph_init(graph *g, double sample_rate, unsigned long block) {
+    memset(g, 0, sizeof(*g));
+    g->sample_rate = sample_rate;
+    /* Keep every block of the arena 64-byte aligned */
+    g->block = (block + 15) / 16 * 16;
+    g->control = GRAPH_CONTROL;
+    g->output = -1;
+    return g->block > 0 ? 0 : -1;
+}
+
+void graph_free(graph *g) {
+    unsigned int i;
+
+    for (i=0; i<g->count; i++) {
+        free(g->nodes[i]->mix);
+        free(g->nodes[i]);
+    }
+    free(g->nodes);
+    rt_arena_free(&g->memory);
+    memset(g, 0, sizeof(*g));
+    g->output = -1;
+}
+
+int graph_control(graph *g, unsigned int frames) {
+    if (frames < 1 || frames > GRAPH_CONTROL_MAX)
+        return -1;
+    g->control = frames;
+    return 0;
+}
+
+static int add(graph *g, int type, double gain) {
+    graph_node *n, **nodes;
+    unsigned int p;
+
+    if (g->count == g->capacity) {
+        nodes = realloc(g->nodes, (2 * g->capacity + 16) * sizeof(*nodes));
+        if (nodes == NULL)
+            return -1;
+        g->nodes = nodes;
+        g->capacity = 2 * g->capacity + 16;
+    }
+    n = calloc(1, sizeof(*n));
+    if (n == NULL)
+        return -1;
+    n->type = type;
+    n->gain = gain;
+    for (p=0; p<GRAPH_PORTS; p++)
+        n->port[p] = -1;
+    g->nodes[g->count] = n;
+    return g->count++;
+}
+
+int graph_osc(graph *g, double frequency, double amplitude) {
+    int id = add(g, NODE_OSC, amplitude);
+
+    if (id >= 0)
+        g->nodes[id]->step = TWO_PI * frequency / g->sample_rate;
+    return id;
+}
+
+int graph_env(graph *g, double attack, double decay, double sustain,
+              double sustain_level, double release) {
+    int id = add(g, NODE_ENV, 1);
+
+    if (id >= 0) {
+        adsr_env_init(&g->nodes[id]->env, g->sample_rate, attack, decay, sustain,
+                      sustain_level, release);
+        adsr_env_note_on(&g->nodes[id]->env);
+        g->nodes[id]->value = g->nodes[id]->env.level;
+    }
+    return id;
+}
+
+int graph_lfo(graph *g, double frequency, double amount, double offset) {
+    int id = add(g, NODE_LFO, amount);
+
+    if (id >= 0) {
+        g->nodes[id]->step = TWO_PI * frequency / g->sample_rate;
+        g->nodes[id]->offset = offset;
+        g->nodes[id]->value = offset;
+    }
+    return id;
+}
+
+int graph_fm(graph *g, double frequency, double depth) {
+    int id = add(g, NODE_FM, 1);
+
+    if (id >= 0) {
+        g->nodes[id]->step = TWO_PI * frequency / g->sample_rate;
+        g->nodes[id]->depth = TWO_PI * depth / g->sample_rate;
+    }
+    return id;
+}
+
+int graph_gain(graph *g, double gain) {
+    return add(g, NODE_GAIN, gain);
+}
+
+int graph_mix(graph *g, double gain) {
+    return add(g, NODE_MIX, gain);
+}
+
+int graph_param(graph *g, param_smooth *p) {
+    int id = add(g, NODE_PARAM, 1);
+
+    if (id >= 0)
+        g->nodes[id]->param = p;
+    return id;
+}
+
+int graph_output(graph *g) {
+    if (g->output >= 0)
+        return -1;
+    g->output = add(g, NODE_OUTPUT, 1);
+    return g->output;
+}
+
+int graph_connect(graph *g, int from, int to, unsigned int port) {
+    graph_node *n;
+    int *mix;
+
+    if (from < 0 || to < 0 || (unsigned int) from >= g->count ||
+        (unsigned int) to >= g->count || g->nodes[from]->type == NODE_OUTPUT)
+        return -1;
+    n = g->nodes[to];
+    switch (n->type) {
+    case NODE_MIX:
+        if (n->nb_mix == n->mix_capacity) {
+            mix = realloc(n->mix, (2 * n->mix_capacity + 8) * sizeof(*mix));
+            if (mix == NULL)
+                return -1;
+            n->mix = mix;
+            n->mix_capacity = 2 * n->mix_capacity + 8;
+        }
+        n->mix[n->nb_mix++] = from;
+        return 0;
+    case NODE_FM:
+    case NODE_GAIN:
+        if (port >= GRAPH_PORTS || n->port[port] >= 0)
+            return -1;
+        break;
+    case NODE_OUTPUT:
+        if (port != GRAPH_OUTPUT_IN || n->port[port] >= 0)
+            return -1;
+        break;
+    default:
+        /* Sources have no inputs */
+        return -1;
+    }
+    n->port[port] = from;
+    return 0;
+}
+
+static void plan(compiler *c, int node, int in0, int in1, int accumulate) {
+    step_plan *s = &c->plan[c->count++];
+
+    s->node = node;
+    s->in[0] = in0;
+    s->in[1] = in1;
+    s->accumulate = accumulate;
+    s->guard = -1;
+    s->skip = 0;
+}
+
+/* Whether the inputs of n can change its output: if not, they are not */
+/* evaluated                                                            */
+static int needed(const graph_node *n) {
+    switch (n->type) {
+    case NODE_GAIN:
+        return n->gain != 0;
+    case NODE_FM:
+        /* Without a modulator the index scales nothing */
+        return n->depth != 0 && n->port[GRAPH_FM_MOD] >= 0;
+    default:
+        return 1;
+    }
+}
+
+/* Schedule what id depends on, then id itself */
+static int visit(compiler *c, int id) {
+    graph_node *n = c->g->nodes[id];
+    int in[GRAPH_PORTS];
+    unsigned int i, p, start;
+
+    if (n->visit == 2)
+        return 0;
+    if (n->visit == 1)
+        return -1;      /* back to a node in progress: a cycle */
+    n->visit = 1;
+    if (n->type == NODE_MIX) {
+        /* Sum each input as soon as it is ready, so it can be freed at once */
+        if (n->nb_mix == 0)
+            plan(c, id, -1, -1, 0);
+        for (i=0; i<n->nb_mix; i++) {
+            if (visit(c, n->mix[i]) < 0)
+                return -1;
+            plan(c, id, n->mix[i], -1, i > 0);
+        }
+    } else {
+        if ((n->type == NODE_GAIN || n->type == NODE_OUTPUT) && n->port[0] < 0)
+            return -1;
+        for (p=0; p<GRAPH_PORTS; p++)
+            in[p] = needed(n) ? n->port[p] : -1;
+        if (n->type == NODE_GAIN && in[GRAPH_GAIN_MOD] >= 0 &&
+            c->g->nodes[in[GRAPH_GAIN_MOD]]->type == NODE_ENV) {
+            /* A voice: its envelope first, so that once it has finished the */
+            /* steps of the rest of the voice can be skipped                 */
+            if (visit(c, in[GRAPH_GAIN_MOD]) < 0)
+                return -1;
+            start = c->count;
+            if (visit(c, in[GRAPH_GAIN_IN]) < 0)
+                return -1;
+            if (c->count > start) {
+                c->plan[start].guard = in[GRAPH_GAIN_MOD];
+                c->plan[start].skip = c->count - start;
+            }
+        } else {
+            for (p=0; p<GRAPH_PORTS; p++)
+                if (in[p] >= 0 && visit(c, in[p]) < 0)
+                    return -1;
+        }
+        plan(c, id, in[0], in[1], 0);
+    }
+    n->visit = 2;
+    return 0;
+}
+
+int graph_compile(graph *g) {
+    compiler c = { g, NULL, 0 };
+    int *free_list = NULL;
+    unsigned int i, s, k, p, nb_free = 0, nb_params = 0, max_steps = 0;
+    graph_node *n;
+    step_plan *sp;
+    graph_step *step;
+    int err = -1;
+
+    rt_arena_free(&g->memory);
+    g->steps = NULL;
+    g->arena = NULL;
+    g->nb_steps = g->buffers = 0;
+    if (g->output < 0)
+        return -1;
+
+    for (i=0; i<g->count; i++) {
+        n = g->nodes[i];
+        n->visit = 0;
+        n->buffer = -1;
+        n->last_use = 0;
+        max_steps += n->type == NODE_MIX && n->nb_mix > 0 ? n->nb_mix : 1;
+    }
+    c.plan = malloc(max_steps * sizeof(*c.plan));
+    free_list = malloc(max_steps * sizeof(*free_list));
+    if (c.plan == NULL || free_list == NULL || visit(&c, g->output) < 0)
+        goto out;
+
+    /* Parameters are shared by the voices: scheduled again, first, they */
+    /* are never inside a voice that gets skipped                        */
+    for (i=0; i<g->count; i++)
+        if (g->nodes[i]->type == NODE_PARAM && g->nodes[i]->visit == 2)
+            free_list[nb_params++] = i;
+    if (nb_params > 0) {
+        for (i=0; i<g->count; i++)
+            g->nodes[i]->visit = 0;
+        c.count = 0;
+        for (i=0; i<nb_params; i++)
+            visit(&c, free_list[i]);
+        visit(&c, g->output);
+    }
+
+    /* Liveness: the last step reading each node */
+    for (s=0; s<c.count; s++)
+        for (p=0; p<GRAPH_PORTS; p++)
+            if (c.plan[s].in[p] >= 0)
+                g->nodes[c.plan[s].in[p]]->last_use = s;
+
+    /* Steps can only be skipped if nothing after their gain reads them */
+    for (s=0; s<c.count; s++)
+        for (k=s; c.plan[s].guard >= 0 && k<s+c.plan[s].skip; k++)
+            if (g->nodes[c.plan[k].node]->last_use > s + c.plan[s].skip)
+                c.plan[s].guard = -1;
+
+    /* Hand out blocks in schedule order, taking back those that die */
+    for (s=0; s<c.count; s++) {
+        sp = &c.plan[s];
+        n = g->nodes[sp->node];
+        if (sp->node != g->output && n->buffer < 0)
+            n->buffer = nb_free > 0 ? free_list[--nb_free] : (int) g->buffers++;
+        for (p=0; p<GRAPH_PORTS; p++)
+            if (sp->in[p] >= 0 && g->nodes[sp->in[p]]->last_use == s &&
+                (p == 0 || sp->in[p] != sp->in[0]))
+                free_list[nb_free++] = g->nodes[sp->in[p]]->buffer;
+    }
+
+    /* The schedule and its buffers, resident before rendering */
+    if (rt_arena_init(&g->memory, rt_arena_size(c.count * sizeof(*g->steps)) +
+                                  rt_arena_size(g->buffers * g->block * sizeof(float))) < 0)
+        goto out;
+    g->steps = rt_arena_alloc(&g->memory, c.count * sizeof(*g->steps));
+    g->arena = rt_arena_alloc(&g->memory, g->buffers * g->block * sizeof(float));
+    for (s=0; s<c.count; s++) {
+        sp = &c.plan[s];
+        step = &g->steps[s];
+        n = g->nodes[sp->node];
+        step->node = n;
+        step->out = sp->node == g->output ? NULL : g->arena + n->buffer * g->block;
+        for (p=0; p<GRAPH_PORTS; p++) {
+            step->from[p] = sp->in[p] < 0 ? NULL : g->nodes[sp->in[p]];
+            step->in[p] = sp->in[p] < 0 ? NULL :
+                          g->arena + g->nodes[sp->in[p]]->buffer * g->block;
+        }
+        step->accumulate = sp->accumulate;
+        step->guard = sp->guard < 0 ? NULL : g->nodes[sp->guard];
+        step->skip = sp->guard < 0 ? 0 : sp->skip;
+    }
+    g->nb_steps = c.count;
+    err = 0;
+
+out:
+    free(c.plan);
+    free(free_list);
+    return err;
+}
+
+/* Phases of an operator, then their sines */
+static void fm(graph_node *n, const float *mod, const float *index, float *out,
+               unsigned long frames) {
+    float phase = n->phase, step = n->step, depth = n->depth;
+    unsigned long i;
+
+    if (mod == NULL) {
+        n->phase = sine_phase_ramp(out, n->phase, n->step, frames);
+    } else {
+        for (i=0; i<frames; i++) {
+            out[i] = phase;
+            phase += step + depth * (index != NULL ? index[i] : 1) * mod[i];
+            if (phase >= TWO_PI)
+                phase -= TWO_PI;
+            else if (phase < 0)
+                phase += TWO_PI;
+        }
+        n->phase = phase;
+    }
+    sine_block(out, out, frames);
+}
+
+/* Value of a modulator period frames on, moving it there */
+static float advance(graph_node *n, unsigned int period) {
+    if (n->type == NODE_ENV) {
+        adsr_env_advance(&n->env, period);
+        return n->env.level;
+    }
+    n->phase = fmod(n->phase + n->step * period, TWO_PI);
+    return n->offset + n->gain * sin(n->phase);
+}
+
+/* A modulator is evaluated at control points only, and runs ahead of its */
+/* output to the next one; the frames in between are interpolated        */
+static void modulate(graph_node *n, unsigned int control, float *out,
+                     unsigned long frames) {
+    float value, slope;
+    unsigned long run;
+    int i;
+
+    while (frames > 0) {
+        if (n->countdown == 0 && control == 1) {
+            /* Audio rate: the modulator itself */
+            if (n->type == NODE_ENV) {
+                adsr_env_process(&n->env, out, frames);
+                n->value = n->env.level;
+            } else {
+                n->phase = sine_phase_ramp(out, n->phase, n->step, frames);
+                sine_block(out, out, frames);
+                for (i=0; i<(int) frames; i++)
+                    out[i] = n->offset + n->gain * out[i];
+                n->value = n->offset + n->gain * sin(n->phase);
+            }
+            return;
+        }
+        if (n->countdown == 0) {
+            n->target = advance(n, control);
+            n->slope = (n->target - n->value) / control;
+            n->countdown = control;
+        }
+        run = frames < n->countdown ? frames : n->countdown;
+        value = n->value;
+        slope = n->slope;
+        for (i=0; i<(int) run; i++)
+            out[i] = value + slope * i;
+        n->countdown -= run;
+        n->value = n->countdown == 0 ? n->target : value + slope * run;
+        out += run;
+        frames -= run;
+    }
+}
+
+/* Whether an envelope is done and its blocks from now on are all zeros */
+static int finished(const graph_node *n) {
+    const adsr_env *env = &n->env;
+
+    return (env->stage == ADSR_IDLE || (env->stage == ADSR_RELEASE && env->remaining == 0)) &&
+           n->value == 0 && (n->countdown == 0 || n->target == 0);
+}
+
+static int is_silent(const graph_node *n) {
+    return n != NULL && n->silent;
+}
+
+/* Run a step, returns non-zero if its output is all zeros. Silent outputs */
+/* are not written: whatever reads them checks first.                      */
+static int run(graph_step *step, unsigned int control, float *out,
+               unsigned long frames) {
+    graph_node *n = step->node;
+    const float *in = step->in[0], *mod = step->in[1];
+    float gain = n->gain;
+    unsigned long i;
+
+    switch (n->type) {
+    case NODE_OSC:
+        n->phase = sine_phase_ramp(out, n->phase, n->step, frames);
+        sine_block(out, out, frames);
+        if (gain != 1)
+            for (i=0; i<frames; i++)
+                out[i] *= gain;
+        return 0;
+    case NODE_ENV:
+        if (finished(n))
+            return 1;
+        modulate(n, control, out, frames);
+        return 0;
+    case NODE_LFO:
+        modulate(n, control, out, frames);
+        return 0;
+    case NODE_FM:
+        /* A silent modulator or index leaves a plain sine */
+        if (is_silent(step->from[GRAPH_FM_MOD]) || is_silent(step->from[GRAPH_FM_INDEX]))
+            in = NULL;
+        fm(n, in, mod, out, frames);
+        return 0;
+    case NODE_GAIN:
+        if (in == NULL || is_silent(step->from[0]) || is_silent(step->from[1]))
+            return 1;
+        if (mod != NULL)
+            for (i=0; i<frames; i++)
+                out[i] = gain * in[i] * mod[i];
+        else
+            for (i=0; i<frames; i++)
+                out[i] = gain * in[i];
+        return 0;
+    case NODE_MIX:
+        /* Silent so far until an input that is not */
+        if (in == NULL || is_silent(step->from[0]))
+            return step->accumulate ? n->silent : 1;
+        if (step->accumulate && !n->silent)
+            for (i=0; i<frames; i++)
+                out[i] += gain * in[i];
+        else
+            for (i=0; i<frames; i++)
+                out[i] = gain * in[i];
+        return 0;
+    case NODE_PARAM:
+        /* Static: one value for the whole block */
+        if (!param_smooth_block(n->param, out, frames))
+            for (i=0; i<frames; i++)
+                out[i] = n->param->value;
+        return 0;
+    case NODE_OUTPUT:
+        /* The caller's buffer is always written */
+        if (is_silent(step->from[0])) {
+            memset(out, 0, frames * sizeof(float));
+            return 1;
+        }
+        memcpy(out, in, frames * sizeof(float));
+        return 0;
+    }
+    return 0;
+}
+
+int graph_render(graph *g, float *out, unsigned long frames) {
+    unsigned long block;
+    unsigned int s;
+    graph_step *step;
+    int silent = 1;
+
+    while (frames > 0) {
+        block = frames < g->block ? frames : g->block;
+        for (s=0; s<g->nb_steps; s++) {
+            step = &g->steps[s];
+            if (step->guard != NULL && step->guard->silent) {
+                /* The voice has finished: its gain will be silent */
+                s += step->skip - 1;
+                continue;
+            }
+            step->node->silent = run(step, g->control,
+                                     step->out != NULL ? step->out : out, block);
+        }
+        silent &= g->nodes[g->output]->silent;
+        out += block;
+        frames -= block;
+    }
+    return silent;
+}
@@ -0,0 +1,137 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Block-processing graphs of DSP nodes                                       */
+/*                                                                            */
+/* Instead of fusing oscillators, envelopes and mixing by hand in a callback, */
+/* a program adds nodes (oscillator, envelope, FM operator, gain, mixer,      */
+/* smoothed parameter and one output) and connects them. graph_compile()      */
+/* then turns the graph into a flat schedule of steps, so rendering a block   */
+/* is one loop over an array, with no graph walking, no recursion and no      */
+/* allocation.                                                                */
+/*                                                                            */
+/* The schedule is a depth-first topological order from the output, so each   */
+/* branch is finished before the next one starts, and a mixer adds each input */
+/* into its sum as soon as that input is ready. Every intermediate block      */
+/* lives in a buffer of a small arena, handed back as soon as its last reader */
+/* has run: a mix of hundreds of voices only needs the handful of buffers one */
+/* voice needs, plus the sum, so the working set stays in cache.              */
+/*                                                                            */
+/* Modulators (envelopes and LFOs) run at a control rate: they are evaluated  */
+/* exactly once every g->control frames, 32 unless graph_control() says       */
+/* otherwise, and their blocks are linear ramps between those values, which   */
+/* is all that the gains and operators reading them see. Modulators are only  */
+/* evaluated when they reach the output through an input that matters: nodes  */
+/* that cannot reach the output at all, and the inputs of a gain of zero or   */
+/* the index of an operator with no modulator or no depth, are left out of    */
+/* the schedule. Building and compiling allocate, rendering never does and    */
+/* can run in a callback: the steps and buffers come from one arena, resident */
+/* once compiled (rt_arena.h).                                                */
+/******************************************************************************/
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "param.h"
+#include "rt_arena.h"
+
+#define GRAPH_PORTS (2) /* inputs of every node but the mixer */
+#define GRAPH_CONTROL (32)      /* default frames per control period */
+#define GRAPH_CONTROL_MAX (64)
+
+/* Input ports */
+#define GRAPH_FM_MOD (0)        /* modulator, optional */
+#define GRAPH_FM_INDEX (1)      /* scales the modulation, optional */
+#define GRAPH_GAIN_IN (0)
+#define GRAPH_GAIN_MOD (1)      /* multiplies the gain, optional */
+#define GRAPH_OUTPUT_IN (0)
+
+typedef struct graph_node graph_node;
+
+typedef struct {
+    graph_node *node;
+    float *out;                 /* NULL: the caller's buffer */
+    const float *in[GRAPH_PORTS];
+    graph_node *from[GRAPH_PORTS]; /* the nodes behind in, NULL for none */
+    int accumulate;             /* mixer steps: add to out rather than write it */
+    graph_node *guard;          /* when this envelope has finished, */
+    unsigned int skip;          /* skip this step and the next skip - 1 */
+} graph_step;
+
+typedef struct {
+    double sample_rate;
+    unsigned long block;        /* frames per step, a multiple of 16 */
+    unsigned int control;       /* frames per evaluation of the modulators */
+    graph_node **nodes;
+    unsigned int count;
+    unsigned int capacity;
+    int output;                 /* id of the output node, -1 until added */
+    /* Filled by graph_compile() */
+    graph_step *steps;
+    unsigned int nb_steps;
+    unsigned int buffers;       /* blocks in the arena */
+    float *arena;
+    rt_arena memory;            /* steps and arena */
+} graph;
+
+/* Start an empty graph. block: most frames processed at once by each node. */
+int graph_init(graph *g, double sample_rate, unsigned long block);
+
+void graph_free(graph *g);
+
+/* Frames between evaluations of the modulators, 1 (audio rate) to */
+/* GRAPH_CONTROL_MAX. Returns 0, or -1 if out of range.            */
+int graph_control(graph *g, unsigned int frames);
+
+/******************************************************************************/
+/* Nodes. Each call returns the id of the new node, or -1 if out of memory.   */
+/******************************************************************************/
+
+/* Sine oscillator */
+int graph_osc(graph *g, double frequency, double amplitude);
+
+/* ADSR envelope, times in seconds as in adsr(), started when added */
+int graph_env(graph *g, double attack, double decay, double sustain,
+              double sustain_level, double release);
+
+/* Sine LFO: offset + amount * sin(2*pi*frequency*t) */
+int graph_lfo(graph *g, double frequency, double amount, double offset);
+
+/******************************************************************************/
+/* graph_fm: sine operator whose instantaneous frequency is                   */
+/* frequency + depth * index * mod, in Hz, index and mod being its two        */
+/* inputs (index is 1 and mod 0 when not connected). With a modulator at      */
+/* fm Hz, depth = I * fm gives Chowning's modulation index I.                 */
+/******************************************************************************/
+
+int graph_fm(graph *g, double frequency, double depth);
+
+/* in * gain, times the second input if connected */
+int graph_gain(graph *g, double gain);
+
+/* Sum of any number of inputs, times gain */
+int graph_mix(graph *g, double gain);
+
+/* The values of a smoothed parameter, owned and ramped by the caller */
+int graph_param(graph *g, param_smooth *p);
+
+/* Where graph_render() writes; one per graph */
+int graph_output(graph *g);
+
+/* Feed from's output into a port of to (the port is ignored by mixers). */
+/* Returns 0, or -1 if a node or the port is invalid or already taken.   */
+int graph_connect(graph *g, int from, int to, unsigned int port);
+
+/******************************************************************************/
+/* graph_compile: schedule the nodes and allocate the arena. Returns 0, or -1 */
+/* if there is no output, a required input is missing, there is a cycle or    */
+/* memory is short. It can be compiled again after more nodes are added.      */
+/******************************************************************************/
+
+int graph_compile(graph *g);
+
+/* Render frames frames of the output, mono, into out. Returns non-zero if */
+/* they are all zeros.                                                     */
+int graph_render(graph *g, float *out, unsigned long frames);
+
+#endif
@@ -0,0 +1,167 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Size of the arena and cost per voice and sample of a graph of brass        */
+/* voices (modulator, envelope, FM operator and gain per voice, all mixed),   */
+/* next to the arena a buffer per node would take and to the fused loops of   */
+/* the FM voice pool. The graph is timed with its modulators at the control   */
+/* rate and at audio rate, then again with an LFO on the index of each voice. */
+/* Usage: graph_bench [frames_per_buffer]                                     */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sine.h"
+#include "fm_voices.h"
+#include "graph.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define MAX_FRAMES (4096)
+#define MIN_SECONDS (0.3)
+#define NB_RUNS (4) /* with and without the LFO, at control and audio rate */
+
+static float out[MAX_FRAMES];
+static volatile float sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The voices of fm_voices_bench, as a graph, the index swept by an LFO */
+/* at 5 Hz if lfo is set                                               */
+static int build(graph *g, unsigned int voices, unsigned long frames, int lfo) {
+    unsigned int v;
+    int mix, mod, env, op, gain, output, sweep, depth;
+    double frequency;
+
+    if (graph_init(g, SAMPLE_RATE_IN_HZ, frames) < 0 || (mix = graph_mix(g, 1)) < 0 ||
+        (output = graph_output(g)) < 0 || graph_connect(g, mix, output, GRAPH_OUTPUT_IN) < 0)
+        return -1;
+    for (v=0; v<voices; v++) {
+        frequency = 55.0 * (1 + (v % 60) / 12.0);
+        if ((mod = graph_osc(g, frequency, 1)) < 0 ||
+            (env = graph_env(g, 0.1, 0.1, -1, 0.5, 0.1)) < 0 ||
+            (op = graph_fm(g, frequency, 5 * frequency)) < 0 ||
+            (gain = graph_gain(g, 1.0 / voices)) < 0 ||
+            graph_connect(g, mod, op, GRAPH_FM_MOD) < 0 ||
+            graph_connect(g, op, gain, GRAPH_GAIN_IN) < 0 ||
+            graph_connect(g, env, gain, GRAPH_GAIN_MOD) < 0 ||
+            graph_connect(g, gain, mix, 0) < 0)
+            return -1;
+        if (!lfo) {
+            if (graph_connect(g, env, op, GRAPH_FM_INDEX) < 0)
+                return -1;
+        } else if ((sweep = graph_lfo(g, 5, 0.5, 1)) < 0 ||
+                   (depth = graph_gain(g, 1)) < 0 ||
+                   graph_connect(g, env, depth, GRAPH_GAIN_IN) < 0 ||
+                   graph_connect(g, sweep, depth, GRAPH_GAIN_MOD) < 0 ||
+                   graph_connect(g, depth, op, GRAPH_FM_INDEX) < 0) {
+            return -1;
+        }
+    }
+    return graph_compile(g);
+}
+
+/* Seconds per buffer, after the attack and decay, with modulators */
+/* evaluated every control frames                                   */
+static double time_graph(graph *g, unsigned long frames, unsigned int control) {
+    unsigned long blocks;
+    double start, elapsed;
+
+    graph_control(g, control);
+    for (blocks=0; blocks<(unsigned long)(0.25 * SAMPLE_RATE_IN_HZ / frames) + 1; blocks++)
+        graph_render(g, out, frames);
+    blocks = 0;
+    start = now();
+    do {
+        graph_render(g, out, frames);
+        blocks++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    sink = out[frames-1];
+    return elapsed / blocks;
+}
+
+static double time_pool(unsigned int voices, unsigned long frames) {
+    fm_pool pool;
+    fm_patch brass = { 440, 440, 5, 1, 0.1, 0.1, -1, 0.5, 0.1 };
+    unsigned long blocks;
+    unsigned int v;
+    double start, elapsed;
+
+    if (fm_pool_init(&pool, voices, SAMPLE_RATE_IN_HZ) < 0)
+        return -1;
+    for (v=0; v<voices; v++) {
+        brass.frequency = 55.0 * (1 + (v % 60) / 12.0);
+        brass.mod_frequency = brass.frequency;
+        brass.gain = 1.0 / voices;
+        fm_pool_note_on(&pool, &brass);
+    }
+    for (blocks=0; blocks<(unsigned long)(0.25 * SAMPLE_RATE_IN_HZ / frames) + 1; blocks++)
+        fm_pool_render(&pool, out, frames);
+    blocks = 0;
+    start = now();
+    do {
+        fm_pool_render(&pool, out, frames);
+        blocks++;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    sink = out[frames-1];
+    fm_pool_free(&pool);
+    return elapsed / blocks;
+}
+
+int main(int argc, char *argv[]) {
+    static const unsigned int polyphony[] = { 1, 16, 64, 256 };
+    static const struct {
+        int lfo;
+        unsigned int control;
+    } runs[NB_RUNS] = { { 0, GRAPH_CONTROL }, { 0, 1 }, { 1, GRAPH_CONTROL }, { 1, 1 } };
+    unsigned long frames = 256;
+    unsigned int p, r, count = 0, nb_steps = 0, buffers = 0;
+    double times[NB_RUNS], pool_time, scale, arena = 0, per_node = 0;
+    graph g;
+
+    if (argc == 2)
+        frames = atoi(argv[1]);
+    if (frames < 1 || frames > MAX_FRAMES) {
+        fprintf(stderr, "Frames per buffer must be between 1 and %d\n", MAX_FRAMES);
+        return 1;
+    }
+
+    printf("Brass voices as a graph, %lu frames per buffer, sine kernel %s\n",
+           frames, sine_kernel_name());
+    printf("ns per voice and frame, modulators every %d frames or at audio rate\n",
+           GRAPH_CONTROL);
+    printf("%8s %8s %8s %8s %12s %12s %10s %10s %10s %10s %10s\n", "voices", "nodes",
+           "steps", "buffers", "arena KiB", "per node KiB", "control", "audio",
+           "lfo ctl", "lfo audio", "fm_pool");
+
+    for (p=0; p<sizeof(polyphony)/sizeof(polyphony[0]); p++) {
+        for (r=0; r<NB_RUNS; r++) {
+            if (build(&g, polyphony[p], frames, runs[r].lfo) < 0) {
+                fprintf(stderr, "Could not build the graph\n");
+                return 1;
+            }
+            times[r] = time_graph(&g, frames, runs[r].control);
+            if (r == 0) {
+                count = g.count;
+                nb_steps = g.nb_steps;
+                buffers = g.buffers;
+                arena = g.buffers * g.block * sizeof(float) / 1024.0;
+                per_node = (g.count - 1) * g.block * sizeof(float) / 1024.0;
+            }
+            graph_free(&g);
+        }
+        pool_time = time_pool(polyphony[p], frames);
+        scale = 1e9 / ((double)polyphony[p] * frames);
+        printf("%8u %8u %8u %8u %12.1f %12.1f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+               polyphony[p], count, nb_steps, buffers, arena, per_node,
+               times[0] * scale, times[1] * scale, times[2] * scale, times[3] * scale,
+               pool_time * scale);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Fixed-size, log-bucketed histograms of times                               */
+/******************************************************************************/
+
+#include <math.h>
+#include "histogram.h"
+
+#define RELAXED memory_order_relaxed
+
+void histogram_init(histogram *h) {
+    unsigned int b;
+
+    for (b=0; b<HISTOGRAM_BUCKETS; b++) {
+        atomic_init(&h->negative[b], 0);
+        atomic_init(&h->positive[b], 0);
+    }
+    atomic_init(&h->zero, 0);
+    atomic_init(&h->count, 0);
+    atomic_init(&h->min, INFINITY);
+    atomic_init(&h->max, -INFINITY);
+}
+
+/* Bucket of a magnitude of at least 1 us */
+static unsigned int bucket(double us) {
+    int exponent;
+    double mantissa = frexp(us, &exponent); /* in [0.5, 1) */
+    unsigned int b = (exponent - 1) * HISTOGRAM_STEPS +
+                     (unsigned int) ((2 * mantissa - 1) * HISTOGRAM_STEPS);
+
+    return b < HISTOGRAM_BUCKETS ? b : HISTOGRAM_BUCKETS - 1;
+}
+
+/* Keep a bucket's middle within what was actually recorded */
+static double clamp(histogram *h, double value) {
+    double min = atomic_load_explicit(&h->min, RELAXED);
+    double max = atomic_load_explicit(&h->max, RELAXED);
+
+    return value < min ? min : value > max ? max : value;
+}
+
+/* Middle of a bucket, in seconds */
+static double bucket_value(unsigned int b) {
+    double octave = ldexp(1e-6, b / HISTOGRAM_STEPS);
+
+    return octave * (1 + (b % HISTOGRAM_STEPS + 0.5) / HISTOGRAM_STEPS);
+}
+
+void histogram_record(histogram *h, double seconds) {
+    double us = fabs(seconds) * 1e6;
+
+    if (us < 1)
+        atomic_fetch_add_explicit(&h->zero, 1, RELAXED);
+    else if (seconds < 0)
+        atomic_fetch_add_explicit(&h->negative[bucket(us)], 1, RELAXED);
+    else
+        atomic_fetch_add_explicit(&h->positive[bucket(us)], 1, RELAXED);
+    /* Single writer: no compare and swap needed */
+    if (seconds < atomic_load_explicit(&h->min, RELAXED))
+        atomic_store_explicit(&h->min, seconds, RELAXED);
+    if (seconds > atomic_load_explicit(&h->max, RELAXED))
+        atomic_store_explicit(&h->max, seconds, RELAXED);
+    atomic_fetch_add_explicit(&h->count, 1, RELAXED);
+}
+
+double histogram_percentile(histogram *h, double percent) {
+    unsigned long total = 0, rank, seen = 0;
+    unsigned int b;
+
+    if (atomic_load_explicit(&h->count, RELAXED) == 0)
+        return 0;
+    if (percent <= 0)
+        return atomic_load_explicit(&h->min, RELAXED);
+    if (percent >= 100)
+        return atomic_load_explicit(&h->max, RELAXED);
+
+    /* Total of the buckets themselves, which may run ahead of count */
+    for (b=0; b<HISTOGRAM_BUCKETS; b++)
+        total += atomic_load_explicit(&h->negative[b], RELAXED) +
+                 atomic_load_explicit(&h->positive[b], RELAXED);
+    total += atomic_load_explicit(&h->zero, RELAXED);
+    rank = (unsigned long) ceil(percent / 100 * total);
+    if (rank == 0)
+        rank = 1;
+
+    /* From the most negative value up */
+    for (b=HISTOGRAM_BUCKETS; b-- > 0; ) {
+        seen += atomic_load_explicit(&h->negative[b], RELAXED);
+        if (seen >= rank)
+            return clamp(h, -bucket_value(b));
+    }
+    seen += atomic_load_explicit(&h->zero, RELAXED);
+    if (seen >= rank)
+        return clamp(h, 0);
+    for (b=0; b<HISTOGRAM_BUCKETS; b++) {
+        seen += atomic_load_explicit(&h->positive[b], RELAXED);
+        if (seen >= rank)
+            return clamp(h, bucket_value(b));
+    }
+    return atomic_load_explicit(&h->max, RELAXED);
+}
+
+void histogram_print(histogram *h, const char *name, FILE *f) {
+    fprintf(f, "%-12s %10lu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+            atomic_load_explicit(&h->count, RELAXED),
+            1e3 * histogram_percentile(h, 0), 1e3 * histogram_percentile(h, 50),
+            1e3 * histogram_percentile(h, 90), 1e3 * histogram_percentile(h, 99),
+            1e3 * histogram_percentile(h, 99.9), 1e3 * histogram_percentile(h, 100));
+}
@@ -0,0 +1,54 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Fixed-size, log-bucketed histograms of times                               */
+/*                                                                            */
+/* Values are in seconds and may be negative (a late deadline). Their         */
+/* magnitudes are bucketed by octave of microseconds, with HISTOGRAM_STEPS    */
+/* buckets per octave, so a bucket is never more than 1/HISTOGRAM_STEPS wide  */
+/* relative to its values, from 1 us up to 2^HISTOGRAM_OCTAVES us (about 4.8  */
+/* hours). Anything below 1 us counts as zero. The memory is fixed: recording */
+/* for a day costs the same as for a second.                                  */
+/*                                                                            */
+/* Recording is wait-free and safe in an audio callback: a few relaxed atomic */
+/* adds, no locks, no allocation. Any other thread may read the histogram     */
+/* while it is being recorded into, seeing each count before or after its     */
+/* latest update, which is all a live percentile needs.                       */
+/******************************************************************************/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define HISTOGRAM_OCTAVES (34)
+#define HISTOGRAM_STEPS (8) /* buckets per octave */
+#define HISTOGRAM_BUCKETS (HISTOGRAM_OCTAVES * HISTOGRAM_STEPS)
+
+typedef struct {
+    atomic_ulong negative[HISTOGRAM_BUCKETS];
+    atomic_ulong zero;
+    atomic_ulong positive[HISTOGRAM_BUCKETS];
+    atomic_ulong count;
+    _Atomic double min;
+    _Atomic double max;
+} histogram;
+
+void histogram_init(histogram *h);
+
+/* Count one value; one recording thread per histogram */
+void histogram_record(histogram *h, double seconds);
+
+/******************************************************************************/
+/* histogram_percentile: value below which percent of the recorded values     */
+/* lie, to the resolution of a bucket (the middle of the bucket is returned). */
+/* 0 and 100 return the exact minimum and maximum. 0 if nothing was recorded. */
+/******************************************************************************/
+
+double histogram_percentile(histogram *h, double percent);
+
+/* One line: count, min, 50th/90th/99th/99.9th percentiles and max, in ms */
+void histogram_print(histogram *h, const char *name, FILE *f);
+
+#endif
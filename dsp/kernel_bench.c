@@ -0,0 +1,483 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Microbenchmarks of the hot loops of the programs, in ns per sample and     */
+/* samples per second, for block sizes from 64 to 4096 frames. Each kernel    */
+/* is timed in its float version and, where the programs had one, in the      */
+/* double precision per-sample version it replaced. The FM pool and the       */
+/* multi-operator voices are also timed at several voice counts, a sample     */
+/* being one voice for one frame; the voices' preset is the result's name.    */
+/*                                                                            */
+/* Results are written as JSON, one result per line. With -b the results are  */
+/* compared with a file written earlier by this program: every result gets    */
+/* its change against the baseline, the regressions beyond the threshold are  */
+/* listed on stderr and the exit status is 1 if there was any.                */
+/* Usage: kernel_bench [-o results.json] [-b baseline.json] [-t percent]      */
+/*                     [-s seconds]                                           */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "adsr.h"
+#include "sine.h"
+#include "nco.h"
+#include "wavetable.h"
+#include "fm_voices.h"
+#include "fm_ops.h"
+#include "convert.h"
+#include "channels.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define MIN_BLOCK (64)
+#define MAX_BLOCK (4096)
+#define MAX_VOICES (256)
+#define REPEATS (5)             /* timed runs per result, the fastest is kept */
+#define MAX_RESULTS (256)
+
+typedef struct {
+    char kernel[32];
+    char type[8];
+    char name[16];              /* preset, empty if none */
+    unsigned long block;
+    unsigned int voices;
+    double ns_per_sample;
+} result;
+
+typedef struct {
+    const char *kernel;
+    const char *type;
+    const char *name;           /* preset the setup plays, NULL if none */
+    unsigned int voices;
+    void (*setup)(unsigned int voices);
+    void (*run)(unsigned long n);
+} bench;
+
+static float fbuf[MAX_BLOCK];
+static float gains[MAX_BLOCK];
+static double dbuf[MAX_BLOCK];
+static int16_t pcm[2 * MAX_BLOCK];
+static uint8_t packed[4 * MAX_BLOCK];
+static float stereo[2 * MAX_BLOCK];
+static volatile double sink;
+
+static double phase;
+static double t;
+static adsr_env env;
+static wavetable saw;
+static fm_pool pool;
+static fm_ops ops;
+static nco osc;
+static converter conv;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The kernels, each writing n samples per call */
+
+static void run_adsr(unsigned long n) {
+    unsigned long i;
+
+    /* Stay inside the 2 s envelope, as adsr_test did */
+    for (i=0; i<n; i++) {
+        dbuf[i] = adsr(t, 0.3, 0.3, 1.0, 0.5, 0.4);
+        t += 1.0 / SAMPLE_RATE_IN_HZ;
+    }
+    if (t >= 2.0)
+        t = 0;
+    sink = dbuf[n-1];
+}
+
+static void setup_adsr_env(unsigned int voices) {
+    adsr_env_init(&env, SAMPLE_RATE_IN_HZ, 0.3, 0.3, -1, 0.5, 0.4);
+}
+
+static void run_adsr_env(unsigned long n) {
+    /* Cycle through every stage */
+    if (env.stage == ADSR_IDLE)
+        adsr_env_note_on(&env);
+    else if (env.stage == ADSR_SUSTAIN)
+        adsr_env_note_off(&env);
+    adsr_env_process(&env, gains, n);
+    sink = gains[n-1];
+}
+
+static void setup_phases(unsigned int voices) {
+    unsigned long i;
+
+    for (i=0; i<MAX_BLOCK; i++)
+        fbuf[i] = (float)(2 * M_PI * rand() / RAND_MAX);
+    phase = 0;
+}
+
+static void run_sin(unsigned long n) {
+    unsigned long i;
+
+    for (i=0; i<n; i++)
+        dbuf[i] = sin(fbuf[i]);
+    sink = dbuf[n-1];
+}
+
+static void run_sine_block(unsigned long n) {
+    sine_block(fbuf, gains, n);
+    sink = gains[n-1];
+}
+
+/* generate_sine() of the ALSA sweep, before and after the block kernels */
+static void run_generate_sine_double(unsigned long n) {
+    double step = 2 * M_PI * 1000.0 / SAMPLE_RATE_IN_HZ;
+    unsigned long i;
+    int16_t res;
+
+    for (i=0; i<n; i++) {
+        res = sin(phase) * INT16_MAX;
+        pcm[2*i] = res;
+        pcm[2*i+1] = res;
+        phase += step;
+        if (phase >= 2 * M_PI)
+            phase -= 2 * M_PI;
+    }
+    sink = pcm[2*n-1];
+}
+
+static void run_generate_sine_float(unsigned long n) {
+    double step = 2 * M_PI * 1000.0 / SAMPLE_RATE_IN_HZ;
+    unsigned long i;
+    int16_t res;
+
+    phase = sine_phase_ramp(fbuf, phase, step, n);
+    sine_block(fbuf, fbuf, n);
+    for (i=0; i<n; i++) {
+        res = fbuf[i] * INT16_MAX;
+        pcm[2*i] = res;
+        pcm[2*i+1] = res;
+    }
+    sink = pcm[2*n-1];
+}
+
+static void setup_nco(unsigned int voices) {
+    nco_init(&osc, 1000.0, SAMPLE_RATE_IN_HZ);
+}
+
+/* The same with the fixed-point phase of nco.h */
+static void run_generate_sine_fixed(unsigned long n) {
+    unsigned long i;
+    int16_t res;
+
+    nco_render(&osc, fbuf, n);
+    for (i=0; i<n; i++) {
+        res = fbuf[i] * INT16_MAX;
+        pcm[2*i] = res;
+        pcm[2*i+1] = res;
+    }
+    sink = pcm[2*n-1];
+}
+
+/* The truncating int16_t conversion the ALSA programs did, for comparison */
+static void run_convert_truncate(unsigned long n) {
+    unsigned long i;
+
+    for (i=0; i<n; i++)
+        pcm[i] = fbuf[i] * INT16_MAX;
+    sink = pcm[n-1];
+}
+
+static void setup_convert(unsigned int voices) {
+    setup_phases(voices);
+    sine_block(fbuf, fbuf, MAX_BLOCK);
+    converter_init(&conv, CONVERT_S16, 0, 0);
+}
+
+static void run_convert_s16(unsigned long n) {
+    conv.format = CONVERT_S16;
+    conv.dither = 0;
+    convert_block(&conv, fbuf, pcm, n);
+    sink = pcm[n-1];
+}
+
+static void run_convert_s16_dither(unsigned long n) {
+    conv.format = CONVERT_S16;
+    conv.dither = 1;
+    convert_block(&conv, fbuf, pcm, n);
+    sink = pcm[n-1];
+}
+
+static void run_convert_s24_3_dither(unsigned long n) {
+    conv.format = CONVERT_S24_3;
+    conv.dither = 1;
+    convert_block(&conv, fbuf, packed, n);
+    sink = packed[3*n-1];
+}
+
+/* Mono to stereo, as the programs stored it and with the layout stages */
+static void run_fan_out_loop(unsigned long n) {
+    unsigned long i;
+
+    for (i=0; i<n; i++) {
+        stereo[2*i] = fbuf[i];
+        stereo[2*i+1] = fbuf[i];
+    }
+    sink = stereo[2*n-1];
+}
+
+static void run_fan_out(unsigned long n) {
+    channels_fan_out(fbuf, stereo, 2, n);
+    sink = stereo[2*n-1];
+}
+
+static void run_interleave(unsigned long n) {
+    const float *planes[2] = { fbuf, gains };
+
+    channels_interleave(planes, stereo, 2, n);
+    sink = stereo[2*n-1];
+}
+
+static void setup_wavetable(unsigned int voices) {
+    phase = 0;
+}
+
+static void run_wavetable(unsigned long n) {
+    phase = wavetable_render(&saw, fbuf, n, phase, 440);
+    sink = fbuf[n-1];
+}
+
+static void setup_fm_pool(unsigned int voices) {
+    fm_patch brass = { 440, 440, 5, 1, 0.1, 0.1, -1, 0.5, 0.1 };
+    unsigned int v;
+
+    fm_pool_reset(&pool);
+    /* Spread the voices over five octaves, held in sustain */
+    for (v=0; v<voices; v++) {
+        brass.frequency = 55.0 * (1 + (v % 60) / 12.0);
+        brass.mod_frequency = brass.frequency;
+        fm_pool_note_on(&pool, &brass);
+    }
+    /* Get through attack and decay first */
+    for (v=0; v<(unsigned int)(0.25 * SAMPLE_RATE_IN_HZ / MAX_BLOCK) + 1; v++)
+        fm_pool_render(&pool, fbuf, MAX_BLOCK);
+}
+
+static void run_fm_pool(unsigned long n) {
+    fm_pool_render(&pool, fbuf, n);
+    sink = fbuf[n-1];
+}
+
+/* Same spread as the FM pool, the patch rebuilt for each result */
+static void setup_fm_ops(const char *preset, unsigned int voices) {
+    unsigned int v;
+
+    fm_ops_free(&ops);
+    if (fm_ops_init(&ops, voices, SAMPLE_RATE_IN_HZ, fm_ops_preset(preset)) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        exit(2);
+    }
+    for (v=0; v<voices; v++)
+        fm_ops_note_on(&ops, 55.0 * (1 + (v % 60) / 12.0), 1);
+    for (v=0; v<(unsigned int)(0.25 * SAMPLE_RATE_IN_HZ / MAX_BLOCK) + 1; v++)
+        fm_ops_render(&ops, fbuf, MAX_BLOCK);
+}
+
+static void setup_fm_ops_brass(unsigned int voices) {
+    setup_fm_ops("brass", voices);
+}
+
+static void setup_fm_ops_epiano(unsigned int voices) {
+    setup_fm_ops("epiano", voices);
+}
+
+static void run_fm_ops(unsigned long n) {
+    fm_ops_render(&ops, fbuf, n);
+    sink = fbuf[n-1];
+}
+
+static const bench benches[] = {
+    { "adsr",          "double", NULL, 1, NULL,            run_adsr },
+    { "adsr_env",      "float",  NULL, 1, setup_adsr_env,  run_adsr_env },
+    { "sine",          "double", NULL, 1, setup_phases,    run_sin },
+    { "sine",          "float",  NULL, 1, setup_phases,    run_sine_block },
+    { "generate_sine", "double", NULL, 1, setup_phases,    run_generate_sine_double },
+    { "generate_sine", "float",  NULL, 1, setup_phases,    run_generate_sine_float },
+    { "generate_sine", "fixed",  NULL, 1, setup_nco,       run_generate_sine_fixed },
+    { "convert_s16",   "trunc",  NULL, 1, setup_convert,   run_convert_truncate },
+    { "convert_s16",   "float",  NULL, 1, setup_convert,   run_convert_s16 },
+    { "convert_s16_tpdf", "float", NULL, 1, setup_convert, run_convert_s16_dither },
+    { "convert_s24_3_tpdf", "float", NULL, 1, setup_convert, run_convert_s24_3_dither },
+    { "fan_out_stereo", "loop",  NULL, 1, setup_phases,    run_fan_out_loop },
+    { "fan_out_stereo", "float", NULL, 1, setup_phases,    run_fan_out },
+    { "interleave_stereo", "float", NULL, 1, setup_phases, run_interleave },
+    { "wavetable_saw", "float",  NULL, 1, setup_wavetable, run_wavetable },
+    { "fm_pool",       "float",  NULL, 1, setup_fm_pool,   run_fm_pool },
+    { "fm_pool",       "float",  NULL, 16, setup_fm_pool,   run_fm_pool },
+    { "fm_pool",       "float",  NULL, 64, setup_fm_pool,   run_fm_pool },
+    { "fm_pool",       "float",  NULL, MAX_VOICES, setup_fm_pool, run_fm_pool },
+    { "fm_ops",        "float",  "brass", 1, setup_fm_ops_brass, run_fm_ops },
+    { "fm_ops",        "float",  "brass", 16, setup_fm_ops_brass, run_fm_ops },
+    { "fm_ops",        "float",  "brass", 64, setup_fm_ops_brass, run_fm_ops },
+    { "fm_ops",        "float",  "brass", MAX_VOICES, setup_fm_ops_brass, run_fm_ops },
+    { "fm_ops",        "float",  "epiano", 1, setup_fm_ops_epiano, run_fm_ops },
+    { "fm_ops",        "float",  "epiano", 16, setup_fm_ops_epiano, run_fm_ops },
+    { "fm_ops",        "float",  "epiano", 64, setup_fm_ops_epiano, run_fm_ops },
+    { "fm_ops",        "float",  "epiano", MAX_VOICES, setup_fm_ops_epiano, run_fm_ops },
+};
+
+/* Fastest of REPEATS runs of at least seconds / REPEATS each, in ns/sample */
+static double time_it(void (*fn)(unsigned long), unsigned long n,
+                      unsigned int voices, double seconds) {
+    double start, elapsed, ns, best = INFINITY;
+    unsigned long blocks, batch, i;
+    unsigned int r;
+
+    fn(n); /* warm up */
+    for (r=0; r<REPEATS; r++) {
+        blocks = 0;
+        batch = 1;
+        start = now();
+        do {
+            for (i=0; i<batch; i++)
+                fn(n);
+            blocks += batch;
+            batch *= 2;
+            elapsed = now() - start;
+        } while (elapsed < seconds / REPEATS);
+        ns = elapsed * 1e9 / ((double)blocks * n * voices);
+        if (ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+/* Read the results of a file written by this program, -1 on failure. */
+/* Files from before the name field read with an empty name.          */
+static int read_results(const char *path, result *results) {
+    char line[256], *p;
+    int nb = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL)
+        return -1;
+    while (nb < MAX_RESULTS && fgets(line, sizeof(line), f) != NULL) {
+        results[nb].name[0] = '\0';
+        if ((p = strstr(line, "\"name\": \"")) != NULL)
+            sscanf(p, "\"name\": \"%15[^\"]\"", results[nb].name);
+        if (sscanf(line, " {\"kernel\": \"%31[^\"]\", \"type\": \"%7[^\"]\",",
+                   results[nb].kernel, results[nb].type) == 2 &&
+            (p = strstr(line, "\"block\": ")) != NULL &&
+            sscanf(p, "\"block\": %lu, \"voices\": %u, \"ns_per_sample\": %lf",
+                   &results[nb].block, &results[nb].voices,
+                   &results[nb].ns_per_sample) == 3)
+            nb++;
+    }
+    fclose(f);
+    return nb;
+}
+
+static const result *find_result(const result *results, int nb, const result *r) {
+    int i;
+
+    for (i=0; i<nb; i++)
+        if (strcmp(results[i].kernel, r->kernel) == 0 &&
+            strcmp(results[i].type, r->type) == 0 &&
+            strcmp(results[i].name, r->name) == 0 &&
+            results[i].block == r->block && results[i].voices == r->voices)
+            return &results[i];
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    static result results[MAX_RESULTS], baseline[MAX_RESULTS];
+    const char *output = NULL, *baseline_path = NULL;
+    double threshold = 10, seconds = 0.1, change;
+    int nb = 0, nb_baseline = 0, regressions = 0, opt, i;
+    const result *base;
+    unsigned long n;
+    unsigned int b;
+    FILE *out = stdout;
+
+    while ((opt = getopt(argc, argv, "o:b:t:s:")) != -1) {
+        switch (opt) {
+        case 'o': output = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        case 's': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: kernel_bench [-o results.json] [-b baseline.json] "
+                    "[-t percent] [-s seconds]\n");
+            return 2;
+        }
+    }
+    if (baseline_path != NULL &&
+        (nb_baseline = read_results(baseline_path, baseline)) < 0) {
+        fprintf(stderr, "Cannot read baseline %s\n", baseline_path);
+        return 2;
+    }
+    if (wavetable_build_named(&saw, "saw", SAMPLE_RATE_IN_HZ) < 0 ||
+        fm_pool_init(&pool, MAX_VOICES, SAMPLE_RATE_IN_HZ) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        return 2;
+    }
+
+    for (b=0; b<sizeof(benches)/sizeof(benches[0]); b++) {
+        for (n=MIN_BLOCK; n<=MAX_BLOCK; n*=2) {
+            if (benches[b].setup != NULL)
+                benches[b].setup(benches[b].voices);
+            snprintf(results[nb].kernel, sizeof(results[nb].kernel), "%s", benches[b].kernel);
+            snprintf(results[nb].type, sizeof(results[nb].type), "%s", benches[b].type);
+            snprintf(results[nb].name, sizeof(results[nb].name), "%s",
+                     benches[b].name != NULL ? benches[b].name : "");
+            results[nb].block = n;
+            results[nb].voices = benches[b].voices;
+            results[nb].ns_per_sample = time_it(benches[b].run, n, benches[b].voices,
+                                                seconds);
+            nb++;
+        }
+    }
+
+    if (output != NULL && (out = fopen(output, "w")) == NULL) {
+        fprintf(stderr, "Cannot write %s\n", output);
+        return 2;
+    }
+    fprintf(out, "{\n  \"sine_kernel\": \"%s\",\n  \"convert_kernel\": \"%s\",\n  \"results\": [\n",
+            sine_kernel_name(), convert_kernel_name());
+    for (i=0; i<nb; i++) {
+        fprintf(out, "    {\"kernel\": \"%s\", \"type\": \"%s\", \"name\": \"%s\", "
+                "\"block\": %lu, \"voices\": %u, \"ns_per_sample\": %.4f, "
+                "\"samples_per_sec\": %.4e",
+                results[i].kernel, results[i].type, results[i].name, results[i].block,
+                results[i].voices, results[i].ns_per_sample,
+                1e9 / results[i].ns_per_sample);
+        base = find_result(baseline, nb_baseline, &results[i]);
+        if (base != NULL) {
+            /* Positive changes are slowdowns */
+            change = 100 * (results[i].ns_per_sample / base->ns_per_sample - 1);
+            fprintf(out, ", \"baseline_ns_per_sample\": %.4f, \"change_percent\": %.1f",
+                    base->ns_per_sample, change);
+            if (change > threshold) {
+                fprintf(stderr, "Regression: %s %s%s%s block %lu voices %u: "
+                        "%.4f -> %.4f ns/sample (%+.1f%%)\n", results[i].kernel,
+                        results[i].type, results[i].name[0] != '\0' ? " " : "",
+                        results[i].name, results[i].block, results[i].voices,
+                        base->ns_per_sample, results[i].ns_per_sample, change);
+                regressions++;
+            }
+        }
+        fprintf(out, "}%s\n", i < nb - 1 ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout)
+        fclose(out);
+
+    if (baseline_path != NULL)
+        fprintf(stderr, "%d regression%s beyond %.1f%% against %s\n", regressions,
+                regressions == 1 ? "" : "s", threshold, baseline_path);
+    wavetable_free(&saw);
+    fm_pool_free(&pool);
+    fm_ops_free(&ops);
+    return regressions > 0;
+}
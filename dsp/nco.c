@@ -0,0 +1,78 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Fixed-point phase accumulator oscillators (numerically controlled)         */
+/******************************************************************************/
+
+#include <math.h>
+#include "nco.h"
+
+#define TABLE_SIZE (1 << NCO_TABLE_BITS)
+#define FRACTION_BITS (32 - NCO_TABLE_BITS)
+#define NCO_CHUNK (256) /* phases computed ahead of the table lookups */
+
+/* Entry i is sin(2*pi*i/TABLE_SIZE), slope its difference with the next */
+static float table[TABLE_SIZE];
+static float slope[TABLE_SIZE];
+static int table_ready;
+
+static void build_table(void) {
+    unsigned int i;
+
+    if (__atomic_load_n(&table_ready, __ATOMIC_ACQUIRE))
+        return;
+    for (i=0; i<TABLE_SIZE; i++) {
+        table[i] = sin(2 * M_PI * i / TABLE_SIZE);
+        slope[i] = sin(2 * M_PI * (i + 1) / TABLE_SIZE) - table[i];
+    }
+    __atomic_store_n(&table_ready, 1, __ATOMIC_RELEASE);
+}
+
+uint32_t nco_increment(double frequency, double sample_rate) {
+    double cycles = frequency / sample_rate;
+
+    /* Wrapped to [0, 1) first, so any frequency fits */
+    return (uint32_t) llrint((cycles - floor(cycles)) * NCO_CYCLE);
+}
+
+void nco_init(nco *o, double frequency, double sample_rate) {
+    build_table();
+    o->phase = 0;
+    o->increment = nco_increment(frequency, sample_rate);
+}
+
+void nco_sine_block(const uint32_t *phase, float *y, unsigned long n) {
+    const float scale = 1.0f / (1 << FRACTION_BITS);
+    unsigned long i;
+    uint32_t index;
+
+    build_table();
+    for (i=0; i<n; i++) {
+        index = phase[i] >> FRACTION_BITS;
+        y[i] = table[index] +
+               slope[index] * (float)(phase[i] & ((1u << FRACTION_BITS) - 1)) * scale;
+    }
+}
+
+void nco_phases(nco *o, uint32_t *phase, unsigned long n) {
+    uint32_t start = o->phase, increment = o->increment;
+    unsigned long i;
+
+    /* No carried dependency: every phase from the start, wrapping mod 2^32 */
+    for (i=0; i<n; i++)
+        phase[i] = start + (uint32_t) i * increment;
+    o->phase = start + (uint32_t) n * increment;
+}
+
+void nco_render(nco *o, float *y, unsigned long n) {
+    uint32_t phase[NCO_CHUNK];
+    unsigned long block;
+
+    while (n > 0) {
+        block = n < NCO_CHUNK ? n : NCO_CHUNK;
+        nco_phases(o, phase, block);
+        nco_sine_block(phase, y, block);
+        y += block;
+        n -= block;
+    }
+}
@@ -0,0 +1,112 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Offline rendering to a file, as fast as the CPU allows                     */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include "offline.h"
+
+static double now(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void put_le(unsigned char *p, uint32_t value, int bytes) {
+    int i;
+
+    for (i=0; i<bytes; i++)
+        p[i] = value >> (8 * i);
+}
+
+static int is_wav(const char *path) {
+    size_t len = strlen(path);
+
+    return len >= 4 && strcasecmp(path + len - 4, ".wav") == 0;
+}
+
+/* The sizes are known before rendering, so the header is written once and */
+/* the output can be a pipe                                                  */
+static int write_wav_header(FILE *file, offline_format format,
+                            unsigned int channels, unsigned int sample_rate,
+                            uint64_t data_bytes) {
+    unsigned char h[44];
+    unsigned int bytes = format == OFFLINE_S16 ? 2 : 4;
+    uint32_t riff_size = data_bytes + 36 > UINT32_MAX ? UINT32_MAX : data_bytes + 36;
+    uint32_t data_size = data_bytes > UINT32_MAX ? UINT32_MAX : data_bytes;
+
+    memcpy(h, "RIFF", 4);
+    put_le(h + 4, riff_size, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le(h + 16, 16, 4);
+    put_le(h + 20, format == OFFLINE_S16 ? 1 : 3, 2);
+    put_le(h + 22, channels, 2);
+    put_le(h + 24, sample_rate, 4);
+    put_le(h + 28, sample_rate * channels * bytes, 4);
+    put_le(h + 32, channels * bytes, 2);
+    put_le(h + 34, 8 * bytes, 2);
+    memcpy(h + 36, "data", 4);
+    put_le(h + 40, data_size, 4);
+    return fwrite(h, sizeof(h), 1, file) == 1 ? 0 : -1;
+}
+
+int offline_render(const char *path, offline_format format,
+                   unsigned int channels, unsigned int sample_rate,
+                   unsigned long frames_per_period, double duration,
+                   offline_render_fn render, void *data) {
+    size_t frame_bytes = channels * (format == OFFLINE_S16 ? 2 : 4);
+    unsigned long periods = ceil(duration * sample_rate / frames_per_period);
+    unsigned long p;
+    double start, render_time = 0, write_time = 0, audio;
+    void *buffer;
+    FILE *file;
+    int err = 0;
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    buffer = malloc(frames_per_period * frame_bytes);
+    if (buffer == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        fclose(file);
+        return -1;
+    }
+    if (is_wav(path))
+        err = write_wav_header(file, format, channels, sample_rate,
+                               (uint64_t) periods * frames_per_period * frame_bytes);
+
+    for (p=0; p<periods && err == 0; p++) {
+        start = now();
+        render(data, buffer, frames_per_period,
+               (double) p * frames_per_period / sample_rate);
+        render_time += now() - start;
+        start = now();
+        if (fwrite(buffer, frame_bytes, frames_per_period, file) != frames_per_period)
+            err = -1;
+        write_time += now() - start;
+    }
+    if (fclose(file) != 0)
+        err = -1;
+    free(buffer);
+    if (err < 0) {
+        fprintf(stderr, "Error writing %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    audio = (double) periods * frames_per_period / sample_rate;
+    printf("Rendered %.3f s of audio to %s in %.3f s (%.1fx real time), "
+           "%.3f s writing\n", audio, path, render_time,
+           render_time > 0 ? audio / render_time : INFINITY, write_time);
+    return 0;
+}
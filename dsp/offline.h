@@ -0,0 +1,39 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Offline rendering to a file, as fast as the CPU allows                     */
+/*                                                                            */
+/* Runs a program's audio callback in a tight loop, one period at a time, and */
+/* writes the interleaved result to a file instead of a sound device. Paths   */
+/* ending in ".wav" get a WAV header; anything else is written raw, so        */
+/* "/dev/null" measures the callback alone. The time handed to the callback   */
+/* is a virtual clock: the stream position of the period, in seconds.         */
+/* Rendering and file writing are timed separately and the real-time factor   */
+/* of the rendering (seconds of audio per wall-clock second) is printed.      */
+/******************************************************************************/
+
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+typedef enum {
+    OFFLINE_FLOAT32, /* native floats, WAV format 3 */
+    OFFLINE_S16      /* native 16-bit integers, WAV format 1 */
+} offline_format;
+
+/* Fill out with frames interleaved frames, starting time seconds in */
+typedef void (*offline_render_fn)(void *data, void *out, unsigned long frames,
+                                  double time);
+
+/******************************************************************************/
+/* offline_render: render duration seconds of audio into path                 */
+/* frames_per_period: frames per call of render, the period of the stream     */
+/* The last period is rendered whole, so up to one period more than duration  */
+/* may be written. Returns 0, or -1 if the file cannot be written.            */
+/******************************************************************************/
+
+int offline_render(const char *path, offline_format format,
+                   unsigned int channels, unsigned int sample_rate,
+                   unsigned long frames_per_period, double duration,
+                   offline_render_fn render, void *data);
+
+#endif
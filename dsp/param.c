@@ -0,0 +1,157 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Smoothed parameters, changed from another thread without locks             */
+/******************************************************************************/
+
+#include <math.h>
+#include "param.h"
+
+void param_smooth_init(param_smooth *p, float value) {
+    p->value = p->target = value;
+    p->remaining = 0;
+    p->position = 0;
+    p->start = value;
+    p->rate = 0;
+    p->shape = PARAM_LINEAR;
+}
+
+/* Value frame k of the ramp, from its start */
+static double ramp_value(const param_smooth *p, unsigned long k) {
+    if (p->shape == PARAM_EXPONENTIAL)
+        return p->start * exp(p->rate * k);
+    return p->start + p->rate * k;
+}
+
+void param_smooth_set(param_smooth *p, float target, unsigned long frames,
+                      param_shape shape) {
+    unsigned int k;
+
+    p->target = target;
+    p->start = p->value;
+    p->position = 0;
+    /* Exponential ramps need both ends on the same side of 0 */
+    if (shape == PARAM_EXPONENTIAL && !(p->value * target > 0))
+        shape = PARAM_LINEAR;
+    p->shape = shape;
+    if (frames == 0 || target == p->value) {
+        p->value = target;
+        p->remaining = 0;
+        return;
+    }
+    p->remaining = frames;
+    if (shape == PARAM_EXPONENTIAL) {
+        p->rate = log((double) target / p->value) / frames;
+        for (k=0; k<PARAM_LANES; k++)
+            p->powers[k] = exp(p->rate * k);
+    } else {
+        p->rate = ((double) target - p->value) / frames;
+    }
+}
+
+/* Move on n frames, n <= remaining */
+static void advance(param_smooth *p, unsigned long n) {
+    p->position += n;
+    p->remaining -= n;
+    p->value = p->remaining > 0 ? ramp_value(p, p->position) : p->target;
+}
+
+int param_smooth_block(param_smooth *p, float *out, unsigned long n) {
+    unsigned long i, j, run;
+    double start = p->start, rate = p->rate, base;
+    unsigned long position = p->position;
+    unsigned int k;
+
+    if (p->remaining == 0)
+        return 0;
+    run = n < p->remaining ? n : p->remaining;
+    if (p->shape == PARAM_LINEAR) {
+        for (i=0; i<run; i++)
+            out[i] = start + rate * (double) (position + i);
+    } else {
+        /* Closed form at every PARAM_LANES frames, powers in between */
+        for (j=0; j<run; j+=PARAM_LANES) {
+            base = start * exp(rate * (double) (position + j));
+            for (k=0; k<PARAM_LANES && j+k<run; k++)
+                out[j+k] = base * p->powers[k];
+        }
+    }
+    advance(p, run);
+    /* The frame after a finished ramp is the exact target */
+    for (i=run; i<n; i++)
+        out[i] = p->target;
+    return 1;
+}
+
+void param_smooth_skip(param_smooth *p, unsigned long n) {
+    if (p->remaining > 0)
+        advance(p, n < p->remaining ? n : p->remaining);
+}
+
+int param_bank_init(param_bank *bank, unsigned int count, const float *initial,
+                    unsigned long capacity) {
+    unsigned int i;
+
+    bank->size = 1;
+    while (bank->size < capacity)
+        bank->size *= 2;
+    if (rt_arena_init(&bank->arena, rt_arena_size(count * sizeof(*bank->params)) +
+                                    rt_arena_size(bank->size * sizeof(*bank->events))) < 0)
+        return -1;
+    bank->params = rt_arena_alloc(&bank->arena, count * sizeof(*bank->params));
+    bank->events = rt_arena_alloc(&bank->arena, bank->size * sizeof(*bank->events));
+    bank->count = count;
+    for (i=0; i<count; i++)
+        param_smooth_init(&bank->params[i], initial[i]);
+    bank->position = 0;
+    atomic_init(&bank->head, 0);
+    atomic_init(&bank->tail, 0);
+    return 0;
+}
+
+void param_bank_free(param_bank *bank) {
+    rt_arena_free(&bank->arena);
+    bank->params = NULL;
+    bank->events = NULL;
+}
+
+int param_post(param_bank *bank, unsigned int id, float target,
+               unsigned long frames, param_shape shape, unsigned long time) {
+    unsigned long head = atomic_load_explicit(&bank->head, memory_order_relaxed);
+    param_event *e;
+
+    if (id >= bank->count ||
+        head - atomic_load_explicit(&bank->tail, memory_order_acquire) == bank->size)
+        return -1;
+    e = &bank->events[head & (bank->size - 1)];
+    e->id = id;
+    e->target = target;
+    e->frames = frames;
+    e->shape = shape;
+    e->time = time;
+    atomic_store_explicit(&bank->head, head + 1, memory_order_release);
+    return 0;
+}
+
+unsigned long param_bank_update(param_bank *bank, unsigned long frames) {
+    unsigned long tail = atomic_load_explicit(&bank->tail, memory_order_relaxed);
+    unsigned long head = atomic_load_explicit(&bank->head, memory_order_acquire);
+    param_event *e;
+
+    for (; tail != head; tail++) {
+        e = &bank->events[tail & (bank->size - 1)];
+        if (e->time > bank->position) {
+            /* Render up to the frame where it is due */
+            if (e->time - bank->position < frames)
+                frames = e->time - bank->position;
+            break;
+        }
+        param_smooth_set(&bank->params[e->id], e->target, e->frames, e->shape);
+    }
+    atomic_store_explicit(&bank->tail, tail, memory_order_release);
+    return frames;
+}
+
+void param_bank_advance(param_bank *bank, unsigned long frames) {
+    bank->position += frames;
+}
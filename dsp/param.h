@@ -0,0 +1,114 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Smoothed parameters, changed from another thread without locks             */
+/*                                                                            */
+/* A control thread posts changes (a target, a ramp length in frames, linear  */
+/* or exponential, and the stream frame where the ramp starts) into a         */
+/* wait-free single-producer, single-consumer queue. The audio thread picks   */
+/* them up at the start of each stretch of frames: param_bank_update() says   */
+/* how many frames can be rendered before the next change is due, so a block  */
+/* is split exactly where a change lands and every ramp starts on its frame.  */
+/*                                                                            */
+/* A ramp is produced a block at a time in closed form from its start, with   */
+/* no carried dependency, so the compiler vectorizes it; a finished ramp      */
+/* sits exactly on its target, so ramps never overshoot or drift. A static    */
+/* parameter costs one compare per block: param_smooth_block() returns 0 and  */
+/* the caller uses the scalar value.                                          */
+/******************************************************************************/
+
+#ifndef PARAM_H
+#define PARAM_H
+
+#include <stdatomic.h>
+#include "rt_arena.h"
+
+#define PARAM_NOW (0) /* post time: at the start of the next block */
+#define PARAM_LANES (8) /* exponential ramps: one exp() per PARAM_LANES frames */
+
+typedef enum {
+    PARAM_LINEAR,
+    PARAM_EXPONENTIAL           /* equal ratios per frame; value and target > 0 */
+} param_shape;
+
+typedef struct {
+    float value;                /* value of the next frame */
+    float target;
+    unsigned long remaining;    /* frames left in the ramp, 0 when static */
+    double start;               /* value at the start of the ramp */
+    double rate;                /* per frame: increment, or log of the ratio */
+    unsigned long position;     /* frames into the ramp */
+    float powers[PARAM_LANES];  /* exponential: ratio^k, k < PARAM_LANES */
+    param_shape shape;
+} param_smooth;
+
+typedef struct {
+    unsigned int id;
+    param_shape shape;
+    float target;
+    unsigned long frames;       /* ramp length, 0 to jump */
+    unsigned long time;         /* stream frame where the ramp starts */
+} param_event;
+
+typedef struct {
+    param_smooth *params;
+    unsigned int count;
+    unsigned long position;     /* stream frame, audio thread's */
+    param_event *events;
+    unsigned long size;         /* a power of two */
+    rt_arena arena;             /* params and events, resident */
+    _Alignas(64) atomic_ulong head;     /* events ever posted, control thread's */
+    _Alignas(64) atomic_ulong tail;     /* events ever applied, audio thread's */
+} param_bank;
+
+void param_smooth_init(param_smooth *p, float value);
+
+/* Ramp from the current value to target over frames frames (0 jumps) */
+void param_smooth_set(param_smooth *p, float target, unsigned long frames,
+                      param_shape shape);
+
+/******************************************************************************/
+/* param_smooth_block: the next n values of the parameter                     */
+/* Returns 0 if the parameter is static, leaving out untouched (use           */
+/* p->value), or 1 after writing the n values to out.                         */
+/******************************************************************************/
+
+int param_smooth_block(param_smooth *p, float *out, unsigned long n);
+
+/* Skip n frames, as if param_smooth_block() had been called */
+void param_smooth_skip(param_smooth *p, unsigned long n);
+
+/******************************************************************************/
+/* param_bank_init: count parameters, all starting at initial[id]             */
+/* capacity: changes that can be waiting at once, rounded to a power of two   */
+/* Returns 0, or -1 if out of memory.                                         */
+/******************************************************************************/
+
+int param_bank_init(param_bank *bank, unsigned int count, const float *initial,
+                    unsigned long capacity);
+
+void param_bank_free(param_bank *bank);
+
+/******************************************************************************/
+/* param_post: control thread side, never blocks                              */
+/* Changes are applied in the order they are posted, each at its time or at   */
+/* once if that is past; post them in time order. Returns 0, or -1 if the     */
+/* queue is full or id unknown.                                               */
+/******************************************************************************/
+
+int param_post(param_bank *bank, unsigned int id, float target,
+               unsigned long frames, param_shape shape, unsigned long time);
+
+/******************************************************************************/
+/* param_bank_update: audio thread side, at the current stream position       */
+/* Applies the changes that are due and returns how many of the next frames   */
+/* frames can be rendered before the next one is (at least 1). Render them    */
+/* with param_smooth_block() or param_smooth_skip() on every parameter, then  */
+/* call param_bank_advance().                                                 */
+/******************************************************************************/
+
+unsigned long param_bank_update(param_bank *bank, unsigned long frames);
+
+void param_bank_advance(param_bank *bank, unsigned long frames);
+
+#endif
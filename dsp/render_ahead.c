@@ -0,0 +1,118 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Rendering ahead of the audio callback                                      */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "render_ahead.h"
+#include "denormals.h"
+
+/* Render blocks until the ring holds the fill level */
+static void top_up(render_ahead *ra) {
+    while (spsc_ring_fill(&ra->ring) < ra->fill * ra->channels) {
+        ra->render(ra->data, ra->scratch, ra->block);
+        /* The ring has room for fill plus a block, so this always fits */
+        spsc_ring_write(&ra->ring, ra->scratch, ra->block * ra->channels);
+    }
+}
+
+static void *producer(void *arg) {
+    render_ahead *ra = arg;
+    struct timespec nap;
+    double half_block = 0.5 * ra->block / ra->sample_rate;
+
+    nap.tv_sec = (time_t) half_block;
+    nap.tv_nsec = (long) ((half_block - nap.tv_sec) * 1e9);
+    denormals_flush();
+    while (!atomic_load_explicit(&ra->quit, memory_order_relaxed)) {
+        top_up(ra);
+        nanosleep(&nap, NULL);
+    }
+    return NULL;
+}
+
+int render_ahead_start(render_ahead *ra, render_ahead_fn render, void *data,
+                       unsigned int channels, double sample_rate,
+                       unsigned long block, unsigned long fill) {
+    pthread_attr_t attr;
+    struct sched_param param;
+    int policy, err;
+
+    ra->render = render;
+    ra->data = data;
+    ra->channels = channels;
+    ra->sample_rate = sample_rate;
+    ra->block = block;
+    ra->fill = (fill + block - 1) / block * block;
+    if (ra->fill == 0)
+        ra->fill = block;
+    atomic_init(&ra->quit, 0);
+    atomic_init(&ra->underruns, 0);
+    atomic_init(&ra->missing, 0);
+    atomic_init(&ra->low_water, ra->fill);
+    atomic_init(&ra->high_water, 0);
+
+    ra->scratch = aligned_alloc(64, (block * channels * sizeof(float) + 63) / 64 * 64);
+    if (ra->scratch == NULL)
+        return -1;
+    if (spsc_ring_init(&ra->ring, (ra->fill + block) * channels) < 0) {
+        free(ra->scratch);
+        return -1;
+    }
+    top_up(ra);
+
+    pthread_attr_init(&attr);
+    /* Run at the caller's real-time priority, if it has one */
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 &&
+        (policy == SCHED_FIFO || policy == SCHED_RR)) {
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, policy);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    err = pthread_create(&ra->thread, &attr, producer, ra);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        spsc_ring_free(&ra->ring);
+        free(ra->scratch);
+        return -1;
+    }
+    return 0;
+}
+
+void render_ahead_read(render_ahead *ra, float *out, unsigned long frames) {
+    unsigned long fill = spsc_ring_fill(&ra->ring) / ra->channels;
+    unsigned long got;
+
+    /* Only this thread writes the water marks */
+    if (fill < atomic_load_explicit(&ra->low_water, memory_order_relaxed))
+        atomic_store_explicit(&ra->low_water, fill, memory_order_relaxed);
+    if (fill > atomic_load_explicit(&ra->high_water, memory_order_relaxed))
+        atomic_store_explicit(&ra->high_water, fill, memory_order_relaxed);
+
+    got = spsc_ring_read(&ra->ring, out, frames * ra->channels) / ra->channels;
+    if (got < frames) {
+        memset(out + got * ra->channels, 0,
+               (frames - got) * ra->channels * sizeof(float));
+        atomic_fetch_add_explicit(&ra->underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ra->missing, frames - got, memory_order_relaxed);
+    }
+}
+
+void render_ahead_stop(render_ahead *ra) {
+    atomic_store(&ra->quit, 1);
+    pthread_join(ra->thread, NULL);
+    spsc_ring_free(&ra->ring);
+    free(ra->scratch);
+    ra->scratch = NULL;
+}
+
+void render_ahead_print(render_ahead *ra) {
+    printf("Rendered %lu frames ahead: %lu underruns (%lu frames of silence), "
+           "fill between %lu and %lu frames\n", ra->fill,
+           atomic_load(&ra->underruns), atomic_load(&ra->missing),
+           atomic_load(&ra->low_water), atomic_load(&ra->high_water));
+}
@@ -0,0 +1,64 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Rendering ahead of the audio callback                                      */
+/*                                                                            */
+/* A producer thread runs the synthesis in blocks and keeps an spsc_ring      */
+/* filled to a chosen level, so the audio callback only copies samples out    */
+/* and a slow block is absorbed by the fill instead of causing an underrun.   */
+/* The callback side never blocks, allocates or makes system calls; the       */
+/* producer sleeps for half a block whenever the ring holds enough. The       */
+/* counters are written by the callback and can be read from any thread.      */
+/* The fill level adds its own length to the output latency.                  */
+/******************************************************************************/
+
+#ifndef RENDER_AHEAD_H
+#define RENDER_AHEAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "spsc_ring.h"
+
+/* Render frames interleaved frames into out */
+typedef void (*render_ahead_fn)(void *data, float *out, unsigned long frames);
+
+typedef struct {
+    spsc_ring ring;
+    render_ahead_fn render;
+    void *data;
+    unsigned int channels;
+    unsigned long block;        /* frames per call of render */
+    unsigned long fill;         /* frames the producer keeps ready */
+    double sample_rate;
+    float *scratch;             /* one block, producer's */
+    pthread_t thread;
+    atomic_int quit;
+    /* Counters, in frames except for underruns */
+    atomic_ulong underruns;     /* callbacks that could not be served whole */
+    atomic_ulong missing;       /* frames replaced by silence */
+    atomic_ulong low_water;     /* lowest fill seen by the callback */
+    atomic_ulong high_water;    /* highest fill seen by the callback */
+} render_ahead;
+
+/******************************************************************************/
+/* render_ahead_start: fill the ring, then start the producer thread          */
+/* render, data: synthesis, called with block frames at a time                */
+/* fill: frames to keep rendered ahead, rounded up to whole blocks            */
+/* The producer inherits the real-time priority of the calling thread, if     */
+/* any. Returns 0, or -1 on failure.                                          */
+/******************************************************************************/
+
+int render_ahead_start(render_ahead *ra, render_ahead_fn render, void *data,
+                       unsigned int channels, double sample_rate,
+                       unsigned long block, unsigned long fill);
+
+/* Audio callback side: copy frames out, padding with silence on underrun */
+void render_ahead_read(render_ahead *ra, float *out, unsigned long frames);
+
+/* Stop the producer and free the ring */
+void render_ahead_stop(render_ahead *ra);
+
+/* Print the counters on stdout */
+void render_ahead_print(render_ahead *ra);
+
+#endif
@@ -0,0 +1,194 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Multi-core rendering of an FM voice pool                                   */
+/******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "render_pool.h"
+#include "denormals.h"
+
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void futex_wait(atomic_uint *word, unsigned int value) {
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake_all(atomic_uint *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Render chunks until none are left; called by the workers and the caller */
+static void render_chunks(render_pool *rp) {
+    unsigned int chunk, first, count;
+    unsigned int active = rp->voices->active;
+
+    while ((chunk = atomic_fetch_add(&rp->next_chunk, 1)) < rp->nb_chunks) {
+        first = chunk * RENDER_CHUNK_VOICES;
+        count = active - first < RENDER_CHUNK_VOICES ? active - first : RENDER_CHUNK_VOICES;
+        fm_pool_render_voices(rp->voices, first, count,
+                              rp->partials + chunk * rp->max_frames, rp->frames);
+    }
+}
+
+static void *worker(void *arg) {
+    render_pool *rp = arg;
+    unsigned int seen = 0;  /* epoch at init: the caller may bump it before we run */
+    unsigned int e, i;
+
+    denormals_flush();
+    for (;;) {
+        for (i=0; i<RENDER_POOL_SPIN && atomic_load(&rp->epoch) == seen; i++)
+            cpu_relax();
+        while ((e = atomic_load(&rp->epoch)) == seen) {
+            /* The caller checks sleepers after bumping epoch: one of */
+            /* the two always sees the other's update                */
+            atomic_fetch_add(&rp->sleepers, 1);
+            if (atomic_load(&rp->epoch) == seen)
+                futex_wait(&rp->epoch, seen);
+            atomic_fetch_sub(&rp->sleepers, 1);
+        }
+        seen = e;
+        if (atomic_load(&rp->quit))
+            break;
+        render_chunks(rp);
+        atomic_fetch_sub(&rp->pending, 1);
+    }
+    return NULL;
+}
+
+int render_pool_init(render_pool *rp, fm_pool *voices, unsigned int threads,
+                     unsigned long max_frames, int pin) {
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t cpus;
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int policy;
+    unsigned int i;
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > RENDER_POOL_MAX_THREADS + 1)
+        threads = RENDER_POOL_MAX_THREADS + 1;
+    if (nb_cpus < 1)
+        nb_cpus = 1;
+
+    rp->voices = voices;
+    rp->nb_workers = 0;
+    rp->max_frames = max_frames;
+    rp->max_chunks = (voices->capacity + RENDER_CHUNK_VOICES - 1) / RENDER_CHUNK_VOICES;
+    rp->partials = aligned_alloc(64, ((rp->max_chunks * max_frames * sizeof(float)) + 63) / 64 * 64);
+    if (rp->partials == NULL)
+        return -1;
+    rp->frames = 0;
+    rp->nb_chunks = 0;
+    atomic_init(&rp->next_chunk, 0);
+    atomic_init(&rp->pending, 0);
+    atomic_init(&rp->epoch, 0);
+    atomic_init(&rp->sleepers, 0);
+    atomic_init(&rp->quit, 0);
+
+    pthread_attr_init(&attr);
+    /* Run at the caller's real-time priority, if it has one */
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 &&
+        (policy == SCHED_FIFO || policy == SCHED_RR)) {
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, policy);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    for (i=0; i<threads-1; i++) {
+        if (pin) {
+            CPU_ZERO(&cpus);
+            CPU_SET((i + 1) % nb_cpus, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+        if (pthread_create(&rp->workers[i], &attr, worker, rp) != 0)
+            break;
+        rp->nb_workers++;
+    }
+    pthread_attr_destroy(&attr);
+    if (rp->nb_workers != threads - 1) {
+        render_pool_free(rp);
+        return -1;
+    }
+    return 0;
+}
+
+/* One period of at most max_frames frames, the size of the partials */
+static void render_period(render_pool *rp, float *out, unsigned long frames) {
+    unsigned int c, nb_chunks;
+    unsigned long i;
+    float *partial;
+
+    nb_chunks = (rp->voices->active + RENDER_CHUNK_VOICES - 1) / RENDER_CHUNK_VOICES;
+    rp->frames = frames;
+    rp->nb_chunks = nb_chunks;
+    atomic_store(&rp->next_chunk, 0);
+
+    if (nb_chunks > 1 && rp->nb_workers > 0) {
+        atomic_store(&rp->pending, rp->nb_workers);
+        atomic_fetch_add(&rp->epoch, 1);
+        if (atomic_load(&rp->sleepers) > 0)
+            futex_wake_all(&rp->epoch);
+        render_chunks(rp);
+        for (i=0; atomic_load(&rp->pending) != 0; i++) {
+            if (i < RENDER_POOL_SPIN)
+                cpu_relax();
+            else
+                sched_yield();
+        }
+    } else {
+        render_chunks(rp);
+    }
+    fm_pool_collect(rp->voices);
+
+    /* Fixed order mixdown */
+    if (nb_chunks == 0) {
+        memset(out, 0, frames * sizeof(float));
+        return;
+    }
+    memcpy(out, rp->partials, frames * sizeof(float));
+    for (c=1; c<nb_chunks; c++) {
+        partial = rp->partials + c * rp->max_frames;
+        for (i=0; i<frames; i++)
+            out[i] += partial[i];
+    }
+}
+
+void render_pool_render(render_pool *rp, float *out, unsigned long frames) {
+    unsigned long block;
+
+    /* Longer periods than the partials hold go in several passes */
+    while (frames > 0) {
+        block = frames < rp->max_frames ? frames : rp->max_frames;
+        render_period(rp, out, block);
+        out += block;
+        frames -= block;
+    }
+}
+
+void render_pool_free(render_pool *rp) {
+    unsigned int i;
+
+    if (rp->nb_workers > 0) {
+        atomic_store(&rp->quit, 1);
+        atomic_fetch_add(&rp->epoch, 1);
+        futex_wake_all(&rp->epoch);
+        for (i=0; i<rp->nb_workers; i++)
+            pthread_join(rp->workers[i], NULL);
+        rp->nb_workers = 0;
+    }
+    free(rp->partials);
+    rp->partials = NULL;
+}
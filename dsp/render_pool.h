@@ -0,0 +1,68 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Multi-core rendering of an FM voice pool                                   */
+/*                                                                            */
+/* The voices are cut into chunks of RENDER_CHUNK_VOICES. Once per period the */
+/* calling thread (the audio callback) wakes a persistent set of pinned       */
+/* worker threads and they all take chunks from a shared counter, each chunk  */
+/* rendering into its own buffer. The caller then adds the chunk buffers in   */
+/* chunk order. Chunk boundaries and the order of the additions do not depend */
+/* on the number of threads, so the output is bit-identical whatever the      */
+/* thread count, including a single thread.                                   */
+/*                                                                            */
+/* Workers spin for a short while after each period and then sleep on a       */
+/* futex, so waking them costs a system call only when they were idle for     */
+/* long. The caller waiting for the workers yields the CPU after the same     */
+/* spin, so running more threads than cores degrades instead of stalling.     */
+/* All buffers are allocated by render_pool_init().                           */
+/******************************************************************************/
+
+#ifndef RENDER_POOL_H
+#define RENDER_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "fm_voices.h"
+
+#define RENDER_CHUNK_VOICES (2 * FM_POOL_LANES)
+#define RENDER_POOL_MAX_THREADS (64)
+#define RENDER_POOL_SPIN (2000) /* polls before a waiting thread backs off */
+
+typedef struct {
+    fm_pool *voices;
+    unsigned int nb_workers;     /* threads besides the caller */
+    pthread_t workers[RENDER_POOL_MAX_THREADS];
+    unsigned long max_frames;
+    unsigned int max_chunks;
+    float *partials;             /* max_chunks buffers of max_frames */
+    /* Current period, written by the caller before bumping epoch */
+    unsigned long frames;
+    unsigned int nb_chunks;
+    _Alignas(64) atomic_uint next_chunk;
+    _Alignas(64) atomic_uint pending;  /* workers not done with the period */
+    _Alignas(64) atomic_uint epoch;    /* futex word, one step per period */
+    atomic_uint sleepers;
+    atomic_int quit;
+} render_pool;
+
+/******************************************************************************/
+/* render_pool_init: start the workers                                        */
+/* voices: pool to render, its capacity sets the number of chunk buffers      */
+/* threads: total number of rendering threads, the caller included            */
+/* max_frames: frames rendered per pass, longer periods take several         */
+/* pin: when non-zero, worker i is pinned to CPU (i + 1) modulo the CPU count */
+/* Workers inherit the real-time priority of the calling thread, if any.      */
+/* Returns 0, or -1 on failure.                                               */
+/******************************************************************************/
+
+int render_pool_init(render_pool *rp, fm_pool *voices, unsigned int threads,
+                     unsigned long max_frames, int pin);
+
+/* Render frames of the mono mix into out, then retire finished voices */
+void render_pool_render(render_pool *rp, float *out, unsigned long frames);
+
+/* Stop the workers and free the buffers */
+void render_pool_free(render_pool *rp);
+
+#endif
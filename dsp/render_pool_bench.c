@@ -0,0 +1,146 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Scaling of the multi-core voice renderer: for each thread count, the       */
+/* largest number of brass voices whose average render time stays within a    */
+/* fixed share of a 1024-frame period. Also checks that the output is the     */
+/* same, bit for bit, for one thread and for the largest thread count.        */
+/* Usage: render_pool_bench [max_threads] [budget_percent]                    */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "fm_voices.h"
+#include "render_pool.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define FRAMES_PER_BUFFER (1024)
+#define MAX_VOICES (16384)
+#define PERIODS (20)
+#define CHECK_PERIODS (64)
+
+static float out[FRAMES_PER_BUFFER];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void start_voices(fm_pool *pool, unsigned int voices) {
+    fm_patch brass = { 440, 440, 5, 1, 0.05, 0.05, -1, 0.5, 0.1 };
+    unsigned int v;
+
+    fm_pool_reset(pool);
+    for (v=0; v<voices; v++) {
+        brass.frequency = 55.0 * (1 + (v % 60) / 12.0);
+        brass.mod_frequency = brass.frequency;
+        fm_pool_note_on(pool, &brass);
+    }
+}
+
+/* Average seconds per period for the given polyphony */
+static double period_time(render_pool *rp, unsigned int voices) {
+    double start;
+    int i;
+
+    start_voices(rp->voices, voices);
+    for (i=0; i<5; i++)
+        render_pool_render(rp, out, FRAMES_PER_BUFFER);
+    start = now();
+    for (i=0; i<PERIODS; i++)
+        render_pool_render(rp, out, FRAMES_PER_BUFFER);
+    return (now() - start) / PERIODS;
+}
+
+/* Render a score with note offs, keeping every sample */
+static void render_score(render_pool *rp, float *result) {
+    unsigned int ids[300];
+    fm_patch brass = { 440, 440, 5, 1, 0.05, 0.05, -1, 0.5, 0.1 };
+    unsigned int v;
+    int i;
+
+    fm_pool_reset(rp->voices);
+    for (v=0; v<300; v++) {
+        brass.frequency = 55.0 * (1 + (v % 60) / 12.0);
+        brass.mod_frequency = brass.frequency * 1.4;
+        ids[v] = fm_pool_note_on(rp->voices, &brass);
+    }
+    for (i=0; i<CHECK_PERIODS; i++) {
+        for (v=i; v<300; v+=CHECK_PERIODS / 2)
+            fm_pool_note_off(rp->voices, ids[v]);
+        render_pool_render(rp, result + i * FRAMES_PER_BUFFER, FRAMES_PER_BUFFER);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static float single[CHECK_PERIODS * FRAMES_PER_BUFFER];
+    static float multi[CHECK_PERIODS * FRAMES_PER_BUFFER];
+    unsigned int threads, max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int lo, hi, mid, best1 = 0, best;
+    double budget_percent = 50, deadline, budget;
+    fm_pool pool;
+    render_pool rp;
+
+    if (argc >= 2)
+        max_threads = atoi(argv[1]);
+    if (argc >= 3)
+        budget_percent = atof(argv[2]);
+    if (max_threads < 1)
+        max_threads = 1;
+    deadline = (double)FRAMES_PER_BUFFER / SAMPLE_RATE_IN_HZ;
+    budget = deadline * budget_percent / 100;
+
+    if (fm_pool_init(&pool, MAX_VOICES, SAMPLE_RATE_IN_HZ) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+
+    printf("Budget %.2f ms (%.0f%% of a %d-frame period), %ld CPUs online\n",
+           budget * 1e3, budget_percent, FRAMES_PER_BUFFER, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %8s %10s %10s\n", "threads", "voices", "ms/period", "speedup");
+    for (threads=1; threads<=max_threads; threads++) {
+        if (render_pool_init(&rp, &pool, threads, FRAMES_PER_BUFFER, 1) < 0) {
+            fprintf(stderr, "Cannot start %u threads\n", threads);
+            return 1;
+        }
+        /* Grow until over budget, then bisect in whole chunks */
+        lo = 0;
+        hi = RENDER_CHUNK_VOICES;
+        while (hi <= MAX_VOICES && period_time(&rp, hi) <= budget) {
+            lo = hi;
+            hi *= 2;
+        }
+        if (hi > MAX_VOICES)
+            hi = MAX_VOICES + RENDER_CHUNK_VOICES;
+        while (hi - lo > RENDER_CHUNK_VOICES) {
+            mid = (lo + hi) / 2 / RENDER_CHUNK_VOICES * RENDER_CHUNK_VOICES;
+            if (period_time(&rp, mid) <= budget)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        best = lo;
+        if (threads == 1)
+            best1 = best;
+        printf("%8u %8u %10.3f %9.2fx\n", threads, best,
+               best > 0 ? period_time(&rp, best) * 1e3 : 0.0,
+               best1 > 0 ? (double)best / best1 : 0.0);
+        render_pool_free(&rp);
+    }
+
+    render_pool_init(&rp, &pool, 1, FRAMES_PER_BUFFER, 1);
+    render_score(&rp, single);
+    render_pool_free(&rp);
+    render_pool_init(&rp, &pool, max_threads > 1 ? max_threads : 2, FRAMES_PER_BUFFER, 1);
+    render_score(&rp, multi);
+    render_pool_free(&rp);
+    printf("Output with 1 and %u threads is %s\n", max_threads > 1 ? max_threads : 2,
+           memcmp(single, multi, sizeof(single)) == 0 ? "bit-identical" : "DIFFERENT");
+
+    fm_pool_free(&pool);
+    return 0;
+}
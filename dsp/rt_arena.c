@@ -0,0 +1,54 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Preallocated arenas for the state of streams and voices                    */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "rt_arena.h"
+
+size_t rt_arena_size(size_t size) {
+    return (size + RT_ARENA_ALIGN - 1) / RT_ARENA_ALIGN * RT_ARENA_ALIGN;
+}
+
+int rt_arena_init(rt_arena *arena, size_t size) {
+    arena->size = rt_arena_size(size > 0 ? size : 1);
+    arena->used = 0;
+    arena->base = aligned_alloc(RT_ARENA_ALIGN, arena->size);
+    if (arena->base == NULL)
+        return -1;
+    /* Fault every page in now rather than in the audio thread */
+    memset(arena->base, 0, arena->size);
+    arena->locked = mlock(arena->base, arena->size) == 0;
+    return 0;
+}
+
+void rt_arena_free(rt_arena *arena) {
+    if (arena->locked)
+        munlock(arena->base, arena->size);
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = arena->used = 0;
+}
+
+void *rt_arena_alloc(rt_arena *arena, size_t size) {
+    size_t aligned = rt_arena_size(size);
+    void *p;
+
+    if (aligned > arena->size - arena->used)
+        return NULL;
+    p = arena->base + arena->used;
+    arena->used += aligned;
+    return p;
+}
+
+size_t rt_arena_mark(const rt_arena *arena) {
+    return arena->used;
+}
+
+void rt_arena_reset(rt_arena *arena, size_t mark) {
+    if (mark < arena->used)
+        arena->used = mark;
+}
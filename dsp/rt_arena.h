@@ -0,0 +1,50 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Preallocated arenas for the state of streams and voices                    */
+/*                                                                            */
+/* A stream or a voice pool sizes everything it will need up front and takes  */
+/* it from one arena, allocated, touched and, where allowed, locked into RAM  */
+/* by rt_arena_init() before the audio starts. Taking memory from the arena   */
+/* is a bump of an offset: no malloc, no lock, no page fault, so it is safe   */
+/* in the audio thread. Nothing is freed one by one; the arena can be reset   */
+/* to an earlier mark, or freed whole once the stream has stopped.            */
+/******************************************************************************/
+
+#ifndef RT_ARENA_H
+#define RT_ARENA_H
+
+#include <stddef.h>
+
+#define RT_ARENA_ALIGN (64) /* every allocation starts on a cache line */
+
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+    int locked;                 /* non-zero if mlock() succeeded */
+} rt_arena;
+
+/******************************************************************************/
+/* rt_arena_init: allocate size bytes, zeroed, and keep them resident         */
+/* Returns 0, or -1 if out of memory. Failing to lock the pages (RLIMIT_      */
+/* MEMLOCK) is not an error: locked stays 0.                                  */
+/******************************************************************************/
+
+int rt_arena_init(rt_arena *arena, size_t size);
+
+void rt_arena_free(rt_arena *arena);
+
+/* Bytes the arena must hold for size bytes, once aligned */
+size_t rt_arena_size(size_t size);
+
+/* size bytes, aligned to RT_ARENA_ALIGN, or NULL if the arena is full */
+void *rt_arena_alloc(rt_arena *arena, size_t size);
+
+/* Current position, to go back to with rt_arena_reset() */
+size_t rt_arena_mark(const rt_arena *arena);
+
+/* Give back everything allocated since mark; it is not zeroed again */
+void rt_arena_reset(rt_arena *arena, size_t mark);
+
+#endif
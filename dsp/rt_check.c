@@ -0,0 +1,129 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Tripwire for blocking calls in the audio thread                            */
+/******************************************************************************/
+
+#define _GNU_SOURCE
+#include <stddef.h>
+#include "rt_check.h"
+
+static __thread int depth;
+
+void rt_check_enter(void) {
+    depth++;
+}
+
+void rt_check_leave(void) {
+    depth--;
+}
+
+int rt_check_active(void) {
+    return depth > 0;
+}
+
+#ifndef RT_CHECK
+
+int rt_check_enabled(void) {
+    return 0;
+}
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+
+#define BACKTRACE_DEPTH (32)
+
+/* glibc's own allocator, behind the public names replaced below */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *p);
+
+static int (*real_mutex_lock)(pthread_mutex_t *mutex);
+
+__attribute__((constructor)) static void setup(void) {
+    void *frames[1];
+
+    real_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    /* The first backtrace loads the unwinder, which allocates: do it now */
+    backtrace(frames, 1);
+}
+
+static void trip(const char *call) {
+    void *frames[BACKTRACE_DEPTH];
+    int n;
+
+    depth = 0;      /* what follows may itself allocate */
+    write(2, "rt_check: ", 10);
+    write(2, call, strlen(call));
+    write(2, " called in a real-time region\n", 30);
+    n = backtrace(frames, BACKTRACE_DEPTH);
+    backtrace_symbols_fd(frames, n, 2);
+    abort();
+}
+
+int rt_check_enabled(void) {
+    return 1;
+}
+
+void *malloc(size_t size) {
+    if (depth > 0)
+        trip("malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (depth > 0)
+        trip("calloc");
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+    if (depth > 0)
+        trip("realloc");
+    return __libc_realloc(p, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    if (depth > 0)
+        trip("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    if (depth > 0)
+        trip("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+    if (depth > 0)
+        trip("posix_memalign");
+    *p = __libc_memalign(alignment, size);
+    return *p != NULL ? 0 : ENOMEM;
+}
+
+void free(void *p) {
+    if (depth > 0)
+        trip("free");
+    __libc_free(p);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    if (depth > 0)
+        trip("pthread_mutex_lock");
+    /* Other constructors may lock before setup() has run */
+    if (real_mutex_lock == NULL)
+        real_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    return real_mutex_lock(mutex);
+}
+
+#endif
@@ -0,0 +1,35 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Tripwire for blocking calls in the audio thread                            */
+/*                                                                            */
+/* Code that must meet a deadline (an audio callback, the render step of a    */
+/* playback loop) is bracketed with rt_check_enter() and rt_check_leave().    */
+/* In a normal build these only set a thread-local flag. Built with           */
+/* make RT_CHECK=1, libdsp.a also replaces malloc, calloc, realloc, free,     */
+/* the aligned allocators and pthread_mutex_lock: called from a thread        */
+/* inside such a region, they print what was called and a backtrace to        */
+/* stderr and abort, so a hidden allocation or lock shows up the first time   */
+/* the path runs instead of as an occasional xrun under load. Link with       */
+/* -rdynamic to see function names in the backtrace.                          */
+/*                                                                            */
+/* Only calls made through the dynamic symbols are seen: the locks glibc      */
+/* takes inside stdio are not, but printf's first allocation of its buffer    */
+/* is.                                                                        */
+/******************************************************************************/
+
+#ifndef RT_CHECK_H
+#define RT_CHECK_H
+
+/* The calling thread enters a real-time region; regions may nest */
+void rt_check_enter(void);
+
+void rt_check_leave(void);
+
+/* Non-zero inside a real-time region */
+int rt_check_active(void);
+
+/* Non-zero if the tripwire is built in */
+int rt_check_enabled(void);
+
+#endif
@@ -0,0 +1,82 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Sample-accurate scheduling of note and parameter events                    */
+/******************************************************************************/
+
+#include "sched.h"
+
+/* Whether a comes out before b */
+static int before(const sched_event *a, const sched_event *b) {
+    return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+int sched_init(sched *s, unsigned long capacity) {
+    if (rt_arena_init(&s->arena, (capacity > 0 ? capacity : 1) * sizeof(*s->heap)) < 0)
+        return -1;
+    s->heap = rt_arena_alloc(&s->arena, (capacity > 0 ? capacity : 1) * sizeof(*s->heap));
+    s->count = 0;
+    s->capacity = capacity;
+    s->order = 0;
+    s->position = 0;
+    return 0;
+}
+
+void sched_free(sched *s) {
+    rt_arena_free(&s->arena);
+    s->heap = NULL;
+}
+
+int sched_post(sched *s, const sched_event *e) {
+    sched_event x = *e;
+    unsigned long i, parent;
+
+    if (s->count == s->capacity)
+        return -1;
+    x.order = s->order++;
+    /* Sift up: move the hole towards the root past every later parent */
+    for (i=s->count++; i>0; i=parent) {
+        parent = (i - 1) / 2;
+        if (!before(&x, &s->heap[parent]))
+            break;
+        s->heap[i] = s->heap[parent];
+    }
+    s->heap[i] = x;
+    return 0;
+}
+
+int sched_next(sched *s, sched_event *e) {
+    sched_event *last;
+    unsigned long i, child, n;
+
+    if (s->count == 0 || s->heap[0].time > s->position)
+        return 0;
+    *e = s->heap[0];
+    n = --s->count;
+    last = &s->heap[n];
+    /* Sift down: move the hole to the leaves past every earlier child */
+    for (i=0; (child = 2 * i + 1) < n; i=child) {
+        if (child + 1 < n && before(&s->heap[child + 1], &s->heap[child]))
+            child++;
+        if (!before(&s->heap[child], last))
+            break;
+        s->heap[i] = s->heap[child];
+    }
+    s->heap[i] = *last;
+    return 1;
+}
+
+unsigned long sched_run(const sched *s, unsigned long frames) {
+    unsigned long time;
+
+    if (s->count == 0)
+        return frames;
+    time = s->heap[0].time;
+    if (time <= s->position)
+        return frames > 0 ? 1 : 0;
+    return time - s->position < frames ? time - s->position : frames;
+}
+
+void sched_advance(sched *s, unsigned long frames) {
+    s->position += frames;
+}
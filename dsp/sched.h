@@ -0,0 +1,69 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Sample-accurate scheduling of note and parameter events                    */
+/*                                                                            */
+/* Events are stamped with the stream frame they happen on and kept in a      */
+/* binary min-heap, so they may be posted in any order: posting and taking    */
+/* the next event are O(log n), and finding when the next one is due is       */
+/* O(1). Events due on the same frame come out in the order they were posted. */
+/* The audio thread renders a block as in param.h: it takes the events that   */
+/* are due, asks sched_run() how many frames it can render before the next    */
+/* one, renders them and advances, so a block is split exactly where events   */
+/* land and every note starts on its frame.                                   */
+/*                                                                            */
+/* The heap is taken by sched_init() from an arena, resident before the audio */
+/* starts (rt_arena.h), and never grows: posting into a full scheduler fails  */
+/* instead of allocating, so everything can run in the audio callback. A      */
+/* scheduler belongs to one thread; events from another thread go through a   */
+/* queue first (spsc_ring.h, or param.h for parameters alone).                */
+/******************************************************************************/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "rt_arena.h"
+
+typedef enum {
+    SCHED_NOTE_ON,
+    SCHED_NOTE_OFF,
+    SCHED_PARAM
+} sched_type;
+
+typedef struct {
+    unsigned long time;         /* stream frame */
+    sched_type type;
+    unsigned int channel;       /* 0 to 15 for MIDI */
+    unsigned int key;           /* note: MIDI key number, param: its id */
+    float value;                /* note on: velocity 0 to 1, param: the value */
+    unsigned long order;        /* set by sched_post(), breaks ties in time */
+} sched_event;
+
+typedef struct {
+    sched_event *heap;          /* heap[0] is the next event */
+    unsigned long count;
+    unsigned long capacity;
+    unsigned long order;        /* events ever posted */
+    unsigned long position;     /* stream frame */
+    rt_arena arena;             /* the heap */
+} sched;
+
+/* Room for capacity events waiting at once, position 0. Returns 0, or -1. */
+int sched_init(sched *s, unsigned long capacity);
+
+void sched_free(sched *s);
+
+/* Post an event, O(log n). Returns 0, or -1 if the scheduler is full. */
+int sched_post(sched *s, const sched_event *e);
+
+/* Take the next event if it is due (its time is the position or past) into */
+/* e, O(log n). Returns 1, or 0 if no event is due.                          */
+int sched_next(sched *s, sched_event *e);
+
+/* How many of the next frames frames can be rendered before the next event */
+/* is due: frames if none is, at least 1. Take the due events first.          */
+unsigned long sched_run(const sched *s, unsigned long frames);
+
+void sched_advance(sched *s, unsigned long frames);
+
+#endif
@@ -0,0 +1,81 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Cost of scheduling an event (dsp/sched) with from 16 to 64k events         */
+/* waiting: each round posts an event at a random frame of the next second    */
+/* and takes the next one due, as a player feeding ahead of the audio thread  */
+/* does, and checks that events come out in time order.                       */
+/* Usage: sched_bench                                                         */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sched.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define MIN_SECONDS (0.2)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Next of a 64-bit linear congruential generator, top bits */
+static unsigned long next_random(unsigned long long *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned long) (*state >> 33);
+}
+
+/* ns per event posted and taken with waiting events pending, -1 if out of */
+/* order or out of memory                                                  */
+static double time_sched(unsigned long waiting) {
+    unsigned long long state = 1;
+    unsigned long rounds = 0, i, last = 0;
+    double start, elapsed;
+    sched_event e = { 0, SCHED_NOTE_ON, 0, 60, 1, 0 };
+    sched s;
+    int ordered = 1;
+
+    if (sched_init(&s, waiting + 1) < 0)
+        return -1;
+    for (i=0; i<waiting; i++) {
+        e.time = next_random(&state) % SAMPLE_RATE_IN_HZ;
+        sched_post(&s, &e);
+    }
+    start = now();
+    do {
+        for (i=0; i<1024; i++) {
+            e.time = s.position + next_random(&state) % SAMPLE_RATE_IN_HZ;
+            sched_post(&s, &e);
+            /* Jump to the next event, as rendering up to it would */
+            sched_advance(&s, sched_run(&s, SAMPLE_RATE_IN_HZ));
+            sched_next(&s, &e);
+            ordered &= e.time >= last;
+            last = e.time;
+        }
+        rounds += i;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    sched_free(&s);
+    return ordered ? elapsed * 1e9 / rounds : -1;
+}
+
+int main(void) {
+    static const unsigned long waiting[] = { 16, 256, 4096, 65536 };
+    unsigned int i;
+    double ns;
+
+    printf("Events posted and taken, one second of frames ahead\n");
+    printf("%10s %12s %16s\n", "waiting", "ns/event", "events/s of CPU");
+    for (i=0; i<sizeof(waiting)/sizeof(waiting[0]); i++) {
+        ns = time_sched(waiting[i]);
+        if (ns < 0) {
+            fprintf(stderr, "Events out of order, or not enough memory\n");
+            return 1;
+        }
+        printf("%10lu %12.1f %16.3g\n", waiting[i], ns, 1e9 / ns);
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Scalar sine kernel, phase ramps and runtime selection of the SIMD kernels  */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sine.h"
+#include "sine_impl.h"
+
+/* Reduce x to r in [-pi/4, pi/4] and the quadrant q, x = q*pi/2 + r */
+static inline float sine_reduce(float x, int *q) {
+    float qf = (x * SINE_2_OVER_PI + SINE_ROUND) - SINE_ROUND;
+    float r;
+
+    *q = (int)qf;
+    r = x - qf * SINE_PIO2_1;
+    r = r - qf * SINE_PIO2_2;
+    r = r - qf * SINE_PIO2_3;
+    return r;
+}
+
+static inline float sine_poly(float r, float z) {
+    float p = SINE_S3;
+    p = p * z + SINE_S2;
+    p = p * z + SINE_S1;
+    p = p * z;
+    p = p * r;
+    return p + r;
+}
+
+static inline float cosine_poly(float z) {
+    float p = SINE_C3;
+    p = p * z + SINE_C2;
+    p = p * z + SINE_C1;
+    p = p * z;
+    p = p * z;
+    p = p - 0.5f * z;
+    return p + 1.0f;
+}
+
+/* Pick the polynomial and sign for quadrant q */
+static inline float sine_quadrant(float s, float c, int q) {
+    float v = (q & 1) ? c : s;
+    return (q & 2) ? -v : v;
+}
+
+void sine_scalar(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    float r, z;
+    int q;
+
+    for (i=0; i<n; i++) {
+        r = sine_reduce(x[i], &q);
+        z = r * r;
+        y[i] = sine_quadrant(sine_poly(r, z), cosine_poly(z), q);
+    }
+}
+
+void cosine_scalar(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    float r, z;
+    int q;
+
+    for (i=0; i<n; i++) {
+        r = sine_reduce(x[i], &q);
+        z = r * r;
+        y[i] = sine_quadrant(sine_poly(r, z), cosine_poly(z), q + 1);
+    }
+}
+
+void sincos_scalar(const float *x, float *s, float *c, unsigned long n) {
+    unsigned long i;
+    float r, z, ps, pc;
+    int q;
+
+    for (i=0; i<n; i++) {
+        r = sine_reduce(x[i], &q);
+        z = r * r;
+        ps = sine_poly(r, z);
+        pc = cosine_poly(z);
+        s[i] = sine_quadrant(ps, pc, q);
+        c[i] = sine_quadrant(ps, pc, q + 1);
+    }
+}
+
+double sine_phase_ramp(float *x, double phase, double step, unsigned long n) {
+    unsigned long i;
+
+    for (i=0; i<n; i++)
+        x[i] = (float)(phase + step * i);
+    phase = fmod(phase + step * n, 2 * M_PI);
+    if (phase < 0)
+        phase += 2 * M_PI;
+    return phase;
+}
+
+/* Kernel table and runtime dispatch */
+
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    sine_fn sin;
+    sine_fn cos;
+    sincos_fn sincos;
+} sine_kernel;
+
+static int always(void) {
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static int has_sse2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static int has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static int has_avx512(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+/* In order of preference */
+static const sine_kernel kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx512", has_avx512, sine_avx512, cosine_avx512, sincos_avx512 },
+    { "avx2", has_avx2, sine_avx2, cosine_avx2, sincos_avx2 },
+    { "sse2", has_sse2, sine_sse2, cosine_sse2, sincos_sse2 },
+#endif
+    { "scalar", always, sine_scalar, cosine_scalar, sincos_scalar }
+};
+
+#define NB_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const sine_kernel *current_kernel;
+
+int sine_kernel_select(const char *name) {
+    unsigned int i;
+
+    for (i=0; i<NB_KERNELS; i++) {
+        if (name != NULL && strcmp(name, kernels[i].name) != 0)
+            continue;
+        if (!kernels[i].supported()) {
+            if (name != NULL)
+                return -1;
+            continue;
+        }
+        __atomic_store_n(&current_kernel, &kernels[i], __ATOMIC_RELEASE);
+        return 0;
+    }
+    return -1;
+}
+
+static const sine_kernel *sine_kernel_get(void) {
+    const sine_kernel *k = __atomic_load_n(&current_kernel, __ATOMIC_ACQUIRE);
+
+    if (k == NULL) {
+        if (sine_kernel_select(getenv("DSP_SINE_KERNEL")) < 0)
+            sine_kernel_select(NULL);
+        k = __atomic_load_n(&current_kernel, __ATOMIC_ACQUIRE);
+    }
+    return k;
+}
+
+const char *sine_kernel_name(void) {
+    return sine_kernel_get()->name;
+}
+
+void sine_block(const float *x, float *y, unsigned long n) {
+    sine_kernel_get()->sin(x, y, n);
+}
+
+void cosine_block(const float *x, float *y, unsigned long n) {
+    sine_kernel_get()->cos(x, y, n);
+}
+
+void sincos_block(const float *x, float *s, float *c, unsigned long n) {
+    sine_kernel_get()->sincos(x, s, c, n);
+}
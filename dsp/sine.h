@@ -0,0 +1,56 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Block sine/cosine kernels with runtime CPU dispatch                        */
+/*                                                                            */
+/* All kernels evaluate the same single precision algorithm: reduction by     */
+/* pi/2 in three parts (Cody-Waite) followed by degree 7/8 minimax            */
+/* polynomials on [-pi/4, pi/4]. The SSE2, AVX2 and AVX-512 paths perform     */
+/* exactly the same operations as the scalar fallback (no FMA contraction),   */
+/* so every path returns bit-identical results.                               */
+/*                                                                            */
+/* Error bounds against double precision sin()/cos(), exhaustive over all     */
+/* floats for the first range and sampled for the others:                     */
+/*   |x| <= 2*pi      max absolute error 7.0e-8 (sin), 7.8e-8 (cos)           */
+/*   |x| <= 8192      max absolute error 7.9e-8                               */
+/*   |x| <= 65536     max absolute error 9.6e-7                               */
+/* Past that the reduction loses accuracy quickly (3e-2 at 1e6), and inputs   */
+/* beyond 2^22 * pi/2 are outside the domain and return garbage.              */
+/* Oscillators should keep their phase wrapped, see sine_phase_ramp().        */
+/******************************************************************************/
+
+#ifndef SINE_H
+#define SINE_H
+
+/* y[i] = sin(x[i]), y may alias x */
+void sine_block(const float *x, float *y, unsigned long n);
+
+/* y[i] = cos(x[i]), y may alias x */
+void cosine_block(const float *x, float *y, unsigned long n);
+
+/* s[i] = sin(x[i]), c[i] = cos(x[i]), either output may alias x */
+void sincos_block(const float *x, float *s, float *c, unsigned long n);
+
+/******************************************************************************/
+/* sine_phase_ramp: fill x with the phases of an oscillator, n samples long   */
+/* phase: starting phase in radians                                           */
+/* step: phase increment per sample in radians                                */
+/* Returns the phase following the block, wrapped to [0, 2*pi). Wrapping is   */
+/* done once per block, so no per-sample compare is needed.                   */
+/******************************************************************************/
+
+double sine_phase_ramp(float *x, double phase, double step, unsigned long n);
+
+/* Name of the kernel in use: "scalar", "sse2", "avx2" or "avx512" */
+const char *sine_kernel_name(void);
+
+/******************************************************************************/
+/* sine_kernel_select: force a kernel by name, or pick the best one the CPU   */
+/* supports when name is NULL. Returns 0 on success, -1 if the kernel is      */
+/* unknown or not supported. The DSP_SINE_KERNEL environment variable forces  */
+/* a kernel the same way on first use.                                        */
+/******************************************************************************/
+
+int sine_kernel_select(const char *name);
+
+#endif
@@ -0,0 +1,94 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* AVX2 sine kernel, 8 samples per iteration. Built with -mavx2.              */
+/******************************************************************************/
+
+#include "sine_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+static inline __m256 sine_reduce_avx2(__m256 x, __m256i *q) {
+    __m256 qf = _mm256_mul_ps(x, _mm256_set1_ps(SINE_2_OVER_PI));
+    __m256 r;
+
+    qf = _mm256_sub_ps(_mm256_add_ps(qf, _mm256_set1_ps(SINE_ROUND)), _mm256_set1_ps(SINE_ROUND));
+    *q = _mm256_cvttps_epi32(qf);
+    r = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(SINE_PIO2_1)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(SINE_PIO2_2)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(SINE_PIO2_3)));
+    return r;
+}
+
+static inline __m256 sine_poly_avx2(__m256 r, __m256 z) {
+    __m256 p = _mm256_set1_ps(SINE_S3);
+    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(SINE_S2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(SINE_S1));
+    p = _mm256_mul_ps(p, z);
+    p = _mm256_mul_ps(p, r);
+    return _mm256_add_ps(p, r);
+}
+
+static inline __m256 cosine_poly_avx2(__m256 z) {
+    __m256 p = _mm256_set1_ps(SINE_C3);
+    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(SINE_C2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z), _mm256_set1_ps(SINE_C1));
+    p = _mm256_mul_ps(p, z);
+    p = _mm256_mul_ps(p, z);
+    p = _mm256_sub_ps(p, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+    return _mm256_add_ps(p, _mm256_set1_ps(1.0f));
+}
+
+static inline __m256 sine_quadrant_avx2(__m256 s, __m256 c, __m256i q) {
+    __m256i one = _mm256_set1_epi32(1);
+    __m256 odd = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+    __m256 v = _mm256_blendv_ps(s, c, odd);
+    __m256i sign = _mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30);
+    return _mm256_xor_ps(v, _mm256_castsi256_ps(sign));
+}
+
+void sine_avx2(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    __m256 r, z;
+    __m256i q;
+
+    for (i=0; i+8<=n; i+=8) {
+        r = sine_reduce_avx2(_mm256_loadu_ps(x + i), &q);
+        z = _mm256_mul_ps(r, r);
+        _mm256_storeu_ps(y + i, sine_quadrant_avx2(sine_poly_avx2(r, z), cosine_poly_avx2(z), q));
+    }
+    sine_scalar(x + i, y + i, n - i);
+}
+
+void cosine_avx2(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    __m256 r, z;
+    __m256i q;
+
+    for (i=0; i+8<=n; i+=8) {
+        r = sine_reduce_avx2(_mm256_loadu_ps(x + i), &q);
+        z = _mm256_mul_ps(r, r);
+        q = _mm256_add_epi32(q, _mm256_set1_epi32(1));
+        _mm256_storeu_ps(y + i, sine_quadrant_avx2(sine_poly_avx2(r, z), cosine_poly_avx2(z), q));
+    }
+    cosine_scalar(x + i, y + i, n - i);
+}
+
+void sincos_avx2(const float *x, float *s, float *c, unsigned long n) {
+    unsigned long i;
+    __m256 r, z, ps, pc;
+    __m256i q;
+
+    for (i=0; i+8<=n; i+=8) {
+        r = sine_reduce_avx2(_mm256_loadu_ps(x + i), &q);
+        z = _mm256_mul_ps(r, r);
+        ps = sine_poly_avx2(r, z);
+        pc = cosine_poly_avx2(z);
+        _mm256_storeu_ps(s + i, sine_quadrant_avx2(ps, pc, q));
+        _mm256_storeu_ps(c + i, sine_quadrant_avx2(ps, pc, _mm256_add_epi32(q, _mm256_set1_epi32(1))));
+    }
+    sincos_scalar(x + i, s + i, c + i, n - i);
+}
+
+#endif
@@ -0,0 +1,94 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* AVX-512 sine kernel, 16 samples per iteration. Built with -mavx512f.       */
+/******************************************************************************/
+
+#include "sine_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+static inline __m512 sine_reduce_avx512(__m512 x, __m512i *q) {
+    __m512 qf = _mm512_mul_ps(x, _mm512_set1_ps(SINE_2_OVER_PI));
+    __m512 r;
+
+    qf = _mm512_sub_ps(_mm512_add_ps(qf, _mm512_set1_ps(SINE_ROUND)), _mm512_set1_ps(SINE_ROUND));
+    *q = _mm512_cvttps_epi32(qf);
+    r = _mm512_sub_ps(x, _mm512_mul_ps(qf, _mm512_set1_ps(SINE_PIO2_1)));
+    r = _mm512_sub_ps(r, _mm512_mul_ps(qf, _mm512_set1_ps(SINE_PIO2_2)));
+    r = _mm512_sub_ps(r, _mm512_mul_ps(qf, _mm512_set1_ps(SINE_PIO2_3)));
+    return r;
+}
+
+static inline __m512 sine_poly_avx512(__m512 r, __m512 z) {
+    __m512 p = _mm512_set1_ps(SINE_S3);
+    p = _mm512_add_ps(_mm512_mul_ps(p, z), _mm512_set1_ps(SINE_S2));
+    p = _mm512_add_ps(_mm512_mul_ps(p, z), _mm512_set1_ps(SINE_S1));
+    p = _mm512_mul_ps(p, z);
+    p = _mm512_mul_ps(p, r);
+    return _mm512_add_ps(p, r);
+}
+
+static inline __m512 cosine_poly_avx512(__m512 z) {
+    __m512 p = _mm512_set1_ps(SINE_C3);
+    p = _mm512_add_ps(_mm512_mul_ps(p, z), _mm512_set1_ps(SINE_C2));
+    p = _mm512_add_ps(_mm512_mul_ps(p, z), _mm512_set1_ps(SINE_C1));
+    p = _mm512_mul_ps(p, z);
+    p = _mm512_mul_ps(p, z);
+    p = _mm512_sub_ps(p, _mm512_mul_ps(_mm512_set1_ps(0.5f), z));
+    return _mm512_add_ps(p, _mm512_set1_ps(1.0f));
+}
+
+static inline __m512 sine_quadrant_avx512(__m512 s, __m512 c, __m512i q) {
+    __mmask16 odd = _mm512_test_epi32_mask(q, _mm512_set1_epi32(1));
+    __m512 v = _mm512_mask_blend_ps(odd, s, c);
+    __m512i sign = _mm512_slli_epi32(_mm512_and_si512(q, _mm512_set1_epi32(2)), 30);
+    /* _mm512_xor_ps needs AVX512DQ, stay on AVX512F integer ops */
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), sign));
+}
+
+void sine_avx512(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    __m512 r, z;
+    __m512i q;
+
+    for (i=0; i+16<=n; i+=16) {
+        r = sine_reduce_avx512(_mm512_loadu_ps(x + i), &q);
+        z = _mm512_mul_ps(r, r);
+        _mm512_storeu_ps(y + i, sine_quadrant_avx512(sine_poly_avx512(r, z), cosine_poly_avx512(z), q));
+    }
+    sine_scalar(x + i, y + i, n - i);
+}
+
+void cosine_avx512(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    __m512 r, z;
+    __m512i q;
+
+    for (i=0; i+16<=n; i+=16) {
+        r = sine_reduce_avx512(_mm512_loadu_ps(x + i), &q);
+        z = _mm512_mul_ps(r, r);
+        q = _mm512_add_epi32(q, _mm512_set1_epi32(1));
+        _mm512_storeu_ps(y + i, sine_quadrant_avx512(sine_poly_avx512(r, z), cosine_poly_avx512(z), q));
+    }
+    cosine_scalar(x + i, y + i, n - i);
+}
+
+void sincos_avx512(const float *x, float *s, float *c, unsigned long n) {
+    unsigned long i;
+    __m512 r, z, ps, pc;
+    __m512i q;
+
+    for (i=0; i+16<=n; i+=16) {
+        r = sine_reduce_avx512(_mm512_loadu_ps(x + i), &q);
+        z = _mm512_mul_ps(r, r);
+        ps = sine_poly_avx512(r, z);
+        pc = cosine_poly_avx512(z);
+        _mm512_storeu_ps(s + i, sine_quadrant_avx512(ps, pc, q));
+        _mm512_storeu_ps(c + i, sine_quadrant_avx512(ps, pc, _mm512_add_epi32(q, _mm512_set1_epi32(1))));
+    }
+    sincos_scalar(x + i, s + i, c + i, n - i);
+}
+
+#endif
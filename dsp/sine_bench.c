@@ -0,0 +1,122 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Compares the block sine kernels with libm, in ns per sample, and checks    */
+/* their maximum error against double precision sin().                        */
+/* Usage: sine_bench [block_size]                                             */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "sine.h"
+
+#define MAX_BLOCK (4096)
+#define MIN_SECONDS (0.2)
+
+static float x[MAX_BLOCK];
+static float y[MAX_BLOCK];
+static double yd[MAX_BLOCK];
+static volatile float sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void libm_sin(unsigned long n) {
+    unsigned long i;
+    for (i=0; i<n; i++)
+        yd[i] = sin(x[i]);
+    sink = yd[n-1];
+}
+
+static void libm_sinf(unsigned long n) {
+    unsigned long i;
+    for (i=0; i<n; i++)
+        y[i] = sinf(x[i]);
+    sink = y[n-1];
+}
+
+static void kernel(unsigned long n) {
+    sine_block(x, y, n);
+    sink = y[n-1];
+}
+
+/* Run fn on blocks of n samples for at least MIN_SECONDS, return ns/sample */
+static double time_it(void (*fn)(unsigned long), unsigned long n) {
+    double start, elapsed;
+    unsigned long blocks = 0, batch = 1;
+    unsigned long i;
+
+    fn(n); /* warm up */
+    start = now();
+    do {
+        for (i=0; i<batch; i++)
+            fn(n);
+        blocks += batch;
+        batch *= 2;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    return elapsed * 1e9 / ((double)blocks * n);
+}
+
+static double max_error(double range) {
+    double err, max = 0;
+    unsigned long i, j;
+
+    for (j=0; j<256; j++) {
+        for (i=0; i<MAX_BLOCK; i++)
+            x[i] = (float)(range * (2.0 * rand() / RAND_MAX - 1.0));
+        sine_block(x, y, MAX_BLOCK);
+        for (i=0; i<MAX_BLOCK; i++) {
+            err = fabs(y[i] - sin((double)x[i]));
+            if (err > max)
+                max = err;
+        }
+    }
+    return max;
+}
+
+int main(int argc, char *argv[]) {
+    static const char *names[] = { "scalar", "sse2", "avx2", "avx512" };
+    unsigned long i, n = 1024;
+    unsigned int k;
+    double libm_ns, ns;
+
+    if (argc == 2)
+        n = atoi(argv[1]);
+    if (n < 1 || n > MAX_BLOCK) {
+        fprintf(stderr, "Block size must be between 1 and %d\n", MAX_BLOCK);
+        return 1;
+    }
+
+    for (i=0; i<n; i++)
+        x[i] = (float)(2 * M_PI * rand() / RAND_MAX);
+
+    printf("Block size %lu\n", n);
+    printf("%-10s %10s %10s %12s %12s\n", "kernel", "ns/sample", "vs sin()", "err 2*pi", "err 8192");
+    libm_ns = time_it(libm_sin, n);
+    printf("%-10s %10.3f %9.2fx\n", "libm sin", libm_ns, 1.0);
+    ns = time_it(libm_sinf, n);
+    printf("%-10s %10.3f %9.2fx\n", "libm sinf", ns, libm_ns / ns);
+
+    for (k=0; k<sizeof(names)/sizeof(names[0]); k++) {
+        double err_2pi, err_8192;
+
+        if (sine_kernel_select(names[k]) < 0) {
+            printf("%-10s %10s\n", names[k], "n/a");
+            continue;
+        }
+        for (i=0; i<n; i++)
+            x[i] = (float)(2 * M_PI * rand() / RAND_MAX);
+        ns = time_it(kernel, n);
+        err_2pi = max_error(2 * M_PI);
+        err_8192 = max_error(8192);
+        printf("%-10s %10.3f %9.2fx %12.3g %12.3g\n", names[k], ns, libm_ns / ns,
+               err_2pi, err_8192);
+    }
+    return 0;
+}
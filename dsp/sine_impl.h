@@ -0,0 +1,46 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Constants and per-ISA entry points shared by the sine kernels. Each        */
+/* implementation must evaluate the expressions in the order given in         */
+/* sine.c so that all kernels agree bit for bit.                              */
+/******************************************************************************/
+
+#ifndef SINE_IMPL_H
+#define SINE_IMPL_H
+
+#define SINE_2_OVER_PI  0.636619772367581343f
+/* pi/2 split in three parts, the first two exact when multiplied by q */
+#define SINE_PIO2_1     1.5703125f
+#define SINE_PIO2_2     4.83751296997070312e-4f
+#define SINE_PIO2_3     7.54978995489188216e-8f
+/* Adding and subtracting 1.5 * 2^23 rounds to the nearest integer */
+#define SINE_ROUND      12582912.0f
+
+#define SINE_S1 -1.6666654611e-1f
+#define SINE_S2  8.3321608736e-3f
+#define SINE_S3 -1.9515295891e-4f
+#define SINE_C1  4.166664568298827e-2f
+#define SINE_C2 -1.388731625493765e-3f
+#define SINE_C3  2.443315711809948e-5f
+
+typedef void (*sine_fn)(const float *x, float *y, unsigned long n);
+typedef void (*sincos_fn)(const float *x, float *s, float *c, unsigned long n);
+
+void sine_scalar(const float *x, float *y, unsigned long n);
+void cosine_scalar(const float *x, float *y, unsigned long n);
+void sincos_scalar(const float *x, float *s, float *c, unsigned long n);
+
+#if defined(__x86_64__) || defined(__i386__)
+void sine_sse2(const float *x, float *y, unsigned long n);
+void cosine_sse2(const float *x, float *y, unsigned long n);
+void sincos_sse2(const float *x, float *s, float *c, unsigned long n);
+void sine_avx2(const float *x, float *y, unsigned long n);
+void cosine_avx2(const float *x, float *y, unsigned long n);
+void sincos_avx2(const float *x, float *s, float *c, unsigned long n);
+void sine_avx512(const float *x, float *y, unsigned long n);
+void cosine_avx512(const float *x, float *y, unsigned long n);
+void sincos_avx512(const float *x, float *s, float *c, unsigned long n);
+#endif
+
+#endif
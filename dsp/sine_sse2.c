@@ -0,0 +1,94 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* SSE2 sine kernel, 4 samples per iteration. Built with -msse2.              */
+/******************************************************************************/
+
+#include "sine_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+
+static inline __m128 sine_reduce_sse2(__m128 x, __m128i *q) {
+    __m128 qf = _mm_mul_ps(x, _mm_set1_ps(SINE_2_OVER_PI));
+    __m128 r;
+
+    qf = _mm_sub_ps(_mm_add_ps(qf, _mm_set1_ps(SINE_ROUND)), _mm_set1_ps(SINE_ROUND));
+    *q = _mm_cvttps_epi32(qf);
+    r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(SINE_PIO2_1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(SINE_PIO2_2)));
+    r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(SINE_PIO2_3)));
+    return r;
+}
+
+static inline __m128 sine_poly_sse2(__m128 r, __m128 z) {
+    __m128 p = _mm_set1_ps(SINE_S3);
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(SINE_S2));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(SINE_S1));
+    p = _mm_mul_ps(p, z);
+    p = _mm_mul_ps(p, r);
+    return _mm_add_ps(p, r);
+}
+
+static inline __m128 cosine_poly_sse2(__m128 z) {
+    __m128 p = _mm_set1_ps(SINE_C3);
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(SINE_C2));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(SINE_C1));
+    p = _mm_mul_ps(p, z);
+    p = _mm_mul_ps(p, z);
+    p = _mm_sub_ps(p, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    return _mm_add_ps(p, _mm_set1_ps(1.0f));
+}
+
+static inline __m128 sine_quadrant_sse2(__m128 s, __m128 c, __m128i q) {
+    __m128i one = _mm_set1_epi32(1);
+    __m128 odd = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    __m128 v = _mm_or_ps(_mm_and_ps(odd, c), _mm_andnot_ps(odd, s));
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30);
+    return _mm_xor_ps(v, _mm_castsi128_ps(sign));
+}
+
+void sine_sse2(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    __m128 r, z;
+    __m128i q;
+
+    for (i=0; i+4<=n; i+=4) {
+        r = sine_reduce_sse2(_mm_loadu_ps(x + i), &q);
+        z = _mm_mul_ps(r, r);
+        _mm_storeu_ps(y + i, sine_quadrant_sse2(sine_poly_sse2(r, z), cosine_poly_sse2(z), q));
+    }
+    sine_scalar(x + i, y + i, n - i);
+}
+
+void cosine_sse2(const float *x, float *y, unsigned long n) {
+    unsigned long i;
+    __m128 r, z;
+    __m128i q;
+
+    for (i=0; i+4<=n; i+=4) {
+        r = sine_reduce_sse2(_mm_loadu_ps(x + i), &q);
+        z = _mm_mul_ps(r, r);
+        q = _mm_add_epi32(q, _mm_set1_epi32(1));
+        _mm_storeu_ps(y + i, sine_quadrant_sse2(sine_poly_sse2(r, z), cosine_poly_sse2(z), q));
+    }
+    cosine_scalar(x + i, y + i, n - i);
+}
+
+void sincos_sse2(const float *x, float *s, float *c, unsigned long n) {
+    unsigned long i;
+    __m128 r, z, ps, pc;
+    __m128i q;
+
+    for (i=0; i+4<=n; i+=4) {
+        r = sine_reduce_sse2(_mm_loadu_ps(x + i), &q);
+        z = _mm_mul_ps(r, r);
+        ps = sine_poly_sse2(r, z);
+        pc = cosine_poly_sse2(z);
+        _mm_storeu_ps(s + i, sine_quadrant_sse2(ps, pc, q));
+        _mm_storeu_ps(c + i, sine_quadrant_sse2(ps, pc, _mm_add_epi32(q, _mm_set1_epi32(1))));
+    }
+    sincos_scalar(x + i, s + i, c + i, n - i);
+}
+
+#endif
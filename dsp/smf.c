@@ -0,0 +1,350 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Standard MIDI Files, loaded as scheduler events                            */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "smf.h"
+
+#define DEFAULT_TEMPO (500000) /* microseconds per quarter note, 120 bpm */
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+} reader;
+
+typedef struct {
+    unsigned long tick;
+    unsigned long order;        /* read before: ties go to the last one read */
+    double tempo;               /* seconds per tick from here */
+    double seconds;             /* at tick, filled once sorted */
+} tempo_change;
+
+/* What the first pass finds, to size the second */
+typedef struct {
+    unsigned long events;
+    unsigned long tempos;
+} counts;
+
+static unsigned long big_endian(const unsigned char *p, unsigned int bytes) {
+    unsigned long x = 0;
+
+    while (bytes-- > 0)
+        x = x << 8 | *p++;
+    return x;
+}
+
+/* Variable-length quantity: 7 bits per byte, most significant first */
+static int read_vlq(reader *r, unsigned long *x) {
+    unsigned int i;
+
+    *x = 0;
+    for (i=0; i<4 && r->p < r->end; i++) {
+        *x = *x << 7 | (*r->p & 0x7f);
+        if ((*r->p++ & 0x80) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+/******************************************************************************/
+/* Read the events of a track. Counts them into n, and when events is not     */
+/* NULL also stores them there, stamped in ticks, and the tempo changes into  */
+/* tempos. end: tick of the end of the track. Returns 0, or -1 if truncated.  */
+/******************************************************************************/
+
+static int read_track(reader r, counts *n, sched_event *events, tempo_change *tempos,
+                      unsigned long *end) {
+    unsigned long tick = 0, delta, length;
+    unsigned int status = 0, type, data[2];
+    sched_event *e;
+
+    while (r.p < r.end) {
+        if (read_vlq(&r, &delta) < 0 || r.p == r.end)
+            return -1;
+        tick += delta;
+        if (*r.p >= 0x80)
+            status = *r.p++;
+        else if (status == 0)
+            return -1;                  /* running status with nothing to run */
+        if (status == 0xff || status == 0xf0 || status == 0xf7) {
+            /* Meta and system exclusive events, which cancel running status */
+            type = status == 0xff && r.p < r.end ? *r.p++ : 0;
+            if (read_vlq(&r, &length) < 0 || length > (unsigned long)(r.end - r.p))
+                return -1;
+            if (status == 0xff && type == 0x51 && length == 3) {
+                if (tempos != NULL) {
+                    tempos[n->tempos].tick = tick;
+                    tempos[n->tempos].order = n->tempos;
+                    tempos[n->tempos].tempo = big_endian(r.p, 3) * 1e-6;
+                }
+                n->tempos++;
+            }
+            r.p += length;
+            status = 0;
+            if (type == 0x2f)
+                break;                  /* end of track */
+            continue;
+        }
+        if (status >= 0xf0)
+            return -1;                  /* system common messages never appear */
+        data[1] = 0;
+        if (r.end - r.p < ((status & 0xe0) == 0xc0 ? 1 : 2))
+            return -1;
+        data[0] = *r.p++ & 0x7f;
+        if ((status & 0xe0) != 0xc0)
+            data[1] = *r.p++ & 0x7f;
+        type = status & 0xf0;
+        if (type != 0x80 && type != 0x90 && type != 0xb0)
+            continue;                   /* aftertouch, programs, pitch bend */
+        if (events != NULL) {
+            e = &events[n->events];
+            e->time = tick;
+            e->channel = status & 0x0f;
+            e->key = data[0];
+            e->value = data[1] / 127.0f;
+            e->order = 0;
+            if (type == 0xb0)
+                e->type = SCHED_PARAM;
+            else if (type == 0x90 && data[1] > 0)
+                e->type = SCHED_NOTE_ON;
+            else
+                e->type = SCHED_NOTE_OFF;
+        }
+        n->events++;
+    }
+    *end = tick;
+    return 0;
+}
+
+static int tempo_compare(const void *a, const void *b) {
+    const tempo_change *x = a, *y = b;
+
+    if (x->tick != y->tick)
+        return x->tick < y->tick ? -1 : 1;
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+/* Frame of tick, through the tempo map: map[0] is at tick 0 */
+static unsigned long frame_of(const tempo_change *map, unsigned long count,
+                              unsigned long tick, double sample_rate) {
+    unsigned long low = 0, high = count, middle;
+
+    /* Last change at or before tick */
+    while (high - low > 1) {
+        middle = low + (high - low) / 2;
+        if (map[middle].tick <= tick)
+            low = middle;
+        else
+            high = middle;
+    }
+    return (unsigned long) llround((map[low].seconds +
+                                    (tick - map[low].tick) * map[low].tempo) * sample_rate);
+}
+
+/* The whole file, NULL after saying why */
+static unsigned char *read_file(const char *path, size_t *size) {
+    unsigned char *data = NULL, *bigger;
+    size_t capacity = 0, n;
+    FILE *file;
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    *size = 0;
+    do {
+        if (*size == capacity) {
+            capacity = capacity > 0 ? 2 * capacity : 65536;
+            if ((bigger = realloc(data, capacity)) == NULL) {
+                fprintf(stderr, "Not enough memory\n");
+                free(data);
+                fclose(file);
+                return NULL;
+            }
+            data = bigger;
+        }
+        n = fread(data + *size, 1, capacity - *size, file);
+        *size += n;
+    } while (n > 0);
+    if (ferror(file)) {
+        fprintf(stderr, "Error reading %s: %s\n", path, strerror(errno));
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+int smf_load(smf *m, const char *path, double sample_rate) {
+    unsigned char *data;
+    const unsigned char *p, *end;
+    size_t size;
+    unsigned long length, division, i, t, track_end, nb_map, *ends = NULL;
+    unsigned int nb_tracks = 0, declared;
+    tempo_change *map = NULL;
+    sched_event *events;
+    counts total = {0, 0}, n;
+    reader r;
+    double tick_seconds;
+
+    m->memory = NULL;
+    if ((data = read_file(path, &size)) == NULL)
+        return -1;
+    end = data + size;
+    if (size < 14 || memcmp(data, "MThd", 4) != 0 || (length = big_endian(data + 4, 4)) < 6 ||
+        length > size - 8) {
+        fprintf(stderr, "%s is not a MIDI file\n", path);
+        free(data);
+        return -1;
+    }
+    m->format = big_endian(data + 8, 2);
+    declared = big_endian(data + 10, 2);
+    division = big_endian(data + 12, 2);
+    if (m->format > 1 || (division & 0x8000 ? division & 0xff : division) == 0) {
+        fprintf(stderr, "%s: format %u or division 0x%04lx not supported\n", path,
+                m->format, division);
+        free(data);
+        return -1;
+    }
+    if (division & 0x8000) {
+        /* SMPTE: minus the frames per second (29 is 30 drop-frame, 29.97) */
+        /* and the ticks per frame                                          */
+        tick_seconds = 1.0 / ((256 - (division >> 8)) * (division & 0xff));
+        if ((division >> 8) == 256 - 29)
+            tick_seconds = 1.001 / (30 * (division & 0xff));
+    } else {
+        tick_seconds = DEFAULT_TEMPO * 1e-6 / division;
+    }
+
+    /* First pass: count the tracks, events and tempo changes */
+    for (p=data + 8 + length; end - p >= 8 && nb_tracks < declared; p += 8 + length) {
+        length = big_endian(p + 4, 4);
+        if (length > (unsigned long)(end - p - 8))
+            length = end - p - 8;       /* truncated: read_track() says so */
+        if (memcmp(p, "MTrk", 4) != 0)
+            continue;                   /* chunks of other kinds are skipped */
+        r.p = p + 8;
+        r.end = p + 8 + length;
+        if (read_track(r, &total, NULL, NULL, &track_end) < 0) {
+            fprintf(stderr, "%s: track %u is truncated\n", path, nb_tracks);
+            free(data);
+            return -1;
+        }
+        nb_tracks++;
+    }
+
+    /* Tracks then events in one block, the map and track ends only while loading */
+    m->memory = malloc(nb_tracks * sizeof(smf_track) + total.events * sizeof(sched_event) + 1);
+    map = malloc((total.tempos + 1) * sizeof(*map));
+    ends = malloc((nb_tracks + 1) * sizeof(*ends));
+    if (m->memory == NULL || map == NULL || ends == NULL) {
+        fprintf(stderr, "Not enough memory\n");
+        free(m->memory);
+        free(map);
+        free(ends);
+        free(data);
+        return -1;
+    }
+    m->tracks = m->memory;
+    events = (sched_event *) (m->tracks + nb_tracks);
+    m->nb_tracks = nb_tracks;
+
+    /* Second pass: the events in ticks, and the tempo changes after the */
+    /* initial tempo                                                      */
+    map[0].tick = 0;
+    map[0].order = 0;
+    map[0].tempo = tick_seconds;
+    n.tempos = 0;
+    for (p=data + 8 + big_endian(data + 4, 4), t=0; t < nb_tracks; p += 8 + length) {
+        length = big_endian(p + 4, 4);
+        if (length > (unsigned long)(end - p - 8))
+            length = end - p - 8;
+        if (memcmp(p, "MTrk", 4) != 0)
+            continue;
+        r.p = p + 8;
+        r.end = p + 8 + length;
+        n.events = 0;
+        read_track(r, &n, events, map + 1, &ends[t]);
+        m->tracks[t].events = events;
+        m->tracks[t].count = n.events;
+        events += n.events;
+        t++;
+    }
+    free(data);
+
+    /* The tempo map, sorted across tracks; SMPTE time has no tempo */
+    nb_map = 1;
+    if (!(division & 0x8000)) {
+        nb_map += total.tempos;
+        for (i=1; i<nb_map; i++)
+            map[i].tempo /= division;
+        qsort(map + 1, total.tempos, sizeof(*map), tempo_compare);
+    }
+    map[0].seconds = 0;
+    for (i=1; i<nb_map; i++)
+        map[i].seconds = map[i - 1].seconds +
+                         (map[i].tick - map[i - 1].tick) * map[i - 1].tempo;
+
+    /* Ticks to frames, the end of the file being the end of the last track */
+    m->notes = 0;
+    m->length = 0;
+    for (t=0; t<nb_tracks; t++) {
+        for (i=0; i<m->tracks[t].count; i++) {
+            events = &m->tracks[t].events[i];
+            events->time = frame_of(map, nb_map, events->time, sample_rate);
+            if (events->type == SCHED_NOTE_ON)
+                m->notes++;
+        }
+        track_end = frame_of(map, nb_map, ends[t], sample_rate);
+        if (track_end > m->length)
+            m->length = track_end;
+    }
+    free(map);
+    free(ends);
+    smf_rewind(m);
+    return 0;
+}
+
+void smf_free(smf *m) {
+    free(m->memory);
+    m->memory = NULL;
+    m->tracks = NULL;
+}
+
+void smf_rewind(smf *m) {
+    unsigned int t;
+
+    for (t=0; t<m->nb_tracks; t++)
+        m->tracks[t].next = 0;
+}
+
+int smf_feed(smf *m, sched *s, unsigned long until) {
+    smf_track *track;
+    unsigned int t;
+
+    for (t=0; t<m->nb_tracks; t++) {
+        track = &m->tracks[t];
+        while (track->next < track->count && track->events[track->next].time < until) {
+            if (sched_post(s, &track->events[track->next]) < 0)
+                return -1;
+            track->next++;
+        }
+    }
+    return 0;
+}
+
+int smf_done(const smf *m) {
+    unsigned int t;
+
+    for (t=0; t<m->nb_tracks; t++)
+        if (m->tracks[t].next < m->tracks[t].count)
+            return 0;
+    return 1;
+}
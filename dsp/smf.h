@@ -0,0 +1,59 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Standard MIDI Files, loaded as scheduler events                            */
+/*                                                                            */
+/* smf_load() reads a format 0 or 1 file and converts every track into        */
+/* sched.h events stamped in frames: the tempo changes of all tracks make one */
+/* tempo map, and each event's time in ticks goes through it once, in         */
+/* double precision from the start of the file, so timing does not drift      */
+/* however long the file plays. Note ons of velocity 0 are note offs, and     */
+/* control changes are parameters of their channel, the controller number     */
+/* as id and the value scaled to [0, 1]. Other messages are skipped.          */
+/*                                                                            */
+/* Playing feeds a scheduler a block ahead at a time: smf_feed() posts what   */
+/* is due before a frame from each track in turn, and the scheduler merges    */
+/* the tracks, so it only ever holds about one block of events.               */
+/******************************************************************************/
+
+#ifndef SMF_H
+#define SMF_H
+
+#include "sched.h"
+
+typedef struct {
+    sched_event *events;        /* in time order */
+    unsigned long count;
+    unsigned long next;         /* first event not posted yet */
+} smf_track;
+
+typedef struct {
+    unsigned int format;        /* 0: one track, 1: simultaneous tracks */
+    unsigned int nb_tracks;
+    smf_track *tracks;
+    unsigned long notes;        /* note ons in all tracks */
+    unsigned long length;       /* frame of the last event, end of track included */
+    void *memory;
+} smf;
+
+/* Load path at sample_rate frames per second. Returns 0, or -1 after */
+/* saying why.                                                         */
+int smf_load(smf *m, const char *path, double sample_rate);
+
+void smf_free(smf *m);
+
+/* Play again from the start */
+void smf_rewind(smf *m);
+
+/******************************************************************************/
+/* smf_feed: post the events due before frame until into s                    */
+/* Returns 0, or -1 if s is full, in which case the events left are posted by */
+/* the next call (late, if they were due by then).                            */
+/******************************************************************************/
+
+int smf_feed(smf *m, sched *s, unsigned long until);
+
+/* Whether every event has been posted */
+int smf_done(const smf *m);
+
+#endif
@@ -0,0 +1,71 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Wait-free single-producer, single-consumer ring of samples                 */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "spsc_ring.h"
+
+int spsc_ring_init(spsc_ring *ring, unsigned long capacity) {
+    unsigned long size = 16; /* one cache line of floats */
+
+    while (size < capacity)
+        size *= 2;
+    ring->data = aligned_alloc(64, size * sizeof(float));
+    if (ring->data == NULL)
+        return -1;
+    memset(ring->data, 0, size * sizeof(float));
+    ring->size = size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->producer_tail = 0;
+    ring->consumer_head = 0;
+    return 0;
+}
+
+void spsc_ring_free(spsc_ring *ring) {
+    free(ring->data);
+    ring->data = NULL;
+}
+
+unsigned long spsc_ring_write(spsc_ring *ring, const float *src, unsigned long n) {
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned long start, first;
+
+    if (ring->size - (head - ring->producer_tail) < n)
+        ring->producer_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (n > ring->size - (head - ring->producer_tail))
+        n = ring->size - (head - ring->producer_tail);
+
+    start = head & (ring->size - 1);
+    first = n < ring->size - start ? n : ring->size - start;
+    memcpy(ring->data + start, src, first * sizeof(float));
+    memcpy(ring->data, src + first, (n - first) * sizeof(float));
+    atomic_store_explicit(&ring->head, head + n, memory_order_release);
+    return n;
+}
+
+unsigned long spsc_ring_read(spsc_ring *ring, float *dst, unsigned long n) {
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned long start, first;
+
+    if (ring->consumer_head - tail < n)
+        ring->consumer_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (n > ring->consumer_head - tail)
+        n = ring->consumer_head - tail;
+
+    start = tail & (ring->size - 1);
+    first = n < ring->size - start ? n : ring->size - start;
+    memcpy(dst, ring->data + start, first * sizeof(float));
+    memcpy(dst + first, ring->data, (n - first) * sizeof(float));
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+unsigned long spsc_ring_fill(spsc_ring *ring) {
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+}
@@ -0,0 +1,43 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Wait-free single-producer, single-consumer ring of samples                 */
+/*                                                                            */
+/* One thread writes, one thread reads, neither ever blocks or retries: each  */
+/* call moves what fits and returns at once. The write and read positions     */
+/* live on cache lines of their own, and each side keeps a private copy of    */
+/* the other side's position, refreshed only when the ring looks full (or     */
+/* empty), so the two cores rarely touch the same line. The storage is 64-    */
+/* byte aligned and its size a power of two, so whole cache lines of samples  */
+/* move between the cores.                                                    */
+/******************************************************************************/
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdatomic.h>
+
+typedef struct {
+    float *data;
+    unsigned long size;                /* samples, a power of two */
+    _Alignas(64) atomic_ulong head;    /* samples ever written, producer's */
+    unsigned long producer_tail;       /* producer's copy of tail */
+    _Alignas(64) atomic_ulong tail;    /* samples ever read, consumer's */
+    unsigned long consumer_head;       /* consumer's copy of head */
+} spsc_ring;
+
+/* Room for at least capacity samples. Returns 0, or -1 on failure. */
+int spsc_ring_init(spsc_ring *ring, unsigned long capacity);
+
+void spsc_ring_free(spsc_ring *ring);
+
+/* Producer side: copy up to n samples in, return how many were copied */
+unsigned long spsc_ring_write(spsc_ring *ring, const float *src, unsigned long n);
+
+/* Consumer side: copy up to n samples out, return how many were copied */
+unsigned long spsc_ring_read(spsc_ring *ring, float *dst, unsigned long n);
+
+/* Samples waiting to be read; exact on either side, a snapshot elsewhere */
+unsigned long spsc_ring_fill(spsc_ring *ring);
+
+#endif
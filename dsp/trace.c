@@ -0,0 +1,181 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Streaming binary traces of per-sample values                               */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+#define TRACE_VERSION (1)
+#define WRITE_CHUNK (8192)  /* floats per fwrite */
+#define WRITER_NAP_NS (10000000)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t decimation;
+    uint32_t minmax;
+    uint32_t reserved;
+    double rate;
+} trace_header;
+
+_Static_assert(sizeof(trace_header) == TRACE_HEADER_SIZE, "trace header layout");
+
+/* Move what the ring holds to the file, return the number of floats moved */
+static unsigned long drain(trace_writer *tw) {
+    float chunk[WRITE_CHUNK];
+    unsigned long n, total = 0;
+
+    while ((n = spsc_ring_read(&tw->ring, chunk, WRITE_CHUNK)) > 0) {
+        if (!tw->error && fwrite(chunk, sizeof(float), n, tw->file) != n)
+            tw->error = 1;
+        tw->written += n;
+        total += n;
+    }
+    return total;
+}
+
+static void *writer(void *arg) {
+    trace_writer *tw = arg;
+    struct timespec nap = { 0, WRITER_NAP_NS };
+
+    while (!atomic_load(&tw->quit))
+        if (drain(tw) == 0)
+            nanosleep(&nap, NULL);
+    drain(tw);
+    return NULL;
+}
+
+int trace_writer_open(trace_writer *tw, const char *path, double rate,
+                      unsigned int decimation, int minmax, unsigned long max_push) {
+    trace_header header;
+
+    if (decimation < 1)
+        decimation = 1;
+    tw->decimation = decimation;
+    tw->minmax = minmax != 0;
+    tw->wait = 0;
+    tw->position = 0;
+    tw->written = 0;
+    tw->error = 0;
+    atomic_init(&tw->quit, 0);
+    atomic_init(&tw->dropped, 0);
+
+    /* A push yields at most one point per decimation values, plus one */
+    tw->staging_size = (max_push / decimation + 1) * (tw->minmax ? 2 : 1);
+    tw->staging = malloc(tw->staging_size * sizeof(float));
+    if (tw->staging == NULL)
+        return -1;
+    if (spsc_ring_init(&tw->ring, TRACE_RING) < 0) {
+        free(tw->staging);
+        return -1;
+    }
+    tw->file = fopen(path, "wb");
+    if (tw->file == NULL)
+        goto fail;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DSPTRACE", 8);
+    header.version = TRACE_VERSION;
+    header.decimation = decimation;
+    header.minmax = tw->minmax;
+    header.rate = rate;
+    if (fwrite(&header, sizeof(header), 1, tw->file) != 1 ||
+        pthread_create(&tw->thread, NULL, writer, tw) != 0) {
+        fclose(tw->file);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    spsc_ring_free(&tw->ring);
+    free(tw->staging);
+    return -1;
+}
+
+void trace_push(trace_writer *tw, const float *values, unsigned long n) {
+    struct timespec nap = { 0, WRITER_NAP_NS };
+    unsigned long i, m = 0;
+    float v;
+
+    for (i=0; i<n; i++) {
+        v = values[i];
+        if (tw->minmax) {
+            if (tw->position == 0 || v < tw->min)
+                tw->min = v;
+            if (tw->position == 0 || v > tw->max)
+                tw->max = v;
+            if (++tw->position == tw->decimation) {
+                tw->staging[m++] = tw->min;
+                tw->staging[m++] = tw->max;
+                tw->position = 0;
+            }
+        } else {
+            if (tw->position == 0)
+                tw->staging[m++] = v;
+            if (++tw->position == tw->decimation)
+                tw->position = 0;
+        }
+    }
+    while (tw->wait && tw->ring.size - spsc_ring_fill(&tw->ring) < m)
+        nanosleep(&nap, NULL);
+    /* All or nothing, so minimum and maximum pairs are never split */
+    if (tw->ring.size - spsc_ring_fill(&tw->ring) >= m)
+        spsc_ring_write(&tw->ring, tw->staging, m);
+    else
+        atomic_fetch_add_explicit(&tw->dropped, m, memory_order_relaxed);
+}
+
+int trace_writer_close(trace_writer *tw) {
+    int err;
+
+    atomic_store(&tw->quit, 1);
+    pthread_join(tw->thread, NULL);
+    err = tw->error || fclose(tw->file) != 0 ? -1 : 0;
+    spsc_ring_free(&tw->ring);
+    free(tw->staging);
+    tw->staging = NULL;
+    return err;
+}
+
+int trace_reader_open(trace_reader *tr, const char *path) {
+    trace_header header;
+    long size;
+
+    tr->file = fopen(path, "rb");
+    if (tr->file == NULL)
+        return -1;
+    if (fread(&header, sizeof(header), 1, tr->file) != 1 ||
+        memcmp(header.magic, "DSPTRACE", 8) != 0 ||
+        header.version != TRACE_VERSION || fseek(tr->file, 0, SEEK_END) != 0 ||
+        (size = ftell(tr->file)) < TRACE_HEADER_SIZE) {
+        fclose(tr->file);
+        return -1;
+    }
+    tr->decimation = header.decimation;
+    tr->minmax = header.minmax != 0;
+    tr->rate = header.rate;
+    tr->points = (size - TRACE_HEADER_SIZE) / (sizeof(float) * (tr->minmax ? 2 : 1));
+    return 0;
+}
+
+unsigned long trace_read(trace_reader *tr, float *out, unsigned long first,
+                         unsigned long count) {
+    unsigned long floats = tr->minmax ? 2 : 1;
+
+    if (first >= tr->points)
+        return 0;
+    if (count > tr->points - first)
+        count = tr->points - first;
+    if (fseek(tr->file, TRACE_HEADER_SIZE + first * floats * sizeof(float), SEEK_SET) != 0)
+        return 0;
+    return fread(out, floats * sizeof(float), count, tr->file);
+}
+
+void trace_reader_close(trace_reader *tr) {
+    fclose(tr->file);
+}
@@ -0,0 +1,96 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Streaming binary traces of per-sample values                               */
+/*                                                                            */
+/* The audio callback pushes values into an spsc_ring and a background thread */
+/* appends them to the trace file, so memory stays at the size of the ring    */
+/* however long the trace runs. Pushing is wait-free: when the writer falls   */
+/* behind, values are dropped and counted rather than waited for, unless      */
+/* wait is set, which offline rendering can afford.                           */
+/*                                                                            */
+/* Values can be decimated before they reach the ring: with a decimation of   */
+/* N, either the first value of every N is kept, or the minimum and maximum   */
+/* of every N are kept as a pair, so short spikes still show.                 */
+/*                                                                            */
+/* The file is a TRACE_HEADER_SIZE byte header followed by native floats,     */
+/* one per point, or two (minimum, maximum) per point when summarised:        */
+/*   0  "DSPTRACE"                                                            */
+/*   8  uint32 version (1)                                                    */
+/*  12  uint32 decimation                                                     */
+/*  16  uint32 non-zero when summarised as minimum and maximum                */
+/*  20  uint32 reserved, 0                                                    */
+/*  24  float64 rate of the traced values before decimation, in Hz            */
+/******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "spsc_ring.h"
+
+#define TRACE_HEADER_SIZE (32)
+#define TRACE_RING (1 << 18) /* floats buffered between callback and writer */
+
+typedef struct {
+    FILE *file;
+    spsc_ring ring;
+    unsigned int decimation;
+    int minmax;
+    int wait;                   /* non-zero: a full ring makes trace_push wait */
+    /* Decimation state, callback's */
+    unsigned int position;      /* values seen in the current window */
+    float min, max;
+    float *staging;             /* points of one push before they enter the ring */
+    unsigned long staging_size;
+    /* Writer thread */
+    pthread_t thread;
+    atomic_int quit;
+    atomic_ulong dropped;       /* floats lost to a full ring */
+    unsigned long written;      /* floats in the file, writer's */
+    int error;
+} trace_writer;
+
+/******************************************************************************/
+/* trace_writer_open: create path and start the writer thread                 */
+/* rate: rate of the values that will be pushed, in Hz                        */
+/* decimation: keep one point per decimation values, 1 to keep them all       */
+/* minmax: when non-zero, each point is the minimum and maximum of its values */
+/* max_push: largest number of values trace_push() will be given at once      */
+/* Returns 0, or -1 on failure.                                               */
+/******************************************************************************/
+
+int trace_writer_open(trace_writer *tw, const char *path, double rate,
+                      unsigned int decimation, int minmax, unsigned long max_push);
+
+/* Audio callback side: trace n values, never blocks */
+void trace_push(trace_writer *tw, const float *values, unsigned long n);
+
+/* Flush what is left, stop the writer and close the file. Returns 0 or -1. */
+int trace_writer_close(trace_writer *tw);
+
+typedef struct {
+    FILE *file;
+    unsigned int decimation;
+    int minmax;
+    double rate;
+    unsigned long points;
+} trace_reader;
+
+/* Open a trace and read its header. Returns 0, or -1 if it is not a trace. */
+int trace_reader_open(trace_reader *tr, const char *path);
+
+/******************************************************************************/
+/* trace_read: read up to count points starting at point first                */
+/* out: count floats, or 2 * count (minimum, maximum) when summarised         */
+/* Returns the number of points read.                                         */
+/******************************************************************************/
+
+unsigned long trace_read(trace_reader *tr, float *out, unsigned long first,
+                         unsigned long count);
+
+void trace_reader_close(trace_reader *tr);
+
+#endif
@@ -0,0 +1,136 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Band-limited, mipmapped wavetables                                         */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "wavetable.h"
+
+#define MAX_NAMED_HARMONICS (WAVETABLE_SIZE / 2)
+
+/* Harmonics that level k can hold without aliasing */
+static unsigned int level_harmonics(unsigned int level) {
+    return (WAVETABLE_SIZE / 2) >> level;
+}
+
+int wavetable_build(wavetable *wt, const float *amplitudes,
+                    unsigned int nb_harmonics, double sample_rate) {
+    unsigned int level, h, i, top;
+    float *table;
+    double peak;
+
+    wt->levels = 0;
+    while (wt->levels < WAVETABLE_MAX_LEVELS && level_harmonics(wt->levels) > 0)
+        wt->levels++;
+    wt->sample_rate = sample_rate;
+    wt->data = aligned_alloc(64, wt->levels * WAVETABLE_STRIDE * sizeof(float));
+    if (wt->data == NULL)
+        return -1;
+
+    for (level=0; level<wt->levels; level++) {
+        table = wt->data + level * WAVETABLE_STRIDE;
+        memset(table, 0, WAVETABLE_STRIDE * sizeof(float));
+        top = level_harmonics(level);
+        if (top > nb_harmonics)
+            top = nb_harmonics;
+        for (h=1; h<=top; h++) {
+            if (amplitudes[h-1] == 0)
+                continue;
+            for (i=0; i<WAVETABLE_SIZE; i++)
+                table[i] += amplitudes[h-1] *
+                            sin(2 * M_PI * (double)h * i / WAVETABLE_SIZE);
+        }
+        peak = 0;
+        for (i=0; i<WAVETABLE_SIZE; i++)
+            if (fabs(table[i]) > peak)
+                peak = fabs(table[i]);
+        if (peak > 0)
+            for (i=0; i<WAVETABLE_SIZE; i++)
+                table[i] /= peak;
+        table[WAVETABLE_SIZE] = table[0]; /* guard for interpolation */
+    }
+    return 0;
+}
+
+int wavetable_build_named(wavetable *wt, const char *name, double sample_rate) {
+    static float amplitudes[MAX_NAMED_HARMONICS];
+    unsigned int h, nb = MAX_NAMED_HARMONICS;
+    char *end;
+
+    memset(amplitudes, 0, sizeof(amplitudes));
+    if (strcmp(name, "sine") == 0) {
+        amplitudes[0] = 1;
+        nb = 1;
+    } else if (strcmp(name, "saw") == 0) {
+        for (h=1; h<=nb; h++)
+            amplitudes[h-1] = 1.0 / h;
+    } else if (strcmp(name, "square") == 0) {
+        for (h=1; h<=nb; h+=2)
+            amplitudes[h-1] = 1.0 / h;
+    } else if (strcmp(name, "triangle") == 0) {
+        for (h=1; h<=nb; h+=2)
+            amplitudes[h-1] = ((h / 2) % 2 ? -1.0 : 1.0) / ((double)h * h);
+    } else {
+        /* Comma separated list of harmonic amplitudes */
+        nb = 0;
+        while (*name != '\0' && nb < MAX_NAMED_HARMONICS) {
+            amplitudes[nb++] = strtod(name, &end);
+            if (end == name || (*end != ',' && *end != '\0'))
+                return -1;
+            name = *end == ',' ? end + 1 : end;
+        }
+        if (nb == 0)
+            return -1;
+    }
+    return wavetable_build(wt, amplitudes, nb, sample_rate);
+}
+
+void wavetable_free(wavetable *wt) {
+    free(wt->data);
+    wt->data = NULL;
+    wt->levels = 0;
+}
+
+size_t wavetable_memory(const wavetable *wt) {
+    return wt->levels * WAVETABLE_STRIDE * sizeof(float);
+}
+
+unsigned int wavetable_level(const wavetable *wt, double frequency) {
+    double ratio = fabs(frequency) / WAVETABLE_BASE(wt->sample_rate);
+    int exponent;
+
+    if (ratio <= 1)
+        return 0;
+    /* ceil(log2(ratio)) without calling log2 */
+    if (frexp(ratio, &exponent) == 0.5)
+        exponent--;
+    if ((unsigned int)exponent >= wt->levels)
+        return wt->levels - 1;
+    return exponent;
+}
+
+double wavetable_render(const wavetable *wt, float *out, unsigned long n,
+                        double phase, double frequency) {
+    const float *table = wt->data + wavetable_level(wt, frequency) * WAVETABLE_STRIDE;
+    double step = frequency / wt->sample_rate;
+    double position;
+    unsigned long i;
+    long k;
+    float frac;
+    int index;
+
+    for (i=0; i<n; i++) {
+        /* Position in closed form from the block start, no carried phase */
+        position = (phase + step * i) * WAVETABLE_SIZE;
+        k = (long)position;
+        k -= position < k; /* floor, for negative frequencies */
+        frac = (float)(position - k);
+        index = k & (WAVETABLE_SIZE - 1);
+        out[i] = table[index] + frac * (table[index+1] - table[index]);
+    }
+    phase += step * n;
+    return phase - floor(phase);
+}
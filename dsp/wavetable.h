@@ -0,0 +1,70 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Band-limited, mipmapped wavetables                                         */
+/*                                                                            */
+/* A wavetable holds one cycle of a waveform per octave ("mip level"). Level  */
+/* k only contains the harmonics that stay below Nyquist for every            */
+/* fundamental up to WAVETABLE_BASE(rate) * 2^k, so playing a level in its    */
+/* own octave cannot alias. All levels live in one 64-byte aligned block,     */
+/* each padded to a whole number of cache lines with a guard sample for the   */
+/* interpolation. Tables are built once and only read afterwards, so a single */
+/* table can be shared by any number of voices and threads.                   */
+/******************************************************************************/
+
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <stddef.h>
+
+#define WAVETABLE_SIZE (2048) /* samples per cycle, a power of two */
+#define WAVETABLE_STRIDE (WAVETABLE_SIZE + 16) /* level pitch, keeps alignment */
+#define WAVETABLE_MAX_LEVELS (12)
+
+/* Highest fundamental of level 0: level 0 carries WAVETABLE_SIZE/2 harmonics */
+#define WAVETABLE_BASE(rate) ((rate) / WAVETABLE_SIZE)
+
+typedef struct {
+    unsigned int levels;
+    double sample_rate;
+    float *data; /* levels * WAVETABLE_STRIDE samples */
+} wavetable;
+
+/******************************************************************************/
+/* wavetable_build: build the mip levels of a waveform from its harmonics     */
+/* amplitudes: amplitude of the sine partial of harmonic h at amplitudes[h-1] */
+/* nb_harmonics: number of entries in amplitudes                              */
+/* sample_rate: rate the table will be played at, in Hz                       */
+/* Each level is normalised to a peak of 1. Returns 0, or -1 on failure.      */
+/******************************************************************************/
+
+int wavetable_build(wavetable *wt, const float *amplitudes,
+                    unsigned int nb_harmonics, double sample_rate);
+
+/******************************************************************************/
+/* wavetable_build_named: build "sine", "saw", "square" or "triangle", or a   */
+/* comma separated list of harmonic amplitudes such as "1,0.5,0,0.25".        */
+/* Returns 0, or -1 if the name is not understood or memory runs out.         */
+/******************************************************************************/
+
+int wavetable_build_named(wavetable *wt, const char *name, double sample_rate);
+
+void wavetable_free(wavetable *wt);
+
+/* Bytes of sample memory held by the table */
+size_t wavetable_memory(const wavetable *wt);
+
+/* Mip level used for a fundamental frequency in Hz */
+unsigned int wavetable_level(const wavetable *wt, double frequency);
+
+/******************************************************************************/
+/* wavetable_render: play n samples of the table with linear interpolation    */
+/* phase: starting phase in cycles, [0, 1)                                    */
+/* frequency: fundamental in Hz, constant over the block                      */
+/* Returns the phase following the block, in [0, 1).                          */
+/******************************************************************************/
+
+double wavetable_render(const wavetable *wt, float *out, unsigned long n,
+                        double phase, double frequency);
+
+#endif
@@ -0,0 +1,91 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Reports the memory used by a wavetable, the time taken to build it and the */
+/* cost per sample of playing it, next to the analytic sine kernel.           */
+/* Usage: wavetable_bench [waveform] [block_size]                             */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "sine.h"
+#include "wavetable.h"
+
+#define SAMPLE_RATE_IN_HZ (44100)
+#define MAX_BLOCK (4096)
+#define MIN_SECONDS (0.2)
+
+static float out[MAX_BLOCK];
+static volatile float sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    static const double frequencies[] = { 55, 440, 3520, 14080 };
+    const char *name = "saw";
+    unsigned long n = 1024, blocks, k;
+    unsigned int f;
+    wavetable wt;
+    double start, elapsed, phase;
+
+    if (argc >= 2)
+        name = argv[1];
+    if (argc >= 3)
+        n = atoi(argv[2]);
+    if (n < 1 || n > MAX_BLOCK) {
+        fprintf(stderr, "Block size must be between 1 and %d\n", MAX_BLOCK);
+        return 1;
+    }
+
+    start = now();
+    if (wavetable_build_named(&wt, name, SAMPLE_RATE_IN_HZ) < 0) {
+        fprintf(stderr, "Unknown waveform %s\n", name);
+        return 1;
+    }
+    elapsed = now() - start;
+
+    printf("Waveform %s: %u levels of %d samples, %zu bytes, built in %.1f ms\n",
+           name, wt.levels, WAVETABLE_SIZE, wavetable_memory(&wt), elapsed * 1e3);
+    printf("Block size %lu\n", n);
+    printf("%-12s %6s %10s\n", "frequency", "level", "ns/sample");
+
+    for (f=0; f<sizeof(frequencies)/sizeof(frequencies[0]); f++) {
+        phase = 0;
+        blocks = 0;
+        start = now();
+        do {
+            for (k=0; k<64; k++)
+                phase = wavetable_render(&wt, out, n, phase, frequencies[f]);
+            blocks += 64;
+            elapsed = now() - start;
+        } while (elapsed < MIN_SECONDS);
+        sink = out[n-1];
+        printf("%9.0f Hz %6u %10.3f\n", frequencies[f],
+               wavetable_level(&wt, frequencies[f]), elapsed * 1e9 / ((double)blocks * n));
+    }
+
+    /* The analytic sine path the sweeps use without a wavetable */
+    phase = 0;
+    blocks = 0;
+    start = now();
+    do {
+        for (k=0; k<64; k++) {
+            phase = sine_phase_ramp(out, phase, 2 * M_PI * 440 / SAMPLE_RATE_IN_HZ, n);
+            sine_block(out, out, n);
+        }
+        blocks += 64;
+        elapsed = now() - start;
+    } while (elapsed < MIN_SECONDS);
+    sink = out[n-1];
+    printf("%-19s %10.3f (sine kernel: %s)\n", "analytic sine",
+           elapsed * 1e9 / ((double)blocks * n), sine_kernel_name());
+
+    wavetable_free(&wt);
+    return 0;
+}
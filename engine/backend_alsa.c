@@ -0,0 +1,259 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* ALSA backend: blocking writes, or conversion into the mmap'ed buffer       */
+/*                                                                            */
+/* Every period is rendered in float and converted with TPDF dither to the    */
+/* deepest format the device takes (pcm_format.h). The buffer holds           */
+/* ALSA_PERIODS periods and playback starts once it is full. Xruns are        */
+/* recovered and counted, and the period they hit is played late rather than  */
+/* skipped, so the virtual stream position handed to render stays exact.      */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <alsa/asoundlib.h>
+#include "engine.h"
+#include "convert.h"
+#include "denormals.h"
+#include "pcm_format.h"
+#include "rt_arena.h"
+#include "rt_check.h"
+
+#define ALSA_PERIODS (4)
+#define MAX_CHANNELS (8)
+
+typedef struct {
+    snd_pcm_t *handle;
+    snd_pcm_format_t format;
+    converter conv;
+    unsigned int channels;
+    unsigned int bytes;         /* per sample */
+    unsigned long xruns;
+} alsa_stream;
+
+static int recover(alsa_stream *s, int err) {
+    s->xruns++;
+    err = snd_pcm_recover(s->handle, err, 1);
+    if (err < 0)
+        fprintf(stderr, "ALSA recovery failed: %s\n", snd_strerror(err));
+    return err;
+}
+
+/* Convert samples samples, or write the device's silence for a silent period */
+static void fill(alsa_stream *s, const float *in, void *out, unsigned long samples,
+                 int silent) {
+    if (silent)
+        snd_pcm_format_set_silence(s->format, out, samples);
+    else
+        convert_block(&s->conv, in, out, samples);
+}
+
+/* Convert frames interleaved frames and write them all */
+static int write_interleaved(alsa_stream *s, const float *in, char *bytes,
+                             unsigned long frames, int silent) {
+    snd_pcm_sframes_t n;
+    unsigned long done = 0;
+
+    fill(s, in, bytes, frames * s->channels, silent);
+    while (done < frames) {
+        n = snd_pcm_writei(s->handle, bytes + done * s->channels * s->bytes, frames - done);
+        if (n < 0) {
+            if (recover(s, n) < 0)
+                return n;
+            continue;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/* Convert each plane and write them all */
+static int write_planar(alsa_stream *s, float *const *planes, char *bytes,
+                        unsigned long frames, int silent) {
+    void *bufs[MAX_CHANNELS];
+    snd_pcm_sframes_t n;
+    unsigned long done = 0;
+    unsigned int c;
+
+    for (c=0; c<s->channels; c++)
+        fill(s, planes[c], bytes + c * frames * s->bytes, frames, silent);
+    while (done < frames) {
+        for (c=0; c<s->channels; c++)
+            bufs[c] = bytes + (c * frames + done) * s->bytes;
+        n = snd_pcm_writen(s->handle, bufs, frames - done);
+        if (n < 0) {
+            if (recover(s, n) < 0)
+                return n;
+            continue;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/* Convert frames interleaved frames straight into the ring buffer */
+static int write_mmap(alsa_stream *s, const float *in, unsigned long frames,
+                      int silent) {
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, n;
+    snd_pcm_sframes_t avail, committed;
+    char *ptr;
+    int err;
+
+    while (frames > 0) {
+        avail = snd_pcm_avail_update(s->handle);
+        if (avail < 0) {
+            if ((err = recover(s, avail)) < 0)
+                return err;
+            continue;
+        }
+        if (avail == 0) {
+            /* Full: start playing the first time, then wait for room */
+            if (snd_pcm_state(s->handle) == SND_PCM_STATE_PREPARED)
+                err = snd_pcm_start(s->handle);
+            else
+                err = snd_pcm_wait(s->handle, -1);
+            if (err < 0 && (err = recover(s, err)) < 0)
+                return err;
+            continue;
+        }
+        n = frames < (unsigned long) avail ? frames : (unsigned long) avail;
+        if ((err = snd_pcm_mmap_begin(s->handle, &areas, &offset, &n)) < 0) {
+            if ((err = recover(s, err)) < 0)
+                return err;
+            continue;
+        }
+        /* Interleaved: every channel shares the first area */
+        ptr = (char *) areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+        fill(s, in, ptr, n * s->channels, silent);
+        committed = snd_pcm_mmap_commit(s->handle, offset, n);
+        if (committed < 0) {
+            if ((err = recover(s, committed)) < 0)
+                return err;
+            continue;
+        }
+        /* A short commit leaves the frames after it for the next pass */
+        in += committed * s->channels;
+        frames -= committed;
+    }
+    return 0;
+}
+
+static int setup(alsa_stream *s, const engine_config *config, snd_pcm_access_t access,
+                 snd_pcm_uframes_t *period) {
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_sw_params_t *sw;
+    snd_pcm_uframes_t buffer = ALSA_PERIODS * *period;
+    snd_pcm_format_t format;
+    convert_format convert;
+    unsigned int rate = config->sample_rate;
+    int err;
+
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_sw_params_alloca(&sw);
+    if ((err = snd_pcm_hw_params_any(s->handle, hw)) < 0 ||
+        (err = snd_pcm_hw_params_set_access(s->handle, hw, access)) < 0 ||
+        (err = pcm_format_negotiate(s->handle, hw, &format, &convert)) < 0 ||
+        (err = snd_pcm_hw_params_set_channels(s->handle, hw, config->channels)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_near(s->handle, hw, &rate, 0)) < 0 ||
+        (err = snd_pcm_hw_params_set_period_size_near(s->handle, hw, period, 0)) < 0 ||
+        (err = snd_pcm_hw_params_set_buffer_size_near(s->handle, hw, &buffer)) < 0 ||
+        (err = snd_pcm_hw_params(s->handle, hw)) < 0) {
+        fprintf(stderr, "ALSA hardware parameters: %s\n", snd_strerror(err));
+        return err;
+    }
+    if (rate != config->sample_rate) {
+        fprintf(stderr, "ALSA rate doesn't match (requested %uHz, got %uHz)\n",
+                config->sample_rate, rate);
+        return -EINVAL;
+    }
+    if ((err = snd_pcm_sw_params_current(s->handle, sw)) < 0 ||
+        (err = snd_pcm_sw_params_set_start_threshold(s->handle, sw, buffer / *period * *period)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(s->handle, sw, *period)) < 0 ||
+        (err = snd_pcm_sw_params(s->handle, sw)) < 0) {
+        fprintf(stderr, "ALSA software parameters: %s\n", snd_strerror(err));
+        return err;
+    }
+    s->format = format;
+    converter_init(&s->conv, convert, 1, 0);
+    s->bytes = convert_bytes(convert);
+    printf("ALSA %s, %s, %lu frames per period, %lu in the buffer\n",
+           snd_pcm_format_name(format), access == SND_PCM_ACCESS_MMAP_INTERLEAVED ? "mmap" :
+           access == SND_PCM_ACCESS_RW_NONINTERLEAVED ? "writen" : "writei",
+           (unsigned long) *period, (unsigned long) buffer);
+    return 0;
+}
+
+int engine_alsa_run(const engine_config *config, engine_render_fn render, void *data,
+                    int mmap) {
+    alsa_stream s;
+    snd_pcm_access_t access;
+    snd_pcm_uframes_t period = config->frames_per_period;
+    float *samples, *planes[MAX_CHANNELS];
+    char *bytes;
+    rt_arena arena = { NULL };
+    unsigned long p, periods;
+    unsigned int c;
+    int err, silent;
+
+    if (config->channels > MAX_CHANNELS || (mmap && config->planar)) {
+        fprintf(stderr, "The ALSA backend takes up to %d channels, interleaved with mmap\n",
+                MAX_CHANNELS);
+        return -1;
+    }
+    access = mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED :
+             config->planar ? SND_PCM_ACCESS_RW_NONINTERLEAVED : SND_PCM_ACCESS_RW_INTERLEAVED;
+    s.channels = config->channels;
+    s.xruns = 0;
+    err = snd_pcm_open(&s.handle, config->device != NULL ? config->device : "default",
+                       SND_PCM_STREAM_PLAYBACK, 0);
+    if (err < 0) {
+        fprintf(stderr, "ALSA open error: %s\n", snd_strerror(err));
+        return -1;
+    }
+    if ((err = setup(&s, config, access, &period)) < 0)
+        goto out;
+
+    /* Everything the loop touches, resident before the first period */
+    if (rt_arena_init(&arena, rt_arena_size(period * s.channels * sizeof(float)) +
+                              rt_arena_size(period * s.channels * 4)) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        err = -1;
+        goto out;
+    }
+    samples = rt_arena_alloc(&arena, period * s.channels * sizeof(float));
+    bytes = rt_arena_alloc(&arena, period * s.channels * 4);
+    for (c=0; c<s.channels; c++)
+        planes[c] = samples + c * period;
+
+    periods = (unsigned long) ceil(config->duration * config->sample_rate / period);
+    denormals_flush();
+    for (p=0; p<periods; p++) {
+        /* The ALSA calls themselves may lock, the rendering must not */
+        rt_check_enter();
+        silent = render(data, config->planar ? (void *) planes : samples, period,
+                        (double) p * period / config->sample_rate) == ENGINE_SILENT;
+        rt_check_leave();
+        if (config->planar)
+            err = write_planar(&s, planes, bytes, period, silent);
+        else if (mmap)
+            err = write_mmap(&s, samples, period, silent);
+        else
+            err = write_interleaved(&s, samples, bytes, period, silent);
+        if (err < 0)
+            goto out;
+    }
+    /* A stream shorter than the buffer has not started yet */
+    if (snd_pcm_state(s.handle) == SND_PCM_STATE_PREPARED)
+        snd_pcm_start(s.handle);
+    snd_pcm_drain(s.handle);
+    if (s.xruns > 0)
+        printf("ALSA: %lu xruns recovered\n", s.xruns);
+
+out:
+    rt_arena_free(&arena);
+    snd_pcm_close(s.handle);
+    return err < 0 ? -1 : 0;
+}
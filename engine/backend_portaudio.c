@@ -0,0 +1,83 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* PortAudio backend: the default output stream                               */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <portaudio.h>
+#include "engine.h"
+#include "denormals.h"
+#include "rt_check.h"
+
+typedef struct {
+    engine_render_fn render;
+    void *data;
+    unsigned int channels;
+    int planar;
+} pa_stream_data;
+
+static int engine_callback(const void *inputBuffer, void *outputBuffer,
+                           unsigned long framesPerBuffer,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           PaStreamCallbackFlags statusFlags,
+                           void *userData) {
+    pa_stream_data *s = (pa_stream_data*) userData;
+    unsigned int c;
+    (void) inputBuffer; /* Prevent unused argument warning. */
+
+    /* The callback thread is PortAudio's: set its mode on every call */
+    denormals_flush();
+    rt_check_enter();
+    if (s->render(s->data, outputBuffer, framesPerBuffer,
+                  timeInfo->outputBufferDacTime) == ENGINE_SILENT) {
+        if (!s->planar)
+            memset(outputBuffer, 0, framesPerBuffer * s->channels * sizeof(float));
+        else
+            for (c=0; c<s->channels; c++)
+                memset(((float **) outputBuffer)[c], 0, framesPerBuffer * sizeof(float));
+    }
+    rt_check_leave();
+    return paContinue;
+}
+
+int engine_portaudio_run(const engine_config *config, engine_render_fn render, void *data) {
+    pa_stream_data s = { render, data, config->channels, config->planar };
+    PaStream *stream;
+    PaError err;
+
+    err = Pa_Initialize();
+    if (err != paNoError) goto error;
+
+    err = Pa_OpenDefaultStream(&stream,
+                               0,           /* no input channels */
+                               config->channels,
+                               paFloat32 | (config->planar ? paNonInterleaved : 0),
+                               config->sample_rate,
+                               config->frames_per_period,
+                               engine_callback,
+                               &s);
+    if (err != paNoError) goto error;
+
+    err = Pa_StartStream(stream);
+    if (err != paNoError) goto error;
+
+    Pa_Sleep(config->duration * 1000);
+
+    err = Pa_StopStream(stream);
+    if (err != paNoError) goto error;
+
+    err = Pa_CloseStream(stream);
+    if (err != paNoError) goto error;
+
+    Pa_Terminate();
+    return 0;
+
+error:
+    Pa_Terminate();
+    fprintf(stderr, "An error occured while using the portaudio stream\n");
+    fprintf(stderr, "Error number: %d\n", err);
+    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText(err));
+    return -1;
+}
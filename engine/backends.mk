@@ -0,0 +1,8 @@
+# Backends compiled into libengine.a, and the libraries the programs linking
+# it need. The null backend is always there: make BACKENDS= builds without
+# PortAudio or ALSA.
+
+BACKENDS ?= portaudio alsa
+
+ENGINE_LIBS = $(if $(filter portaudio,$(BACKENDS)),-lportaudio) \
+              $(if $(filter alsa,$(BACKENDS)),-lasound)
@@ -0,0 +1,60 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Backend table and selection                                                */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "engine.h"
+
+#ifdef ENGINE_ALSA
+static int alsa_writei(const engine_config *config, engine_render_fn render, void *data) {
+    return engine_alsa_run(config, render, data, 0);
+}
+
+static int alsa_mmap(const engine_config *config, engine_render_fn render, void *data) {
+    return engine_alsa_run(config, render, data, 1);
+}
+#endif
+
+/* In order of preference */
+static const struct {
+    const char *name;
+    int (*run)(const engine_config *config, engine_render_fn render, void *data);
+} backends[] = {
+#ifdef ENGINE_PORTAUDIO
+    { "portaudio", engine_portaudio_run },
+#endif
+#ifdef ENGINE_ALSA
+    { "alsa", alsa_writei },
+    { "alsa-mmap", alsa_mmap },
+#endif
+    { "null", engine_null_run }
+};
+
+#define NB_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+int engine_run(const engine_config *config, engine_render_fn render, void *data) {
+    unsigned int i;
+
+    for (i=0; i<NB_BACKENDS; i++)
+        if (config->backend == NULL || strcmp(config->backend, backends[i].name) == 0)
+            return backends[i].run(config, render, data);
+    fprintf(stderr, "Unknown backend %s, try one of: %s\n", config->backend,
+            engine_backends());
+    return -1;
+}
+
+const char *engine_backends(void) {
+    static char names[64];
+    unsigned int i;
+
+    if (names[0] == '\0')
+        for (i=0; i<NB_BACKENDS; i++) {
+            if (i > 0)
+                strcat(names, ", ");
+            strcat(names, backends[i].name);
+        }
+    return names;
+}
@@ -0,0 +1,64 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* One render callback, several audio backends                                */
+/*                                                                            */
+/* A program writes a single render function and engine_run() drives it from  */
+/* the backend named in its configuration, so switching output is a command   */
+/* line flag rather than another copy of the program:                         */
+/*   portaudio   the default PortAudio output stream                          */
+/*   alsa        snd_pcm_writei(), or snd_pcm_writen() when planar            */
+/*   alsa-mmap   rendered, then converted straight into the mmap'ed buffer    */
+/*   null        a virtual clock, as fast as the CPU allows, into a file      */
+/*               (WAV if it ends in ".wav", raw otherwise) or /dev/null       */
+/* The null backend is deterministic: the same program and arguments always   */
+/* render the same periods with the same times, with no device at all, so     */
+/* any change can be benchmarked and compared headless.                       */
+/*                                                                            */
+/* Every backend flushes denormals to zero in the thread that renders         */
+/* (denormals.h), and writes the silence of a period flagged silent itself,   */
+/* in the device's format, instead of converting a buffer of zeros.           */
+/*                                                                            */
+/* Which backends are built is chosen with BACKENDS in backends.mk.           */
+/******************************************************************************/
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+/******************************************************************************/
+/* Render frames frames into out. out is interleaved float, or, when the      */
+/* configuration is planar, a float ** with one buffer per channel. time is   */
+/* the time of the first frame in seconds: the DAC time for PortAudio, the    */
+/* stream position for the other backends.                                    */
+/* Returns 0, or ENGINE_SILENT if every frame is zero, in which case out      */
+/* need not have been written.                                                */
+/******************************************************************************/
+
+#define ENGINE_SILENT (1)
+
+typedef int (*engine_render_fn)(void *data, void *out, unsigned long frames,
+                                double time);
+
+typedef struct {
+    const char *backend;        /* NULL for the first one built */
+    const char *device;         /* ALSA device or null backend file, NULL for the default */
+    unsigned int channels;
+    unsigned int sample_rate;
+    unsigned long frames_per_period;
+    double duration;            /* seconds */
+    int planar;                 /* non-zero for one buffer per channel */
+} engine_config;
+
+/* Run render for the configured duration. Returns 0, or -1 after saying why */
+int engine_run(const engine_config *config, engine_render_fn render, void *data);
+
+/* The backends built, separated by commas, for usage messages */
+const char *engine_backends(void);
+
+/* Backends, for engine.c */
+int engine_portaudio_run(const engine_config *config, engine_render_fn render, void *data);
+int engine_alsa_run(const engine_config *config, engine_render_fn render, void *data,
+                    int mmap);
+int engine_null_run(const engine_config *config, engine_render_fn render, void *data);
+
+#endif
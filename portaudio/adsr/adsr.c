@@ -1,3 +1,5 @@
+#include "adsr.h"
+
 double adsr(double t, double attack_time, double decay_time, double sustain_time, 
             double sustain_level, double release_time) {
 
@@ -15,4 +17,121 @@ double adsr(double t, double attack_time, double decay_time, double sustain_time
     } else {
         return 0;
     }
-}
\ No newline at end of file
+}
+
+static long seconds_to_samples(double seconds, double sample_rate) {
+    if (seconds < 0)
+        return -1;
+    return (long)(seconds * sample_rate + 0.5);
+}
+
+/* Set up the segment for the current stage, given the current level */
+static void adsr_env_enter(adsr_env *env, adsr_stage stage) {
+    env->stage = stage;
+    switch (stage) {
+    case ADSR_ATTACK:
+        /* Keep the attack slope, so a retrigger only covers what is left */
+        env->remaining = (long)((1 - env->level) * env->attack_samples + 0.5);
+        env->increment = env->remaining > 0 ? (1 - env->level) / env->remaining : 0;
+        break;
+    case ADSR_DECAY:
+        env->level = 1;
+        env->remaining = env->decay_samples;
+        env->increment = env->remaining > 0 ?
+                         (env->sustain_level - 1) / env->remaining : 0;
+        break;
+    case ADSR_SUSTAIN:
+        env->level = env->sustain_level;
+        env->remaining = env->sustain_samples;
+        env->increment = 0;
+        break;
+    case ADSR_RELEASE:
+        env->remaining = env->release_samples;
+        env->increment = env->remaining > 0 ? -env->level / env->remaining : 0;
+        break;
+    default:
+        env->level = 0;
+        env->remaining = -1;
+        env->increment = 0;
+        break;
+    }
+}
+
+void adsr_env_init(adsr_env *env, double sample_rate, double attack_time,
+                   double decay_time, double sustain_time,
+                   double sustain_level, double release_time) {
+    env->attack_samples = seconds_to_samples(attack_time, sample_rate);
+    env->decay_samples = seconds_to_samples(decay_time, sample_rate);
+    env->sustain_samples = seconds_to_samples(sustain_time, sample_rate);
+    env->release_samples = seconds_to_samples(release_time, sample_rate);
+    env->sustain_level = sustain_level;
+    env->level = 0;
+    adsr_env_enter(env, ADSR_IDLE);
+}
+
+void adsr_env_note_on(adsr_env *env) {
+    adsr_env_enter(env, ADSR_ATTACK);
+}
+
+void adsr_env_note_off(adsr_env *env) {
+    if (env->stage != ADSR_IDLE && env->stage != ADSR_RELEASE)
+        adsr_env_enter(env, ADSR_RELEASE);
+}
+
+int adsr_env_process(adsr_env *env, float *out, unsigned long n) {
+    unsigned long i, run;
+    double level, increment;
+
+    while (n > 0) {
+        /* Move on from finished segments (zero-length ones included) */
+        while (env->remaining == 0) {
+            if (env->stage == ADSR_RELEASE)
+                adsr_env_enter(env, ADSR_IDLE);
+            else
+                adsr_env_enter(env, env->stage + 1);
+        }
+
+        run = n;
+        if (env->remaining > 0 && (unsigned long)env->remaining < run)
+            run = env->remaining;
+
+        /* Closed form inside the segment: no branch and no carried */
+        /* dependency, so the compiler is free to vectorise it      */
+        level = env->level;
+        increment = env->increment;
+        for (i=0; i<run; i++)
+            out[i] = level + increment * i;
+
+        env->level = level + increment * run;
+        if (env->remaining > 0)
+            env->remaining -= run;
+        out += run;
+        n -= run;
+    }
+
+    return env->stage != ADSR_IDLE;
+}
+
+int adsr_env_advance(adsr_env *env, unsigned long n) {
+    unsigned long run;
+
+    while (n > 0) {
+        while (env->remaining == 0) {
+            if (env->stage == ADSR_RELEASE)
+                adsr_env_enter(env, ADSR_IDLE);
+            else
+                adsr_env_enter(env, env->stage + 1);
+        }
+
+        run = n;
+        if (env->remaining > 0 && (unsigned long)env->remaining < run)
+            run = env->remaining;
+
+        env->level += env->increment * run;
+        if (env->remaining > 0)
+            env->remaining -= run;
+        n -= run;
+    }
+
+    return env->stage != ADSR_IDLE;
+}
@@ -11,4 +11,67 @@
 /************************************************************/
 
 double adsr(double t, double attack_time, double decay_time, double sustain_time, 
-            double sustain_level, double release_time);
\ No newline at end of file
+            double sustain_level, double release_time);
+
+/************************************************************/
+/* Stateful ADSR envelope generator                         */
+/*                                                          */
+/* Same shape as adsr() above, but the envelope keeps its   */
+/* current stage, level and per-sample increment, so a     */
+/* whole block of gains is produced with one multiply-add   */
+/* per sample and no branches inside a segment.             */
+/* A negative sustain_time holds the sustain stage until    */
+/* adsr_env_note_off() is called.                           */
+/************************************************************/
+
+typedef enum {
+    ADSR_IDLE,
+    ADSR_ATTACK,
+    ADSR_DECAY,
+    ADSR_SUSTAIN,
+    ADSR_RELEASE
+} adsr_stage;
+
+typedef struct {
+    adsr_stage stage;
+    double level;            /* gain of the next sample */
+    double increment;        /* per-sample slope of the current segment */
+    long remaining;          /* samples left in the current segment, -1 to hold */
+    long attack_samples;
+    long decay_samples;
+    long sustain_samples;    /* -1 to hold until note off */
+    long release_samples;
+    double sustain_level;
+} adsr_env;
+
+/************************************************************/
+/* adsr_env_init: set up an idle envelope                   */
+/* sample_rate: rate at which adsr_env_process is run, Hz   */
+/* other arguments as in adsr(), in seconds                 */
+/************************************************************/
+
+void adsr_env_init(adsr_env *env, double sample_rate, double attack_time,
+                   double decay_time, double sustain_time,
+                   double sustain_level, double release_time);
+
+/* Start (or retrigger) the attack from the current level */
+void adsr_env_note_on(adsr_env *env);
+
+/* Start the release from the current level */
+void adsr_env_note_off(adsr_env *env);
+
+/************************************************************/
+/* adsr_env_process: write the next n gains to out          */
+/* Returns 0 once the envelope is idle, non-zero otherwise  */
+/************************************************************/
+
+int adsr_env_process(adsr_env *env, float *out, unsigned long n);
+
+/************************************************************/
+/* adsr_env_advance: skip the next n gains, as              */
+/* adsr_env_process() without writing them, in one step per */
+/* segment; env->level is then the gain of the next sample  */
+/* Returns 0 once the envelope is idle, non-zero otherwise  */
+/************************************************************/
+
+int adsr_env_advance(adsr_env *env, unsigned long n);
@@ -1,23 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <portaudio.h>
 #include <math.h>
+#include <unistd.h>
 #include "adsr.h"
+#include "nco.h"
+#include "offline.h"
+#include "channels.h"
 
 #define SAMPLE_RATE_IN_HZ   (44100)
 #define FRAMES_PER_BUFFER (1024)
 
 
 typedef struct {
-    double t;
-    double time_step;
-    double phase;
-    double phase_step;
-    double attack;
-    double decay;
-    double sustain;
-    double sustain_level;
-    double release;
+    nco osc;
+    adsr_env env;
 } pa_data;
 
 static int adsr_test_callback (const void *inputBuffer, void *outputBuffer,
@@ -29,23 +27,37 @@ static int adsr_test_callback (const void *inputBuffer, void *outputBuffer,
     pa_data *data = (pa_data*) userData;
     (void) inputBuffer; /* Prevent unused argument warning. */
     float *out = (float*) outputBuffer;
-    int i;
-    float sample;
-
-    for (i=0; i<framesPerBuffer; i++) {
-        sample = adsr(data->t, data->attack, data->decay, data->sustain, data->sustain_level, data->release) *
-                sin(data->phase);
-        *out++ = sample; /*left */
-        *out++ = sample; /* right */
-        data->t += data->time_step;
-        data->phase += data->phase_step;
-        if (data->phase > 2*M_PI)
-            data->phase -= 2*M_PI;
+    float gains[FRAMES_PER_BUFFER];
+    float samples[FRAMES_PER_BUFFER];
+    unsigned long i, block;
+
+    /* Once released to the end, the note is silence: skip the oscillator */
+    if (data->env.stage == ADSR_IDLE) {
+        memset(out, 0, 2 * framesPerBuffer * sizeof(float));
+        return 0;
+    }
+    while (framesPerBuffer > 0) {
+        block = framesPerBuffer < FRAMES_PER_BUFFER ? framesPerBuffer : FRAMES_PER_BUFFER;
+        adsr_env_process(&data->env, gains, block);
+        nco_render(&data->osc, samples, block);
+        for (i=0; i<block; i++)
+            samples[i] *= gains[i];
+        channels_fan_out(samples, out, 2, block);
+        out += 2 * block;
+        framesPerBuffer -= block;
     }
 
     return 0;
 }
 
+/* Offline rendering runs the same callback on a virtual clock */
+static void adsr_test_render(void *data, void *out, unsigned long frames,
+                             double time) {
+    PaStreamCallbackTimeInfo timeInfo = {time, time, time};
+
+    adsr_test_callback(NULL, out, frames, &timeInfo, 0, data);
+}
+
 int main(int argc, char *argv[]) {
 
     /* audio_setup(adsr_test_callback); */
@@ -55,11 +67,23 @@ int main(int argc, char *argv[]) {
     PaStream *stream;
     PaError err;
     pa_data data;
+    const char *output = NULL; /* file to render to instead of playing */
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        if (opt == 'o')
+            output = optarg;
+        else
+            argc = 0;
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
   
     if (argc != 7) {
         fprintf(stderr, "Wrong number of arguments.\n");
         fprintf(stderr, "Usage:\n");
-        fprintf(stderr, "adsr_test frequency attack decay sustain sustain_level release\n");
+        fprintf(stderr, "adsr_test [-o file] frequency attack decay sustain sustain_level release\n");
         return 0;
     }
 
@@ -72,15 +96,15 @@ int main(int argc, char *argv[]) {
 
     duration = attack + decay + sustain + release;
 
-    data.attack = attack;
-    data.decay = decay;
-    data.sustain = sustain;
-    data.sustain_level = sustain_level;
-    data.release = release;
-    data.phase = 0.0;
-    data.t = 0.0;
-    data.time_step = 1.0 / SAMPLE_RATE_IN_HZ;
-    data.phase_step = 2 * M_PI * frequency * data.time_step;
+    adsr_env_init(&data.env, SAMPLE_RATE_IN_HZ, attack, decay, sustain,
+                  sustain_level, release);
+    adsr_env_note_on(&data.env);
+    nco_init(&data.osc, frequency, SAMPLE_RATE_IN_HZ);
+
+    if (output != NULL)
+        return offline_render(output, OFFLINE_FLOAT32, 2, SAMPLE_RATE_IN_HZ,
+                              FRAMES_PER_BUFFER, duration, adsr_test_render,
+                              &data) < 0 ? 1 : 0;
 
     err = Pa_Initialize();
     if( err != paNoError ) goto error;
@@ -1,113 +1,283 @@
 /******************************************************************************/
 /* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
 /* SPDX-License-Identifier: GPL-3.0-or-later                                  */
-/* A simple frequency sweep program to test PortAudio                         */
+/* A simple frequency sweep program to test the audio backends                */
+/* It plays through the engine library (engine/): -B picks the backend        */
+/* (portaudio, alsa, alsa-mmap or null) and -d its device. With -o file the   */
+/* sweep is rendered by the null backend into a WAV (.wav) or raw float file  */
+/* as fast as possible, without a sound device:                               */
+/* ./freq_sweep -o sweep.wav 10 100 10000 saw                                 */
+/* With -a frames a producer thread renders that many frames ahead of the     */
+/* callback (dsp/render_ahead), which then only copies them out               */
+/* With -n the stream is opened non-interleaved: the sweep is rendered once   */
+/* into the left channel's buffer and copied to the right one (the null       */
+/* backend interleaves them again into its file)                              */
+/* The frequency and the gain are smoothed parameters (dsp/param): the sweep  */
+/* is one linear ramp over the whole duration, exact at every sample, and     */
+/* with -c a control thread reads changes from standard input while playing,  */
+/* one per line, each ramped over an optional time in ms (20 by default):     */
+/*   f 440 500     glide to 440 Hz in 500 ms, exponentially                   */
+/*   g 0.25        fade to a gain of 0.25, linearly                           */
+/* The oscillator keeps its phase in fixed point (dsp/nco), so it never       */
+/* drifts and needs no wrapping, however long the sweep plays.                */
 /******************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include <portaudio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "nco.h"
+#include "wavetable.h"
+#include "engine.h"
+#include "render_ahead.h"
+#include "channels.h"
+#include "param.h"
 
 #define DURATION_IN_SECONDS   (10)
 #define SAMPLE_RATE_IN_HZ   (44100)
 #define SINE_START_FREQ_IN_HZ (1000)
 #define SINE_STOP_FREQ_IN_HZ (1000)
 #define FRAMES_PER_BUFFER (1024)
+#define WAVETABLE_CHUNK (32) /* frames a wavetable plays at one frequency while gliding */
+#define CONTROL_RAMP_IN_MS (20)
+
+enum { PARAM_FREQUENCY, PARAM_GAIN, NB_PARAMS };
 
 typedef struct {
-    float phase;
-    float frequency;
-    float freq_step;
+    nco osc; /* phase of the sine or of the wavetable */
+    param_bank params; /* frequency in Hz and gain, ramped per sample */
+    const wavetable *table; /* NULL for a pure sine */
+    render_ahead *ahead; /* NULL when rendering in the callback */
+    int planar; /* non-zero when the stream is non-interleaved */
 } sine;
 
 
-static int freq_sweep_callback (const void *inputBuffer, void *outputBuffer,
-                           unsigned long framesPerBuffer,
-                           const PaStreamCallbackTimeInfo* timeInfo,
-                           PaStreamCallbackFlags statusFlags,
-                           void *userData) {
+/* The oscillator of the sweep, over frames frames with no change due */
+static void freq_sweep_run(sine *wave, float *out, unsigned long frames) {
+    param_smooth *frequency = &wave->params.params[PARAM_FREQUENCY];
+    param_smooth *gain = &wave->params.params[PARAM_GAIN];
+    float values[FRAMES_PER_BUFFER];
+    uint32_t phases[FRAMES_PER_BUFFER], phase = wave->osc.phase;
+    float scale = NCO_CYCLE / SAMPLE_RATE_IN_HZ;
+    unsigned long i, n;
 
-    /* Cast data passed through stream to our structure. */
+    if (wave->table != NULL) {
+        /* A wavetable plays one frequency per call: glide in short chunks */
+        for (i=0; i<frames; i+=n) {
+            n = frames - i < WAVETABLE_CHUNK ? frames - i : WAVETABLE_CHUNK;
+            wave->osc.increment = nco_increment(frequency->value, SAMPLE_RATE_IN_HZ);
+            wavetable_render(wave->table, out + i, n, wave->osc.phase / NCO_CYCLE,
+                             frequency->value);
+            wave->osc.phase += (uint32_t) n * wave->osc.increment;
+            param_smooth_skip(frequency, n);
+        }
+    } else if (param_smooth_block(frequency, values, frames)) {
+        /* One increment per sample, below half a cycle either way */
+        for (i=0; i<frames; i++) {
+            phases[i] = phase;
+            phase += (uint32_t) (int32_t) lrintf(scale * values[i]);
+        }
+        wave->osc.phase = phase;
+        nco_sine_block(phases, out, frames);
+    } else {
+        wave->osc.increment = nco_increment(frequency->value, SAMPLE_RATE_IN_HZ);
+        nco_render(&wave->osc, out, frames);
+    }
+
+    if (param_smooth_block(gain, values, frames))
+        for (i=0; i<frames; i++)
+            out[i] *= values[i];
+    else if (gain->value != 1)
+        for (i=0; i<frames; i++)
+            out[i] *= gain->value;
+}
+
+/* Render one block of the sweep, mono, split where parameter changes land */
+static void freq_sweep_block(sine *wave, float *out, unsigned long frames) {
+    unsigned long run;
+
+    while (frames > 0) {
+        run = param_bank_update(&wave->params, frames);
+        freq_sweep_run(wave, out, run);
+        param_bank_advance(&wave->params, run);
+        out += run;
+        frames -= run;
+    }
+}
+
+static void freq_sweep_synth(void *userData, float *out, unsigned long framesPerBuffer) {
     sine *wave = (sine*) userData;
-    float *out = (float*) outputBuffer;
-    float sample;
-    unsigned int i;
-    (void) inputBuffer; /* Prevent unused variable warning. */
-    float phase_step = 2*M_PI*(wave->frequency)/(float)SAMPLE_RATE_IN_HZ;
-
-    for(i=0; i<framesPerBuffer; i++)
-    {
-        sample = sin(wave->phase);
-        *out++ = sample;  /* left */
-        *out++ = sample;  /* right */
-        wave->phase += phase_step;
+    float samples[FRAMES_PER_BUFFER];
+    unsigned long block;
+
+    while (framesPerBuffer > 0) {
+        block = framesPerBuffer < FRAMES_PER_BUFFER ? framesPerBuffer : FRAMES_PER_BUFFER;
+        freq_sweep_block(wave, samples, block);
+        channels_fan_out(samples, out, 2, block);
+        out += 2 * block;
+        framesPerBuffer -= block;
     }
-    wave->frequency += wave->freq_step;
+}
+
+/* Non-interleaved: the same blocks, rendered straight into the left buffer */
+static void freq_sweep_synth_planar(sine *wave, float **planes, unsigned long framesPerBuffer) {
+    unsigned long done, block;
+
+    for (done=0; done<framesPerBuffer; done+=block) {
+        block = framesPerBuffer - done < FRAMES_PER_BUFFER ? framesPerBuffer - done : FRAMES_PER_BUFFER;
+        freq_sweep_block(wave, planes[0] + done, block);
+    }
+    memcpy(planes[1], planes[0], framesPerBuffer * sizeof(float));
+}
+
+/* Every backend, live or offline, runs this on its own clock */
+static int freq_sweep_render(void *userData, void *out, unsigned long frames,
+                             double time) {
+    /* Cast data passed through stream to our structure. */
+    sine *wave = (sine*) userData;
+    (void) time;
+
+    if (wave->ahead != NULL)
+        render_ahead_read(wave->ahead, out, frames);
+    else if (wave->planar)
+        freq_sweep_synth_planar(wave, out, frames);
+    else
+        freq_sweep_synth(wave, out, frames);
     return 0;
 }
 
+/* Control thread: post the changes read from standard input */
+static void *freq_sweep_control(void *data) {
+    param_bank *params = data;
+    char line[256], name;
+    float value, ms;
+    int fields;
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        ms = CONTROL_RAMP_IN_MS;
+        fields = sscanf(line, " %c %f %f", &name, &value, &ms);
+        if (fields >= 2 && name == 'f' && value > 0)
+            param_post(params, PARAM_FREQUENCY, value, ms * SAMPLE_RATE_IN_HZ / 1000,
+                       PARAM_EXPONENTIAL, PARAM_NOW);
+        else if (fields >= 2 && name == 'g')
+            param_post(params, PARAM_GAIN, value, ms * SAMPLE_RATE_IN_HZ / 1000,
+                       PARAM_LINEAR, PARAM_NOW);
+        else
+            fprintf(stderr, "Expected f Hz [ms] or g gain [ms]\n");
+    }
+    return NULL;
+}
+
 int main(int argc, char *argv[]) {
 
-    PaStream *stream;
-    PaError err;
+    int err;
+    engine_config config = { NULL, NULL, 2, SAMPLE_RATE_IN_HZ, FRAMES_PER_BUFFER, 0, 0 };
+    unsigned long ahead_frames = 0;
+    render_ahead ahead;
+    pthread_t control;
+    int opt, planar = 0, controlled = 0;
      
-    printf("PortAudio Test: output frequency swept sine wave.\n");
+    printf("Audio Test: output frequency swept sine wave.\n");
     /* Initialize our data for use by callback. */
     sine waveform;
+    wavetable table;
 
     float sine_start_freq = (float) SINE_START_FREQ_IN_HZ;
     float sine_stop_freq = (float) SINE_STOP_FREQ_IN_HZ;
     unsigned int duration = DURATION_IN_SECONDS;
     
-    if (argc==4) {
+    while ((opt = getopt(argc, argv, "o:a:nB:d:c")) != -1) {
+        if (opt == 'o') {
+            /* Shorthand for -B null -d file */
+            config.backend = "null";
+            config.device = optarg;
+        } else if (opt == 'B') {
+            config.backend = optarg;
+        } else if (opt == 'd') {
+            config.device = optarg;
+        } else if (opt == 'a') {
+            ahead_frames = atol(optarg);
+        } else if (opt == 'n') {
+            planar = 1;
+        } else if (opt == 'c') {
+            controlled = 1;
+        } else {
+            fprintf(stderr, "Usage: freq_sweep [-B backend] [-d device] [-o file] [-a frames | -n] [-c] [duration start_freq stop_freq [waveform]]\n");
+            fprintf(stderr, "Backends: %s\n", engine_backends());
+            return 1;
+        }
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (planar && ahead_frames > 0) {
+        fprintf(stderr, "Rendering ahead needs an interleaved stream\n");
+        return 1;
+    }
+    waveform.table = NULL;
+    waveform.ahead = NULL;
+    waveform.planar = planar;
+    config.planar = planar;
+    if (argc==4 || argc==5) {
         duration = atoi(argv[1]);
         sine_start_freq = atof(argv[2]);
         sine_stop_freq = atof(argv[3]);
     }
+    /* Optional waveform: sine, saw, square, triangle or harmonic amplitudes */
+    if (argc==5) {
+        if (wavetable_build_named(&table, argv[4], SAMPLE_RATE_IN_HZ) < 0) {
+            fprintf(stderr, "Unknown waveform %s\n", argv[4]);
+            return 1;
+        }
+        waveform.table = &table;
+    }
 
-    unsigned int iterations = (unsigned int)
-                              ((float) duration / ((float) FRAMES_PER_BUFFER / (float) SAMPLE_RATE_IN_HZ));
+    float initial[NB_PARAMS] = { sine_start_freq, 1 };
 
-    waveform.frequency = (float) SINE_START_FREQ_IN_HZ;
-    waveform.phase = 0.0;
-    waveform.freq_step = (sine_stop_freq - sine_start_freq) / iterations;
-    
-    /* Initialize library before making any other calls. */
-    err = Pa_Initialize();
-    if( err != paNoError ) goto error;
-    
-    /* Open an audio I/O stream. */
-    err = Pa_OpenDefaultStream (&stream,
-                                0,          /* no input channels */
-                                2,          /* stereo output */
-                                paFloat32,  /* 32 bit floating point output */
-                                SAMPLE_RATE_IN_HZ,
-                                FRAMES_PER_BUFFER,
-                                freq_sweep_callback,
-                                &waveform);
-    if( err != paNoError ) goto error;
- 
-    err = Pa_StartStream( stream );
-    if( err != paNoError ) goto error;
- 
-    /* Sleep for several seconds. */
-    Pa_Sleep(duration*1000);
- 
-    err = Pa_StopStream( stream );
-    if( err != paNoError ) goto error;
-    
-    err = Pa_CloseStream( stream );
-    if( err != paNoError ) goto error;
-    
-    Pa_Terminate();
+    nco_init(&waveform.osc, sine_start_freq, SAMPLE_RATE_IN_HZ);
+    if (param_bank_init(&waveform.params, NB_PARAMS, initial, 64) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+    /* The whole sweep is one ramp, posted before anything plays */
+    param_post(&waveform.params, PARAM_FREQUENCY, sine_stop_freq,
+               duration * SAMPLE_RATE_IN_HZ, PARAM_LINEAR, PARAM_NOW);
+    config.duration = duration;
+
+    /* The null backend's clock would outrun the producer thread */
+    if (ahead_frames > 0 && (config.backend == NULL || strcmp(config.backend, "null") != 0)) {
+        if (render_ahead_start(&ahead, freq_sweep_synth, &waveform, 2, SAMPLE_RATE_IN_HZ,
+                               FRAMES_PER_BUFFER, ahead_frames) < 0) {
+            fprintf(stderr, "Could not start the rendering thread\n");
+            return 1;
+        }
+        waveform.ahead = &ahead;
+    }
+
+    if (controlled && pthread_create(&control, NULL, freq_sweep_control, &waveform.params) != 0) {
+        fprintf(stderr, "Could not start the control thread\n");
+        controlled = 0;
+    }
+
+    err = engine_run(&config, freq_sweep_render, &waveform);
+
+    if (controlled) {
+        /* Waiting for input: fgets() is a cancellation point */
+        pthread_cancel(control);
+        pthread_join(control, NULL);
+    }
+    if (waveform.ahead != NULL) {
+        render_ahead_stop(&ahead);
+        render_ahead_print(&ahead);
+    }
+    if (waveform.table != NULL)
+        wavetable_free(&table);
+    param_bank_free(&waveform.params);
+    if (err < 0)
+        return 1;
     printf("Test finished.\n");
-    return err;
-
-error:
-    Pa_Terminate();
-    fprintf( stderr, "An error occured while using the portaudio stream\n" );
-    fprintf( stderr, "Error number: %d\n", err );
-    fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
-    return err;
-}
\ No newline at end of file
+    return 0;
+}
@@ -2,6 +2,15 @@
 /* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
 /* SPDX-License-Identifier: GPL-3.0-or-later                                  */
 /* A simple frequency sweep program to test PortAudio                         */
+/* With -o file the sweep is rendered offline into a WAV (.wav) or raw float  */
+/* file as fast as possible, without a sound device, and the callback times   */
+/* are those of the virtual clock of the file                                 */
+/* The tone plays from a float phase wrapped to [0, 2*pi) after every sample, */
+/* the range of the sine kernel; unwrapped float and double accumulators run  */
+/* beside it only for the study: their difference is traced to a binary file  */
+/* (-t, diag.trace by default) while playing, optionally keeping one value in */
+/* N (-d N) or the minimum and maximum of every N (-m).                       */
+/* trace_dump converts the trace, or a slice of it, back to text.             */
 /******************************************************************************/
 
 #include <stdio.h>
@@ -9,6 +18,13 @@
 #include <math.h>
 #include <portaudio.h>
 #include <strings.h>
+#include <unistd.h>
+#include "sine.h"
+#include "offline.h"
+#include "trace.h"
+#include "channels.h"
+#include "rt_arena.h"
+#include "rt_check.h"
 
 #define DURATION_IN_SECONDS   (10)
 #define SAMPLE_RATE_IN_HZ   (44100)
@@ -25,11 +41,11 @@ typedef struct {
     PaTime *callback_invoked_time;
     PaTime *first_sample_dac_time;
     PaTime *callback_done_time;
-    PaStream *stream;
+    PaStream *stream; /* NULL when rendering offline */
     int counter;
     int disc_count;
     int log;
-    double *differences;
+    trace_writer *trace;
 } sine;
 
 
@@ -43,45 +59,64 @@ static int freq_sweep_callback (const void *inputBuffer, void *outputBuffer,
     /* Cast data passed through stream to our structure. */
     sine *wave = (sine*) userData;
 
+    rt_check_enter();
     *(wave->callback_invoked_time) = timeInfo->currentTime;
     wave->callback_invoked_time++; 
     *(wave->first_sample_dac_time) = timeInfo->outputBufferDacTime;
     wave->first_sample_dac_time++;
 
     float *out = (float*) outputBuffer;
-    double sample_wrapped, sample_unwrapped;
-    unsigned int i;
+    float samples[FRAMES_PER_BUFFER];
+    float differences[FRAMES_PER_BUFFER];
+    unsigned long i, block;
     (void) inputBuffer; /* Prevent unused variable warning. */
     double phase_step = 2*M_PI*(wave->frequency)/(double)SAMPLE_RATE_IN_HZ;
     double discrepancy;
 
     /* fprintf(stderr,"fpb %d f %.1f\n", framesPerBuffer, wave->frequency); */
-    for(i=0; i<framesPerBuffer; i++)
-    {
-        *(wave->differences++) = wave->phase_unwrapped - wave->phase_d; 
-        sample_wrapped = sin(wave->phase_wrapped);
-        sample_unwrapped = sin(wave->phase_unwrapped);
-        *out++ = sample_unwrapped;  /* left */
-        *out++ = sample_unwrapped;  /* right */
-        wave->phase_wrapped += phase_step;
-        wave->phase_unwrapped += phase_step;
-        wave->phase_d += phase_step;
-        discrepancy = wave->phase_d - wave->phase_unwrapped;
-        if( wave->phase_wrapped > 2*M_PI )
-            wave->phase_wrapped -= 2 * M_PI;
+    while (framesPerBuffer > 0) {
+        block = framesPerBuffer < FRAMES_PER_BUFFER ? framesPerBuffer : FRAMES_PER_BUFFER;
+        /* The accumulators under study stay serial, one add per sample; */
+        /* only the sines are batched                                     */
+        for(i=0; i<block; i++)
+        {
+            differences[i] = wave->phase_unwrapped - wave->phase_d;
+            samples[i] = wave->phase_wrapped;
+            wave->phase_wrapped += phase_step;
+            wave->phase_unwrapped += phase_step;
+            wave->phase_d += phase_step;
+            discrepancy = wave->phase_d - wave->phase_unwrapped;
+            if( wave->phase_wrapped >= 2*M_PI )
+                wave->phase_wrapped -= 2 * M_PI;
+        }
+        trace_push(wave->trace, differences, block);
+        sine_block(samples, samples, block);
+        channels_fan_out(samples, out, 2, block);
+        out += 2 * block;
+        framesPerBuffer -= block;
     }
     wave->frequency += wave->freq_step;
-    *(wave->callback_done_time) = Pa_GetStreamTime(wave->stream); 
+    *(wave->callback_done_time) = wave->stream != NULL ?
+                                  Pa_GetStreamTime(wave->stream) : timeInfo->currentTime;
     wave->callback_done_time++;
     wave->counter++;
     if ((wave->log==1) && ((discrepancy > 1.0) || (discrepancy < -1.0))) {
         wave->log = 0;
         wave->disc_count = wave->counter - 1;
     }
+    rt_check_leave();
         
     return 0;   
 }
 
+/* Offline rendering runs the same callback on a virtual clock */
+static void freq_sweep_render(void *data, void *out, unsigned long frames,
+                              double time) {
+    PaStreamCallbackTimeInfo timeInfo = {time, time, time};
+
+    freq_sweep_callback(NULL, out, frames, &timeInfo, 0, data);
+}
+
 int main(int argc, char *argv[]) {
 
     PaStream *stream;
@@ -94,6 +129,12 @@ int main(int argc, char *argv[]) {
     float slack;
 
     PaStreamParameters outputParameters;
+    const char *output = NULL; /* file to render to instead of playing */
+    const char *trace_path = "diag.trace";
+    unsigned int decimation = 1;
+    int minmax = 0, opt;
+    trace_writer trace;
+    rt_arena arena; /* the callback times */
      
     printf("PortAudio Test: output frequency swept sine wave.\n");
     /* Initialize our data for use by callback. */
@@ -103,9 +144,25 @@ int main(int argc, char *argv[]) {
     float sine_stop_freq = (float) SINE_STOP_FREQ_IN_HZ;
     unsigned int duration = DURATION_IN_SECONDS;
     unsigned int iterations;
-    FILE *fp;
-    char double_string[20];
-    double *differences;
+
+    while ((opt = getopt(argc, argv, "o:t:d:m")) != -1) {
+        if (opt == 'o') {
+            output = optarg;
+        } else if (opt == 't') {
+            trace_path = optarg;
+        } else if (opt == 'd' && atoi(optarg) > 0) {
+            decimation = atoi(optarg);
+        } else if (opt == 'm') {
+            minmax = 1;
+        } else {
+            fprintf(stderr, "Usage: freq_sweep [-o file] [-t trace] [-d decimation] [-m] "
+                    "[duration start_freq stop_freq]\n");
+            return 1;
+        }
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
 
     if (argc==4) {
         duration = atoi(argv[1]);
@@ -126,17 +183,38 @@ int main(int argc, char *argv[]) {
     
     /* Being conservative in the size to account for the non-exact duration of sound */
     /* when using Pa_Sleep() (taking actually twice the memory we need in principle) */
-    waveform.callback_invoked_time = malloc(2*iterations*sizeof(PaTime));
-    waveform.first_sample_dac_time = malloc(2*iterations*sizeof(PaTime));
-    waveform.callback_done_time = malloc(2*iterations*sizeof(PaTime));
-
-    waveform.differences = malloc(2*iterations*FRAMES_PER_BUFFER*sizeof(double));
-    differences = waveform.differences;
+    /* The arena is touched up front, so the callback never takes a page fault.      */
+    if (rt_arena_init(&arena, 3 * rt_arena_size(2*iterations*sizeof(PaTime))) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        return 1;
+    }
+    waveform.callback_invoked_time = rt_arena_alloc(&arena, 2*iterations*sizeof(PaTime));
+    waveform.first_sample_dac_time = rt_arena_alloc(&arena, 2*iterations*sizeof(PaTime));
+    waveform.callback_done_time = rt_arena_alloc(&arena, 2*iterations*sizeof(PaTime));
+
+    if (trace_writer_open(&trace, trace_path, SAMPLE_RATE_IN_HZ, decimation,
+                          minmax, FRAMES_PER_BUFFER) < 0) {
+        fprintf(stderr, "Cannot write the trace to %s\n", trace_path);
+        return 1;
+    }
+    waveform.trace = &trace;
 
     invoked_start = waveform.callback_invoked_time;
     first_start = waveform.first_sample_dac_time;
     done_start = waveform.callback_done_time;
 
+    if (output != NULL) {
+        waveform.stream = NULL;
+        trace.wait = 1; /* no deadline to miss, keep every value */
+        waveform.log = 1;
+        if (offline_render(output, OFFLINE_FLOAT32, 2, SAMPLE_RATE_IN_HZ,
+                           FRAMES_PER_BUFFER, duration, freq_sweep_render,
+                           &waveform) < 0)
+            return 1;
+        err = paNoError;
+        goto results;
+    }
+
     /* Initialize library before making any other calls. */
     err = Pa_Initialize();
     if( err != paNoError ) goto error;
@@ -203,6 +281,7 @@ err = Pa_OpenStream(
     Pa_Terminate();
     printf("Test finished.\n");
  
+results:
     waveform.callback_invoked_time = invoked_start;
     waveform.first_sample_dac_time = first_start;
     waveform.callback_done_time = done_start;
@@ -213,22 +292,16 @@ err = Pa_OpenStream(
         invoked_start++;
     }
 
-    fp = fopen("diag.txt", "w");
-
-    waveform.differences = differences;
-    for(i=0; i<FRAMES_PER_BUFFER*iterations; i++) {
-        fprintf(fp, "%10.5f\n", *(waveform.differences++));
-    }
-
-    fclose(fp);
+    if (trace_writer_close(&trace) < 0)
+        fprintf(stderr, "Error writing the trace to %s\n", trace_path);
+    printf("Traced %lu points to %s, %lu dropped; trace_dump %s prints them\n",
+           trace.written / (minmax ? 2 : 1), trace_path,
+           atomic_load(&trace.dropped) / (minmax ? 2 : 1), trace_path);
 
     if (waveform.log == 0) 
         printf("Discrepancy detected at iteration number %d\n", waveform.disc_count);
 
-    free(waveform.callback_invoked_time);
-    free(waveform.first_sample_dac_time);
-    free(waveform.callback_done_time);
-    free(differences);
+    rt_arena_free(&arena);
 
     return err;
 
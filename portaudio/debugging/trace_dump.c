@@ -0,0 +1,51 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Prints a trace written by freq_sweep as text, one point per line, in the   */
+/* format of the old diag.txt; summarised traces print the minimum and        */
+/* maximum of each point. An optional first point and count print a slice.    */
+/* Usage: trace_dump trace [first [count]]                                    */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+#define POINTS_PER_READ (4096)
+
+int main(int argc, char *argv[]) {
+    static float points[2 * POINTS_PER_READ];
+    trace_reader trace;
+    unsigned long first = 0, count, n, i;
+
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "Usage: trace_dump trace [first [count]]\n");
+        return 1;
+    }
+    if (trace_reader_open(&trace, argv[1]) < 0) {
+        fprintf(stderr, "%s is not a trace\n", argv[1]);
+        return 1;
+    }
+    if (argc >= 3)
+        first = strtoul(argv[2], NULL, 10);
+    count = argc == 4 ? strtoul(argv[3], NULL, 10) : trace.points;
+    fprintf(stderr, "%lu points at %g Hz, one per %u values%s\n", trace.points,
+            trace.rate, trace.decimation, trace.minmax ? " (minimum and maximum)" : "");
+
+    while (count > 0) {
+        n = trace_read(&trace, points, first,
+                       count < POINTS_PER_READ ? count : POINTS_PER_READ);
+        if (n == 0)
+            break;
+        for (i=0; i<n; i++) {
+            if (trace.minmax)
+                printf("%10.5f %10.5f\n", points[2*i], points[2*i+1]);
+            else
+                printf("%10.5f\n", points[i]);
+        }
+        first += n;
+        count -= n;
+    }
+    trace_reader_close(&trace);
+    return 0;
+}
@@ -8,64 +8,220 @@
 /* ./fm_test 0.6 440 440 5                                                    */
 /* reproduces a brass-like tone using simple frequency modulation as          */
 /* described in page 7 of the paper                                           */
+/* An optional fifth argument plays that many brass voices at once, spread    */
+/* over a few cents, through the polyphonic voice pool in dsp/fm_voices,      */
+/* and an optional sixth argument spreads their rendering over that many      */
+/* threads (dsp/render_pool):                                                 */
+/* ./fm_test 0.6 440 440 5 256 4                                              */
+/* It plays through the engine library (engine/): -B picks the backend        */
+/* (portaudio, alsa, alsa-mmap or null) and -d its device. With -o file the   */
+/* tone is rendered by the null backend into a WAV (.wav) or raw float file   */
+/* as fast as possible, without a sound device                                */
+/* With -a frames a producer thread renders that many frames ahead of the     */
+/* callback (dsp/render_ahead), which then only copies them out               */
+/* With -g the voices are built as a node graph (dsp/graph) of modulator,     */
+/* envelope, operator and gain nodes feeding a mixer, instead of the fused    */
+/* loops of the voice pool; the threads argument does not apply then          */
+/* With -g, -k frames sets how often the envelopes are evaluated, from 1      */
+/* (every sample) to 64, the frames in between being interpolated; the graph  */
+/* default is 32                                                              */
+/* With -g, -c also starts a control thread that reads changes of the         */
+/* modulation index and of the gain from standard input while playing, one    */
+/* per line, ramped per sample over an optional time in ms (dsp/param):       */
+/*   i 2 300       bring the index to 2 in 300 ms                             */
+/*   g 0.5         fade to a gain of 0.5 in 20 ms                             */
+/* With -p preset the voices are multi-operator patches (dsp/fm_ops) instead, */
+/* and the modulator arguments go: the envelopes are the preset's, released   */
+/* in time to end with the duration. The brass preset is the tone above:      */
+/* ./fm_test -p brass 0.6 440                                                 */
+/* ./fm_test -p epiano 2 220 16                                               */
 /******************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <portaudio.h>
+#include <string.h>
 #include <math.h>
-#include "adsr.h"
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include "fm_voices.h"
+#include "fm_ops.h"
+#include "render_pool.h"
+#include "graph.h"
+#include "param.h"
+#include "engine.h"
+#include "render_ahead.h"
+#include "channels.h"
 
 #define SAMPLE_RATE_IN_HZ   (44100)
 #define FRAMES_PER_BUFFER (1024)
+#define DETUNE_IN_CENTS (20) /* spread of the voices when playing several */
+#define CONTROL_RAMP_IN_MS (20)
+#define CONTROL_POLL_IN_MS (100) /* how soon the control thread sees it must stop */
+
+enum { PARAM_INDEX, PARAM_GAIN, NB_PARAMS };
 
 
 typedef struct {
-    double t;
-    double time_step;
-    double phase;
-    double phase_step;
-    double freq;
-    double mod_freq;
-    double mod_index;
-    double attack;
-    double decay;
-    double sustain;
-    double sustain_level;
-    double release;
-} pa_data;
-
-static int fm_test_callback (const void *inputBuffer, void *outputBuffer,
-                           unsigned long framesPerBuffer,
-                           const PaStreamCallbackTimeInfo* timeInfo,
-                           PaStreamCallbackFlags statusFlags,
-                           void *userData) {
-    
-    pa_data *data = (pa_data*) userData;
-    (void) inputBuffer; /* Prevent unused argument warning. */
-    float *out = (float*) outputBuffer;
-    int i;
-    float sample;
-    double inst_freq;
-    double adsr_val;
-
-
-    for (i=0; i<framesPerBuffer; i++) {
-        adsr_val = adsr(data->t, data->attack, data->decay, data->sustain, data->sustain_level, data->release);
-        inst_freq = data->freq + data->mod_index * adsr_val * data->mod_freq * 
-                    sin(2 * M_PI * data->mod_freq * data->t); 
-        sample = adsr_val * sin(data->phase);
-        *out++ = sample; /*left */
-        *out++ = sample; /* right */
-        data->t += data->time_step;
-        data->phase_step = 2 * M_PI * inst_freq * data->time_step;
-        data->phase += data->phase_step;
-        while (data->phase > 2*M_PI)
-            data->phase -= 2*M_PI;
-        while (data->phase < 0)
-            data->phase += 2*M_PI;
+    fm_pool pool;
+    render_pool renderer;
+    render_ahead *ahead; /* NULL when rendering in the callback */
+    graph *voices;       /* NULL when rendering with the pool */
+    param_bank params;   /* index and gain of the graph */
+    fm_ops *ops;         /* NULL unless playing a preset */
+    unsigned long frame; /* preset: frames rendered so far */
+    unsigned long note_off; /* preset: frame where its notes are released */
+    unsigned int *notes; /* preset: ids of its notes */
+    unsigned int nb_notes;
+    atomic_int stop_control; /* set to end the control thread */
+} fm_data;
+
+/* One voice of the pool, as graph nodes summed into mix, its modulation */
+/* index scaled by the index node                                         */
+static int fm_test_graph_voice(graph *g, int mix, int index, const fm_patch *patch) {
+    int mod, env, op, gain, depth;
+
+    if ((mod = graph_osc(g, patch->mod_frequency, 1)) < 0 ||
+        (env = graph_env(g, patch->attack, patch->decay, patch->sustain,
+                         patch->sustain_level, patch->release)) < 0 ||
+        (op = graph_fm(g, patch->frequency, patch->mod_frequency)) < 0 ||
+        (depth = graph_gain(g, 1)) < 0 ||
+        (gain = graph_gain(g, patch->gain)) < 0)
+        return -1;
+    if (graph_connect(g, mod, op, GRAPH_FM_MOD) < 0 ||
+        graph_connect(g, env, depth, GRAPH_GAIN_IN) < 0 ||
+        graph_connect(g, index, depth, GRAPH_GAIN_MOD) < 0 ||
+        graph_connect(g, depth, op, GRAPH_FM_INDEX) < 0 ||
+        graph_connect(g, op, gain, GRAPH_GAIN_IN) < 0 ||
+        graph_connect(g, env, gain, GRAPH_GAIN_MOD) < 0 ||
+        graph_connect(g, gain, mix, 0) < 0)
+        return -1;
+    return 0;
+}
+
+/* Split where parameter changes land, the graph ramps the parameters */
+static int fm_test_graph_render(fm_data *data, float *out, unsigned long frames) {
+    unsigned long run;
+    int silent = 1;
+
+    while (frames > 0) {
+        run = param_bank_update(&data->params, frames);
+        if (!graph_render(data->voices, out, run))
+            silent = 0;
+        param_bank_advance(&data->params, run);
+        out += run;
+        frames -= run;
     }
+    return silent;
+}
+
+/* Split where the notes of the preset are released */
+static int fm_test_ops_render(fm_data *data, float *out, unsigned long frames) {
+    unsigned long run;
+    unsigned int i;
 
+    if (data->ops->active == 0)
+        return 1;
+    while (frames > 0) {
+        /* Released before rendering, so a note_off of 0 releases at once */
+        if (data->frame == data->note_off)
+            for (i=0; i<data->nb_notes; i++)
+                fm_ops_note_off(data->ops, data->notes[i]);
+        run = frames;
+        if (data->frame < data->note_off && data->note_off - data->frame < run)
+            run = data->note_off - data->frame;
+        fm_ops_render(data->ops, out, run);
+        data->frame += run;
+        out += run;
+        frames -= run;
+    }
+    return 0;
+}
+
+/* Post the change on one line of input */
+static void fm_test_control_line(param_bank *params, const char *line) {
+    char name;
+    float value, ms = CONTROL_RAMP_IN_MS;
+    int fields;
+
+    fields = sscanf(line, " %c %f %f", &name, &value, &ms);
+    if (fields >= 2 && (name == 'i' || name == 'g'))
+        param_post(params, name == 'i' ? PARAM_INDEX : PARAM_GAIN, value,
+                   ms * SAMPLE_RATE_IN_HZ / 1000, PARAM_LINEAR, PARAM_NOW);
+    else
+        fprintf(stderr, "Expected i index [ms] or g gain [ms]\n");
+}
+
+/* Control thread: post the changes read from standard input. It polls the */
+/* descriptor and reads it with read(), never blocking in stdio, so it sees */
+/* stop_control and can be joined without being cancelled.                  */
+static void *fm_test_control(void *userData) {
+    fm_data *data = userData;
+    struct pollfd input = { STDIN_FILENO, POLLIN, 0 };
+    char line[256], *end;
+    size_t used = 0;
+    ssize_t n;
+
+    while (!atomic_load(&data->stop_control)) {
+        if (poll(&input, 1, CONTROL_POLL_IN_MS) <= 0)
+            continue;
+        n = read(STDIN_FILENO, line + used, sizeof(line) - 1 - used);
+        if (n <= 0)
+            break;                      /* end of input */
+        used += n;
+        while ((end = memchr(line, '\n', used)) != NULL) {
+            *end = '\0';
+            fm_test_control_line(&data->params, line);
+            used -= end + 1 - line;
+            memmove(line, end + 1, used);
+        }
+        if (used == sizeof(line) - 1)
+            used = 0;                   /* a line too long for the buffer is dropped */
+    }
+    return NULL;
+}
+
+/* Render frames, returns non-zero if they are all zeros. Silent blocks, */
+/* once every voice has finished, cost neither synthesis nor fan out.     */
+static int fm_test_block(fm_data *data, float *out, unsigned long framesPerBuffer) {
+    float samples[FRAMES_PER_BUFFER];
+    unsigned long block;
+    int silent, all = 1;
+
+    while (framesPerBuffer > 0) {
+        block = framesPerBuffer < FRAMES_PER_BUFFER ? framesPerBuffer : FRAMES_PER_BUFFER;
+        if (data->ops != NULL)
+            silent = fm_test_ops_render(data, samples, block);
+        else if (data->voices != NULL)
+            silent = fm_test_graph_render(data, samples, block);
+        else if ((silent = data->pool.active == 0) == 0)
+            render_pool_render(&data->renderer, samples, block);
+        if (silent)
+            memset(out, 0, 2 * block * sizeof(float));
+        else {
+            channels_fan_out(samples, out, 2, block);
+            all = 0;
+        }
+        out += 2 * block;
+        framesPerBuffer -= block;
+    }
+    return all;
+}
+
+static void fm_test_synth(void *userData, float *out, unsigned long framesPerBuffer) {
+    fm_test_block((fm_data*) userData, out, framesPerBuffer);
+}
+
+/* Every backend, live or offline, runs this on its own clock */
+static int fm_test_render(void *userData, void *out, unsigned long frames,
+                          double time) {
+    fm_data *data = (fm_data*) userData;
+
+    (void) time;
+    if (data->ahead == NULL)
+        return fm_test_block(data, out, frames);
+    render_ahead_read(data->ahead, out, frames);
     return 0;
 }
 
@@ -75,73 +231,210 @@ int main(int argc, char *argv[]) {
 
     double frequency, mod_frequency, mod_index,
            attack, decay, sustain, sustain_level, release, duration;
-    int i;
-    PaStream *stream;
-    PaError err;
-    pa_data data;
+    unsigned int i, voices = 1, threads = 1;
+    double detune;
+    int err;
+    fm_data data;
+    fm_patch patch;
+    fm_ops ops;
+    const fm_ops_patch *preset = NULL;
+    const char *preset_name = NULL;
+    render_ahead ahead;
+    graph voices_graph;
+    int mix = -1, index = -1, gain, master, output;
+    float initial[NB_PARAMS];
+    pthread_t control;
+    engine_config config = { NULL, NULL, 2, SAMPLE_RATE_IN_HZ, FRAMES_PER_BUFFER, 0, 0 };
+    unsigned long ahead_frames = 0;
+    int opt, use_graph = 0, controlled = 0, control_rate = GRAPH_CONTROL;
+
+    while ((opt = getopt(argc, argv, "o:a:B:d:gck:p:")) != -1) {
+        if (opt == 'o') {
+            /* Shorthand for -B null -d file */
+            config.backend = "null";
+            config.device = optarg;
+        } else if (opt == 'B')
+            config.backend = optarg;
+        else if (opt == 'd')
+            config.device = optarg;
+        else if (opt == 'a')
+            ahead_frames = atol(optarg);
+        else if (opt == 'g')
+            use_graph = 1;
+        else if (opt == 'c')
+            controlled = 1;
+        else if (opt == 'k')
+            control_rate = atoi(optarg);
+        else if (opt == 'p')
+            preset_name = optarg;
+        else
+            argc = 0;
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
   
-    if (argc != 5) {
+    if (preset_name != NULL && (use_graph || argc < 3 || argc > 4))
+        argc = 0;
+    if (control_rate < 1 || control_rate > GRAPH_CONTROL_MAX)
+        argc = 0;
+    if (argc != 0 && preset_name == NULL && (argc < 5 || argc > 7))
+        argc = 0;
+    if (argc == 0) {
         fprintf(stderr, "Wrong number of arguments.\n");
         fprintf(stderr, "Usage:\n");
-        fprintf(stderr, "fm_test duration frequency mod_frequency mod_index\n");
+        fprintf(stderr, "fm_test [-B backend] [-d device] [-o file] [-a frames] [-g [-c] [-k frames]] duration frequency mod_frequency mod_index [voices [threads]]\n");
+        fprintf(stderr, "fm_test -p preset [-B backend] [-d device] [-o file] [-a frames] duration frequency [voices]\n");
+        fprintf(stderr, "Backends: %s\n", engine_backends());
+        fprintf(stderr, "Presets: %s\n", fm_ops_presets());
+        return 0;
+    }
+    if (preset_name != NULL && (preset = fm_ops_preset(preset_name)) == NULL) {
+        fprintf(stderr, "Unknown preset %s, presets: %s\n", preset_name, fm_ops_presets());
         return 0;
     }
 
     duration = atof(argv[1]);
+    config.duration = duration;
     frequency = atof(argv[2]);
-    mod_frequency = atof(argv[3]);
-    mod_index = atof(argv[4]);
+    if (preset != NULL) {
+        mod_frequency = mod_index = 0;
+        if (argc == 4)
+            voices = atoi(argv[3]);
+    } else {
+        mod_frequency = atof(argv[3]);
+        mod_index = atof(argv[4]);
+        if (argc >= 6)
+            voices = atoi(argv[5]);
+        if (argc == 7)
+            threads = atoi(argv[6]);
+    }
     attack = duration / 6;
     decay = attack;
     sustain = duration / 2;
     sustain_level = 0.5;
     release = attack;
+    if (voices < 1)
+        voices = 1;
+
+    /* All voices are allocated here, the callback never allocates */
+    data.voices = NULL;
+    data.ops = NULL;
+    if (preset != NULL) {
+        data.notes = malloc(voices * sizeof(unsigned int));
+        if (data.notes == NULL || fm_ops_init(&ops, voices, SAMPLE_RATE_IN_HZ, preset) < 0) {
+            fprintf(stderr, "Not enough memory for %u voices\n", voices);
+            return -1;
+        }
+        /* Released so that the longest carrier release ends with the duration */
+        for (i=0, release=0; i<preset->algorithm->operators; i++)
+            if (preset->algorithm->carriers & (1u << i) && preset->op[i].release > release)
+                release = preset->op[i].release;
+        data.frame = 0;
+        data.note_off = duration > release ? (duration - release) * SAMPLE_RATE_IN_HZ : 0;
+        data.nb_notes = voices;
+        data.ops = &ops;
+    } else if (use_graph) {
+        /* Voices mixed, then the master gain; the index scales every voice */
+        initial[PARAM_INDEX] = mod_index;
+        initial[PARAM_GAIN] = 1;
+        if (param_bank_init(&data.params, NB_PARAMS, initial, 64) < 0 ||
+            graph_init(&voices_graph, SAMPLE_RATE_IN_HZ, FRAMES_PER_BUFFER) < 0 ||
+            graph_control(&voices_graph, control_rate) < 0 ||
+            (mix = graph_mix(&voices_graph, 1)) < 0 ||
+            (master = graph_gain(&voices_graph, 1)) < 0 ||
+            (output = graph_output(&voices_graph)) < 0 ||
+            (index = graph_param(&voices_graph, &data.params.params[PARAM_INDEX])) < 0 ||
+            (gain = graph_param(&voices_graph, &data.params.params[PARAM_GAIN])) < 0 ||
+            graph_connect(&voices_graph, mix, master, GRAPH_GAIN_IN) < 0 ||
+            graph_connect(&voices_graph, gain, master, GRAPH_GAIN_MOD) < 0 ||
+            graph_connect(&voices_graph, master, output, GRAPH_OUTPUT_IN) < 0) {
+            fprintf(stderr, "Not enough memory for the graph\n");
+            return -1;
+        }
+        data.voices = &voices_graph;
+    } else if (fm_pool_init(&data.pool, voices, SAMPLE_RATE_IN_HZ) < 0) {
+        fprintf(stderr, "Not enough memory for %u voices\n", voices);
+        return -1;
+    }
+    patch.mod_index = mod_index;
+    patch.gain = 1.0 / voices;
+    patch.attack = attack;
+    patch.decay = decay;
+    patch.sustain = sustain;
+    patch.sustain_level = sustain_level;
+    patch.release = release;
+    for (i=0; i<voices; i++) {
+        /* Keep the carrier to modulator ratio of every voice */
+        detune = voices > 1 ? DETUNE_IN_CENTS * ((double)i / (voices - 1) - 0.5) : 0;
+        patch.frequency = frequency * pow(2, detune / 1200);
+        patch.mod_frequency = mod_frequency * pow(2, detune / 1200);
+        if (data.ops != NULL)
+            data.notes[i] = fm_ops_note_on(data.ops, patch.frequency, patch.gain);
+        else if (data.voices == NULL)
+            fm_pool_note_on(&data.pool, &patch);
+        else if (fm_test_graph_voice(data.voices, mix, index, &patch) < 0) {
+            fprintf(stderr, "Not enough memory for %u voices\n", voices);
+            return -1;
+        }
+    }
+    if (data.ops != NULL) {
+        printf("%s: %u operators\n", preset->name, preset->algorithm->operators);
+    } else if (data.voices != NULL) {
+        if (graph_compile(data.voices) < 0) {
+            fprintf(stderr, "Could not schedule the graph\n");
+            return -1;
+        }
+        printf("%u nodes in %u steps, %u buffers of %lu frames\n", data.voices->count,
+               data.voices->nb_steps, data.voices->buffers, data.voices->block);
+    } else if (render_pool_init(&data.renderer, &data.pool, threads, FRAMES_PER_BUFFER, 1) < 0) {
+        fprintf(stderr, "Could not start %u rendering threads\n", threads);
+        return -1;
+    }
+    data.ahead = NULL;
 
-    data.attack = attack;
-    data.decay = decay;
-    data.sustain = sustain;
-    data.sustain_level = sustain_level;
-    data.release = release;
-    data.phase = 0.0;
-    data.t = 0.0;
-    data.freq = frequency;
-    data.mod_freq = mod_frequency;
-    data.mod_index = mod_index;
-    data.time_step = 1.0 / SAMPLE_RATE_IN_HZ;
-    data.phase_step = 2 * M_PI * frequency * data.time_step;
-
-    err = Pa_Initialize();
-    if( err != paNoError ) goto error;
-
-    err = Pa_OpenDefaultStream (&stream,
-                                0,           /* no input channels */ 
-                                2,           /* stereo output */
-                                paFloat32,   /* 32 bit floating point output */ 
-                                SAMPLE_RATE_IN_HZ,
-                                FRAMES_PER_BUFFER,
-                                fm_test_callback,
-                                &data);
-    if( err != paNoError ) goto error;
-
-    err = Pa_StartStream(stream);
-    if(err != paNoError) goto error;
- 
-    /* Sleep for duration of ADSR envelope*/
-    Pa_Sleep(duration*1000);
- 
-    err = Pa_StopStream(stream);
-    if(err != paNoError) goto error;
-    
-    err = Pa_CloseStream(stream);
-    if(err != paNoError) goto error;
-    
-    Pa_Terminate();
+    /* The null backend's clock would outrun the producer thread */
+    if (ahead_frames > 0 && (config.backend == NULL || strcmp(config.backend, "null") != 0)) {
+        if (render_ahead_start(&ahead, fm_test_synth, &data, 2, SAMPLE_RATE_IN_HZ,
+                               FRAMES_PER_BUFFER, ahead_frames) < 0) {
+            fprintf(stderr, "Could not start the rendering thread\n");
+            return -1;
+        }
+        data.ahead = &ahead;
+    }
+
+    atomic_init(&data.stop_control, 0);
+    if (controlled && data.voices != NULL &&
+        pthread_create(&control, NULL, fm_test_control, &data) != 0) {
+        fprintf(stderr, "Could not start the control thread\n");
+        controlled = 0;
+    }
+
+    /* Plays for the duration of the ADSR envelope */
+    err = engine_run(&config, fm_test_render, &data);
+
+    if (controlled && data.voices != NULL) {
+        /* It polls for input, and sees the flag within CONTROL_POLL_IN_MS */
+        atomic_store(&data.stop_control, 1);
+        pthread_join(control, NULL);
+    }
+
+    if (data.ahead != NULL) {
+        render_ahead_stop(&ahead);
+        render_ahead_print(&ahead);
+    }
+    if (data.ops != NULL) {
+        fm_ops_free(data.ops);
+        free(data.notes);
+    } else if (data.voices != NULL) {
+        graph_free(data.voices);
+        param_bank_free(&data.params);
+    } else {
+        render_pool_free(&data.renderer);
+        fm_pool_free(&data.pool);
+    }
+    if (err < 0)
+        return 1;
     printf("Test finished.\n");
-    return err;
-error:
-    Pa_Terminate();
-    fprintf(stderr, "An error occured while using the portaudio stream\n");
-    fprintf(stderr, "Error number: %d\n", err);
-    fprintf(stderr, "Error message: %s\n", Pa_GetErrorText(err));
-    return err;
-}
\ No newline at end of file
+    return 0;
+}
@@ -0,0 +1,261 @@
+/******************************************************************************/
+/* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
+/* SPDX-License-Identifier: GPL-3.0-or-later                                  */
+/* Plays a Standard MIDI File through the FM voices                           */
+/* ./smf_play song.mid                                                        */
+/* The file is loaded by dsp/smf into events stamped in frames, and the       */
+/* callback feeds them a block ahead into the scheduler of dsp/sched, which   */
+/* splits every block where a note starts or stops: notes land on their       */
+/* frame, whatever the block size. Every track and channel plays one patch,   */
+/* the brass of fm_test on the two-operator voice pool (dsp/fm_voices), or    */
+/* with -p preset a multi-operator patch (dsp/fm_ops), with -v voices at once */
+/* (64 by default, then voices are stolen). Velocity, channel volume and      */
+/* expression (controllers 7 and 11) set the level of each note, the sustain  */
+/* pedal (64) holds releases, and channel 10, General MIDI percussion, is     */
+/* left out. As fm_test, it plays through the engine library: -B picks the    */
+/* backend and -d its device, and -o file renders offline, without a sound    */
+/* device, into a WAV (.wav) or raw float file:                               */
+/* ./smf_play -o song.wav -p epiano song.mid                                  */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "fm_voices.h"
+#include "fm_ops.h"
+#include "sched.h"
+#include "smf.h"
+#include "engine.h"
+#include "channels.h"
+
+#define SAMPLE_RATE_IN_HZ   (44100)
+#define FRAMES_PER_BUFFER (1024)
+#define VOICES (64)
+#define EVENTS (4096)       /* waiting in the scheduler, about a block's worth */
+#define MASTER_GAIN (0.25)  /* headroom for chords */
+#define CHANNELS (16)
+#define KEYS (128)
+#define PERCUSSION (9)      /* channel 10 */
+
+enum { CC_VOLUME = 7, CC_EXPRESSION = 11, CC_SUSTAIN = 64, CC_ALL_SOUND_OFF = 120,
+       CC_RESET = 121, CC_ALL_NOTES_OFF = 123 };
+
+typedef struct {
+    smf file;
+    sched events;
+    fm_pool pool;
+    fm_ops *ops;                /* NULL when playing on the pool */
+    fm_patch patch;             /* pool: frequency and gain set per note */
+    unsigned int notes[CHANNELS][KEYS]; /* id of the sounding note, 0 if none */
+    unsigned char held[CHANNELS][KEYS]; /* released while the pedal is down */
+    float volume[CHANNELS];
+    float expression[CHANNELS];
+    int pedal[CHANNELS];
+    unsigned long late;         /* events that missed their frame */
+} smf_data;
+
+static void smf_play_release(smf_data *data, unsigned int channel, unsigned int key) {
+    if (data->ops != NULL)
+        fm_ops_note_off(data->ops, data->notes[channel][key]);
+    else
+        fm_pool_note_off(&data->pool, data->notes[channel][key]);
+    data->notes[channel][key] = 0;
+    data->held[channel][key] = 0;
+}
+
+static void smf_play_release_all(smf_data *data, unsigned int channel) {
+    unsigned int key;
+
+    for (key=0; key<KEYS; key++)
+        if (data->notes[channel][key] != 0)
+            smf_play_release(data, channel, key);
+}
+
+static void smf_play_event(smf_data *data, const sched_event *e) {
+    unsigned int c = e->channel, key = e->key;
+    double frequency, gain;
+
+    if (e->time < data->events.position)
+        data->late++;
+    if (e->type == SCHED_NOTE_ON && c != PERCUSSION) {
+        /* Striking a sounding key again releases it first */
+        if (data->notes[c][key] != 0)
+            smf_play_release(data, c, key);
+        frequency = 440 * pow(2, (key - 69.0) / 12);
+        gain = MASTER_GAIN * e->value * data->volume[c] * data->expression[c];
+        if (data->ops != NULL) {
+            data->notes[c][key] = fm_ops_note_on(data->ops, frequency, gain);
+        } else {
+            data->patch.frequency = frequency;
+            data->patch.mod_frequency = frequency;
+            data->patch.gain = gain;
+            data->notes[c][key] = fm_pool_note_on(&data->pool, &data->patch);
+        }
+    } else if (e->type == SCHED_NOTE_OFF && data->notes[c][key] != 0) {
+        if (data->pedal[c])
+            data->held[c][key] = 1;
+        else
+            smf_play_release(data, c, key);
+    } else if (e->type == SCHED_PARAM) {
+        if (key == CC_VOLUME)
+            data->volume[c] = e->value;
+        else if (key == CC_EXPRESSION)
+            data->expression[c] = e->value;
+        else if (key == CC_SUSTAIN) {
+            /* Lifting the pedal releases the notes it held */
+            data->pedal[c] = e->value >= 0.5f;
+            for (key=0; key<KEYS; key++)
+                if (data->held[c][key] && !data->pedal[c])
+                    smf_play_release(data, c, key);
+        } else if (key == CC_ALL_SOUND_OFF || key == CC_ALL_NOTES_OFF) {
+            smf_play_release_all(data, c);
+        } else if (key == CC_RESET) {
+            data->expression[c] = 1;
+            data->pedal[c] = 0;
+            for (key=0; key<KEYS; key++)
+                if (data->held[c][key])
+                    smf_play_release(data, c, key);
+        }
+    }
+}
+
+/* Split the block where events land; returns non-zero if it is all zeros */
+static int smf_play_render(void *userData, void *out, unsigned long frames,
+                           double time) {
+    smf_data *data = (smf_data*) userData;
+    float samples[FRAMES_PER_BUFFER];
+    float *y;
+    unsigned long block, run;
+    sched_event e;
+    int silent, all = 1;
+
+    (void) time;
+    while (frames > 0) {
+        block = frames < FRAMES_PER_BUFFER ? frames : FRAMES_PER_BUFFER;
+        /* Whatever does not fit now is posted on the next pass, late */
+        smf_feed(&data->file, &data->events, data->events.position + block);
+        for (y=samples; y<samples+block; y+=run) {
+            while (sched_next(&data->events, &e))
+                smf_play_event(data, &e);
+            run = sched_run(&data->events, samples + block - y);
+            silent = data->ops != NULL ? data->ops->active == 0 : data->pool.active == 0;
+            if (silent)
+                memset(y, 0, run * sizeof(float));
+            else if (data->ops != NULL)
+                fm_ops_render(data->ops, y, run);
+            else
+                fm_pool_render(&data->pool, y, run);
+            all &= silent;
+            sched_advance(&data->events, run);
+        }
+        channels_fan_out(samples, out, 2, block);
+        out = (float*) out + 2 * block;
+        frames -= block;
+    }
+    return all ? ENGINE_SILENT : 0;
+}
+
+int main(int argc, char *argv[]) {
+    engine_config config = { NULL, NULL, 2, SAMPLE_RATE_IN_HZ, FRAMES_PER_BUFFER, 0, 0 };
+    const fm_ops_patch *preset = NULL;
+    const char *preset_name = NULL;
+    unsigned int c, i, voices = VOICES;
+    double release;
+    smf_data *data;
+    fm_ops ops;
+    int opt, err;
+
+    while ((opt = getopt(argc, argv, "o:B:d:p:v:")) != -1) {
+        if (opt == 'o') {
+            /* Shorthand for -B null -d file */
+            config.backend = "null";
+            config.device = optarg;
+        } else if (opt == 'B')
+            config.backend = optarg;
+        else if (opt == 'd')
+            config.device = optarg;
+        else if (opt == 'p')
+            preset_name = optarg;
+        else if (opt == 'v')
+            voices = atoi(optarg);
+        else
+            argc = 0;
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc != 2 || voices < 1) {
+        fprintf(stderr, "Wrong number of arguments.\n");
+        fprintf(stderr, "Usage:\n");
+        fprintf(stderr, "smf_play [-B backend] [-d device] [-o file] [-p preset] [-v voices] file.mid\n");
+        fprintf(stderr, "Backends: %s\n", engine_backends());
+        fprintf(stderr, "Presets: %s\n", fm_ops_presets());
+        return 0;
+    }
+    if (preset_name != NULL && (preset = fm_ops_preset(preset_name)) == NULL) {
+        fprintf(stderr, "Unknown preset %s, presets: %s\n", preset_name, fm_ops_presets());
+        return 0;
+    }
+
+    /* Too big for the stack; everything the callback uses is allocated here */
+    data = calloc(1, sizeof(*data));
+    if (data == NULL || smf_load(&data->file, argv[1], SAMPLE_RATE_IN_HZ) < 0) {
+        free(data);
+        return 1;
+    }
+    if (sched_init(&data->events, EVENTS) < 0) {
+        fprintf(stderr, "Not enough memory\n");
+        smf_free(&data->file);
+        free(data);
+        return 1;
+    }
+    /* Brass, held until note off */
+    data->patch.mod_index = 5;
+    data->patch.attack = 0.05;
+    data->patch.decay = 0.1;
+    data->patch.sustain = -1;
+    data->patch.sustain_level = 0.75;
+    data->patch.release = 0.1;
+    release = data->patch.release;
+    if (preset != NULL) {
+        if (fm_ops_init(&ops, voices, SAMPLE_RATE_IN_HZ, preset) < 0) {
+            fprintf(stderr, "Not enough memory for %u voices\n", voices);
+            return 1;
+        }
+        for (i=0, release=0; i<preset->algorithm->operators; i++)
+            if (preset->algorithm->carriers & (1u << i) && preset->op[i].release > release)
+                release = preset->op[i].release;
+        data->ops = &ops;
+    } else if (fm_pool_init(&data->pool, voices, SAMPLE_RATE_IN_HZ) < 0) {
+        fprintf(stderr, "Not enough memory for %u voices\n", voices);
+        return 1;
+    }
+    for (c=0; c<CHANNELS; c++) {
+        data->volume[c] = 100 / 127.0f;
+        data->expression[c] = 1;
+    }
+
+    printf("%s: format %u, %u tracks, %lu notes, %.1f s\n", argv[1], data->file.format,
+           data->file.nb_tracks, data->file.notes,
+           (double) data->file.length / SAMPLE_RATE_IN_HZ);
+    /* Plays to the end of the file and the last release */
+    config.duration = (double) data->file.length / SAMPLE_RATE_IN_HZ + release;
+    err = engine_run(&config, smf_play_render, data);
+    if (data->late > 0)
+        printf("%lu events late: more than %d in a block\n", data->late, EVENTS);
+
+    if (data->ops != NULL)
+        fm_ops_free(data->ops);
+    else
+        fm_pool_free(&data->pool);
+    sched_free(&data->events);
+    smf_free(&data->file);
+    free(data);
+    if (err < 0)
+        return 1;
+    printf("Test finished.\n");
+    return 0;
+}
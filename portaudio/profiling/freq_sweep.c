@@ -2,31 +2,56 @@
 /* SPDX-FileCopyrightText: 2020 Javier Serrano <javi@orellut.net>             */
 /* SPDX-License-Identifier: GPL-3.0-or-later                                  */
 /* A simple frequency sweep program to test PortAudio                         */
+/* The callback records its duration, the slack left before its first sample  */
+/* reaches the DAC and the jitter of its start into fixed-size histograms     */
+/* (dsp/histogram), so memory stays constant however long the stream runs.    */
+/* Their percentiles are printed while playing, every -r seconds (default     */
+/* REPORT_SECONDS), and at the end.                                           */
+/* With -o file the sweep is rendered offline into a WAV (.wav) or raw float  */
+/* file as fast as possible, without a sound device, and the callback times   */
+/* are those of the virtual clock of the file                                 */
+/* The sweep is a chirp (dsp/chirp), its phase computed from the frame        */
+/* number, so no rounding builds up: linear, or exponential with -l           */
 /******************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <portaudio.h>
+#include "chirp.h"
+#include "offline.h"
+#include "histogram.h"
+#include "channels.h"
+#include "rt_check.h"
 #include <strings.h>
+#include <unistd.h>
 
 #define DURATION_IN_SECONDS   (10)
 #define SAMPLE_RATE_IN_HZ   (44100)
 #define SINE_START_FREQ_IN_HZ (1000)
 #define SINE_STOP_FREQ_IN_HZ (1000)
 #define FRAMES_PER_BUFFER (1024)
+#define REPORT_SECONDS (10)
 
 typedef struct {
-    double phase;
-    double frequency;
-    double freq_step;
-    PaTime *callback_invoked_time;
-    PaTime *first_sample_dac_time;
-    PaTime *callback_done_time;
-    PaStream *stream;
-    int counter;
+    chirp sweep;
+    unsigned long position;  /* frames rendered */
+    histogram duration;      /* callback invoked to done */
+    histogram slack;         /* done to first sample at the DAC */
+    histogram jitter;        /* start minus expected start */
+    PaTime last_invoked;
+    PaStream *stream; /* NULL when rendering offline */
+    unsigned long counter;
 } sine;
 
+static void print_histograms(sine *wave) {
+    printf("%-12s %10s %10s %10s %10s %10s %10s %10s\n", "ms", "count", "min",
+           "50%", "90%", "99%", "99.9%", "max");
+    histogram_print(&wave->duration, "duration", stdout);
+    histogram_print(&wave->slack, "DAC slack", stdout);
+    histogram_print(&wave->jitter, "jitter", stdout);
+}
+
 
 static int freq_sweep_callback (const void *inputBuffer, void *outputBuffer,
                            unsigned long framesPerBuffer,
@@ -37,48 +62,56 @@ static int freq_sweep_callback (const void *inputBuffer, void *outputBuffer,
 
     /* Cast data passed through stream to our structure. */
     sine *wave = (sine*) userData;
+    PaTime done, period = (double) framesPerBuffer / SAMPLE_RATE_IN_HZ;
 
-    *(wave->callback_invoked_time) = timeInfo->currentTime;
-    wave->callback_invoked_time++; 
-    *(wave->first_sample_dac_time) = timeInfo->outputBufferDacTime;
-    wave->first_sample_dac_time++;
+    rt_check_enter();
+    if (wave->counter > 0)
+        histogram_record(&wave->jitter, timeInfo->currentTime - wave->last_invoked - period);
+    wave->last_invoked = timeInfo->currentTime;
 
     float *out = (float*) outputBuffer;
-    double sample;
-    unsigned int i;
+    float samples[FRAMES_PER_BUFFER];
+    unsigned long block;
     (void) inputBuffer; /* Prevent unused variable warning. */
-    double phase_step = 2*M_PI*(wave->frequency)/(double)SAMPLE_RATE_IN_HZ;
-
-
-    /* fprintf(stderr,"fpb %d f %.1f\n", framesPerBuffer, wave->frequency); */
-    for(i=0; i<framesPerBuffer; i++)
-    {
-        sample = sin(wave->phase);
-        *out++ = sample;  /* left */
-        *out++ = sample;  /* right */
-        wave->phase += phase_step;
-        if( wave->phase > 2*M_PI )
-            wave->phase -= 2 * M_PI;
+
+    while (framesPerBuffer > 0) {
+        block = framesPerBuffer < FRAMES_PER_BUFFER ? framesPerBuffer : FRAMES_PER_BUFFER;
+        chirp_render(&wave->sweep, samples, wave->position, block);
+        wave->position += block;
+        channels_fan_out(samples, out, 2, block);
+        out += 2 * block;
+        framesPerBuffer -= block;
     }
-    wave->frequency += wave->freq_step;
-    *(wave->callback_done_time) = Pa_GetStreamTime(wave->stream); 
-    wave->callback_done_time++;
+    done = wave->stream != NULL ? Pa_GetStreamTime(wave->stream) : timeInfo->currentTime;
+    histogram_record(&wave->duration, done - timeInfo->currentTime);
+    histogram_record(&wave->slack, timeInfo->outputBufferDacTime - done);
     wave->counter++;
+    rt_check_leave();
     return 0;
 }
 
+/* Offline rendering runs the same callback on a virtual clock */
+static void freq_sweep_render(void *data, void *out, unsigned long frames,
+                              double time) {
+    PaStreamCallbackTimeInfo timeInfo = {time, time, time};
+
+    freq_sweep_callback(NULL, out, frames, &timeInfo, 0, data);
+}
+
 int main(int argc, char *argv[]) {
 
     PaStream *stream;
     PaError err;
     int i;
-    PaTime *invoked_start, *first_start, *done_start;
     int numDevices;
     PaDeviceInfo *deviceInfo;
     PaDeviceIndex output_dev;
-    float slack;
+    unsigned int played, report = REPORT_SECONDS, nap;
 
     PaStreamParameters outputParameters;
+    const char *output = NULL; /* file to render to instead of playing */
+    int opt;
+    chirp_shape shape = CHIRP_LINEAR;
      
     printf("PortAudio Test: output frequency swept sine wave.\n");
     /* Initialize our data for use by callback. */
@@ -87,31 +120,46 @@ int main(int argc, char *argv[]) {
     float sine_start_freq = (float) SINE_START_FREQ_IN_HZ;
     float sine_stop_freq = (float) SINE_STOP_FREQ_IN_HZ;
     unsigned int duration = DURATION_IN_SECONDS;
-    
+
+    while ((opt = getopt(argc, argv, "o:r:l")) != -1) {
+        if (opt == 'o') {
+            output = optarg;
+        } else if (opt == 'r' && atoi(optarg) > 0) {
+            report = atoi(optarg);
+        } else if (opt == 'l') {
+            shape = CHIRP_EXPONENTIAL;
+        } else {
+            fprintf(stderr, "Usage: freq_sweep [-o file] [-r seconds] [-l] [duration start_freq stop_freq]\n");
+            return 1;
+        }
+    }
+    /* Skip the options, keeping the positions of the other arguments */
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc==4) {
         duration = atoi(argv[1]);
         sine_start_freq = atof(argv[2]);
         sine_stop_freq = atof(argv[3]);
     }
 
-    unsigned int iterations = (unsigned int)
-                              ((float) duration / ((float) FRAMES_PER_BUFFER / (float) SAMPLE_RATE_IN_HZ));
-
-    waveform.frequency = (float) sine_start_freq;
-    waveform.phase = 0.0;
-    waveform.freq_step = (sine_stop_freq - sine_start_freq) / iterations;
+    chirp_init(&waveform.sweep, SAMPLE_RATE_IN_HZ, sine_start_freq, sine_stop_freq,
+               (unsigned long) duration * SAMPLE_RATE_IN_HZ, shape);
+    waveform.position = 0;
     waveform.counter = 0;
-    
-    /* Being conservative in the size to account for the non-exact duration of sound */
-    /* when using Pa_Sleep() (taking actually twice the memory we need in principle) */
-    waveform.callback_invoked_time = malloc(2*iterations*sizeof(PaTime));
-    waveform.first_sample_dac_time = malloc(2*iterations*sizeof(PaTime));
-    waveform.callback_done_time = malloc(2*iterations*sizeof(PaTime));
-    
-
-    invoked_start = waveform.callback_invoked_time;
-    first_start = waveform.first_sample_dac_time;
-    done_start = waveform.callback_done_time;
+    histogram_init(&waveform.duration);
+    histogram_init(&waveform.slack);
+    histogram_init(&waveform.jitter);
+
+    if (output != NULL) {
+        waveform.stream = NULL;
+        if (offline_render(output, OFFLINE_FLOAT32, 2, SAMPLE_RATE_IN_HZ,
+                           FRAMES_PER_BUFFER, duration, freq_sweep_render,
+                           &waveform) < 0)
+            return 1;
+        err = paNoError;
+        goto results;
+    }
 
     /* Initialize library before making any other calls. */
     err = Pa_Initialize();
@@ -166,8 +214,15 @@ err = Pa_OpenStream(
     err = Pa_StartStream( stream );
     if( err != paNoError ) goto error;
  
-    /* Sleep for several seconds. */
-    Pa_Sleep(duration*1000);
+    /* Sleep for several seconds, reading the histograms as they fill */
+    for (played=0; played<duration; played+=nap) {
+        nap = duration - played < report ? duration - played : report;
+        Pa_Sleep(nap*1000);
+        if (played + nap < duration) {
+            printf("After %u s:\n", played + nap);
+            print_histograms(&waveform);
+        }
+    }
  
     err = Pa_StopStream( stream );
     if( err != paNoError ) goto error;
@@ -178,19 +233,9 @@ err = Pa_OpenStream(
     Pa_Terminate();
     printf("Test finished.\n");
  
-    waveform.callback_invoked_time = invoked_start;
-    waveform.first_sample_dac_time = first_start;
-    waveform.callback_done_time = done_start;
-
-    for(i=0; i<waveform.counter; i++) {
-        slack = *first_start - *done_start;
-        printf("Iteration %d:\t Invoke: %11.4f\t DAC: %11.4f\t Done: %11.4f\t Slack: %7.4f\n", i, (float)*(invoked_start), *first_start++, *done_start++, slack);
-        invoked_start++;
-    }
-
-    free(waveform.callback_invoked_time);
-    free(waveform.first_sample_dac_time);
-    free(waveform.callback_done_time);
+results:
+    printf("%lu callbacks:\n", waveform.counter);
+    print_histograms(&waveform);
     return err;
 
 error: